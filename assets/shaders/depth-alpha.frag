@@ -0,0 +1,19 @@
+#version 330 core
+
+// The fragment shader of the depth pre-pass for the alpha tested materials. It must discard exactly the fragments that
+// lit.frag discards, otherwise the holes would be filled with the depth of a surface that is never shaded.
+
+in Varyings {
+    vec4 color;
+    vec2 tex_coord;
+} fs_in;
+
+uniform vec4 tint;
+uniform sampler2D tex;
+uniform float alphaThreshold;
+uniform vec2 textureScale = vec2(1.0);
+
+void main(){
+    float alpha = (tint * fs_in.color * texture(tex, fs_in.tex_coord * textureScale)).a;
+    if (alpha < alphaThreshold) discard;
+}
@@ -0,0 +1,6 @@
+#version 330 core
+
+// The fragment shader of the depth pre-pass for the opaque materials: only the depth is written
+
+void main(){
+}
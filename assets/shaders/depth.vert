@@ -0,0 +1,24 @@
+#version 330 core
+
+// The vertex shader of the depth pre-pass. The position must be computed exactly like in the shaders of the main pass
+// (hence "invariant"), since the main pass only draws the fragments whose depth is equal to the pre-pass's.
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 tex_coord;
+
+out Varyings {
+    vec4 color;
+    vec2 tex_coord;
+} vs_out;
+
+invariant gl_Position;
+
+uniform mat4 transform;
+
+void main(){
+    // The color and texture coordinates are only used by the alpha tested materials (see depth-alpha.frag)
+    vs_out.color = color;
+    vs_out.tex_coord = tex_coord;
+    gl_Position = transform * vec4(position, 1.0);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+in Varyings {
+    vec4 color;
+    vec2 tex_coord;
+} fs_in;
+
+out vec4 frag_color;
+
+// The unlit color of the submesh's material (the tint times the diffuse color for lit materials)
+uniform vec4 tint;
+uniform sampler2D tex;
+uniform bool has_texture;
+uniform vec2 textureScale;
+uniform float alphaThreshold;
+
+void main(){
+    vec4 texture_color = tint * fs_in.color;
+    if (has_texture) texture_color *= texture(tex, fs_in.tex_coord * textureScale);
+    if (texture_color.a < alphaThreshold) discard;
+    // The covered pixels are opaque, the rest of the picture stays clear (alpha 0) so the impostors can cut it out
+    frag_color = vec4(texture_color.rgb, 1.0);
+}
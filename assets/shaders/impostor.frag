@@ -0,0 +1,135 @@
+#version 330 core
+
+#define LIGHT_DIRECTIONAL 0
+#define LIGHT_POINT 1
+#define LIGHT_SPOT 2
+
+in Varyings {
+    vec2 tex_coord;
+    vec3 normal;
+    vec3 world_position;
+} fs_in;
+
+out vec4 frag_color;
+
+// The per frame data, uploaded once per frame by the forward renderer.
+// It must match "FrameUniforms" in forward-renderer.hpp (and the block in the other shaders)
+layout(std140) uniform FrameData {
+    vec3 camera_position;
+    int directional_light_count;
+    vec3 fog_color;
+    bool fog_enabled;
+    float fog_start;
+    float fog_end;
+    float horizon_threshold;
+    bool has_spotlight_cookie;
+    vec3 camera_forward;
+    float cluster_near;
+    ivec3 cluster_grid;
+    float cluster_depth_scale;
+    vec2 viewport_size;
+    // The first texel of light_data, light_clusters and light_indices (see "LightClusters::getTexelOffsets")
+    int light_data_offset;
+    int light_clusters_offset;
+    int light_indices_offset;
+};
+
+// The fog can be fixed when the shader is compiled (see "ForwardRenderer::getShaderFeatures"),
+// which removes its branch. Without a define, it is read from the frame data.
+#ifndef FOG_ENABLED
+#define FOG_ENABLED fog_enabled
+#endif
+
+struct Light {
+    vec3 position;
+    int type;
+    vec3 direction;
+    float inner_cone_angle;
+    vec3 color;
+    float outer_cone_angle;
+    vec3 attenuation;
+    bool isFlashlight;
+};
+
+// The lights of the frame (see "LightClusters"). The directional lights come first and reach every fragment, the others
+// are only listed (in light_indices) by the clusters that they reach. A cluster is a tile of the screen and a depth slice.
+uniform samplerBuffer light_data;
+uniform usamplerBuffer light_clusters;  // The (first index, count) of the lights of each cluster
+uniform usamplerBuffer light_indices;
+
+// Reads a light from its 4 texels (see "LightData" in light-clusters.hpp)
+Light read_light(int index) {
+    vec4 t0 = texelFetch(light_data, light_data_offset + index * 4);
+    vec4 t1 = texelFetch(light_data, light_data_offset + index * 4 + 1);
+    vec4 t2 = texelFetch(light_data, light_data_offset + index * 4 + 2);
+    vec4 t3 = texelFetch(light_data, light_data_offset + index * 4 + 3);
+    return Light(t0.xyz, int(t0.w), t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w > 0.5);
+}
+
+// When the renderer assigns the lights per object (see "LightClusters::selectLights"), it gives each draw its own
+// lights instead of the clusters (-1 means that the clusters are used)
+uniform int object_light_count = -1;
+uniform ivec4 object_lights[2];
+
+// Returns the (first index, count) of the point and spot lights that reach this fragment: the lights of its cluster or
+// the lights of the object
+uvec2 find_lights(vec3 world_position) {
+    if (object_light_count >= 0) return uvec2(0u, uint(object_light_count));
+    float depth = max(dot(world_position - camera_position, camera_forward), cluster_near);
+    int slice = clamp(int(log(depth / cluster_near) * cluster_depth_scale), 0, cluster_grid.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / viewport_size * vec2(cluster_grid.xy)), ivec2(0), cluster_grid.xy - 1);
+    return texelFetch(light_clusters, light_clusters_offset + tile.x + cluster_grid.x * (tile.y + cluster_grid.y * slice)).xy;
+}
+
+// Returns the index (in light_data) of the k-th light of the list found by find_lights
+int get_light_index(uvec2 lights, int k) {
+    if (object_light_count >= 0) return object_lights[k / 4][k % 4];
+    return int(texelFetch(light_indices, light_indices_offset + int(lights.x) + k).r);
+}
+
+// The baked picture of the mesh (its alpha is 0 outside of the mesh)
+uniform sampler2D tex;
+uniform float alphaThreshold = 0.5;
+
+void main(){
+    vec4 texture_color = texture(tex, fs_in.tex_coord);
+    if (texture_color.a < alphaThreshold) discard;
+
+    // The same diffuse lighting and fog as lit-instanced.frag, without the specular and the cookie since the impostors
+    // are only used far away. The picture already holds the diffuse color of the materials.
+    vec3 result = vec3(0.0);
+    uvec2 found_lights = find_lights(fs_in.world_position);
+    int light_total = directional_light_count + int(found_lights.y);
+    for (int k = 0; k < light_total; k++) {
+        int i = k < directional_light_count ? k : get_light_index(found_lights, k - directional_light_count);
+        Light light = read_light(i);
+        vec3 light_direction;
+        float attenuation = 1.0;
+        if (light.type == LIGHT_DIRECTIONAL) {
+            light_direction = -normalize(light.direction);
+        } else {
+            vec3 to_light = light.position - fs_in.world_position;
+            float distance = length(to_light);
+            light_direction = to_light / distance;
+            attenuation = 1.0 / (light.attenuation.x +
+                                 light.attenuation.y * distance +
+                                 light.attenuation.z * distance * distance);
+            if (light.type == LIGHT_SPOT) {
+                float theta = dot(light_direction, -normalize(light.direction));
+                if (theta < light.outer_cone_angle) continue;
+                attenuation *= smoothstep(light.outer_cone_angle, light.inner_cone_angle, theta);
+            }
+        }
+        float diff = abs(dot(normalize(fs_in.normal), light_direction));
+        result += attenuation * diff * texture_color.rgb * light.color;
+    }
+
+    if (FOG_ENABLED && length(result) > 0.001) {
+        float distance_to_camera = length(camera_position - fs_in.world_position);
+        float fog_factor = clamp((distance_to_camera - fog_start) / (fog_end - fog_start), 0.0, 1.0);
+        vec3 distance_scaled_fog = fog_color * (1.0 - fog_factor);
+        result = mix(result, distance_scaled_fog, fog_factor);
+    }
+
+    frag_color = vec4(result, 1.0);
+}
@@ -0,0 +1,94 @@
+#version 330 core
+
+// Draws each instance of an instanced renderer as a quad which turns around the instance's up axis to face the camera
+// (a cylindrical billboard). The quad covers the bounds of the mesh, like the picture baked into the impostor texture.
+// There are no vertex attributes: the corners of the quad come from gl_VertexID (drawn as a triangle strip of 4 vertices).
+
+out Varyings {
+    vec2 tex_coord;
+    vec3 normal;
+    vec3 world_position;
+} vs_out;
+
+// The per frame data, uploaded once per frame by the forward renderer.
+// It must match "FrameUniforms" in forward-renderer.hpp (and the block in the other shaders)
+layout(std140) uniform FrameData {
+    vec3 camera_position;
+    int directional_light_count;
+    vec3 fog_color;
+    bool fog_enabled;
+    float fog_start;
+    float fog_end;
+    float horizon_threshold;
+    bool has_spotlight_cookie;
+    vec3 camera_forward;
+    float cluster_near;
+    ivec3 cluster_grid;
+    float cluster_depth_scale;
+    vec2 viewport_size;
+    // The first texel of light_data, light_clusters and light_indices (see "LightClusters::getTexelOffsets")
+    int light_data_offset;
+    int light_clusters_offset;
+    int light_indices_offset;
+};
+
+uniform mat4 VP;
+uniform usamplerBuffer instance_data;  // The transforms of all the instances (see decode_instance)
+uniform bool compact_instances;  // The format of instance_data (see InstanceFormat)
+uniform int instance_offset;  // The index of the first instance of the draw (GL 3.3 has no base instance)
+uniform vec3 impostor_min, impostor_max;  // The bounds of the mesh in its local space
+
+// Converts a half float (in the lower 16 bits) to a float (GLSL 3.30 has no unpackHalf2x16)
+float half_to_float(uint bits) {
+    uint exponent = (bits >> 10u) & 31u;
+    float mantissa = float(bits & 1023u) / 1024.0;
+    float value = exponent == 0u ? mantissa * exp2(-14.0) : (1.0 + mantissa) * exp2(float(exponent) - 15.0);
+    return (bits & 32768u) != 0u ? -value : value;
+}
+
+// Reads the model matrix of an instance. The matrix format is 4 RGBA32UI texels holding the bits of the columns.
+// The compact format is 3 RG32UI texels holding the position (floats) then the rotation and the scale (half floats),
+// and the matrix is rebuilt as translate(position) * rotateX * rotateY * rotateZ * scale (like InstanceTransform::toMatrix).
+mat4 decode_instance(int index) {
+    if (!compact_instances) {
+        int first_texel = index * 4;
+        return mat4(
+            uintBitsToFloat(texelFetch(instance_data, first_texel)),
+            uintBitsToFloat(texelFetch(instance_data, first_texel + 1)),
+            uintBitsToFloat(texelFetch(instance_data, first_texel + 2)),
+            uintBitsToFloat(texelFetch(instance_data, first_texel + 3))
+        );
+    }
+    int first_texel = index * 3;
+    uvec2 a = texelFetch(instance_data, first_texel).xy;
+    uvec2 b = texelFetch(instance_data, first_texel + 1).xy;
+    uvec2 c = texelFetch(instance_data, first_texel + 2).xy;
+    vec3 position = vec3(uintBitsToFloat(a.x), uintBitsToFloat(a.y), uintBitsToFloat(b.x));
+    vec3 rotation = vec3(half_to_float(b.y & 65535u), half_to_float(b.y >> 16u), half_to_float(c.x & 65535u));
+    vec3 scale = vec3(half_to_float(c.x >> 16u), half_to_float(c.y & 65535u), half_to_float(c.y >> 16u));
+
+    vec3 s = sin(rotation), k = cos(rotation);
+    mat3 rotate_x = mat3(1.0, 0.0, 0.0,  0.0, k.x, s.x,  0.0, -s.x, k.x);
+    mat3 rotate_y = mat3(k.y, 0.0, -s.y,  0.0, 1.0, 0.0,  s.y, 0.0, k.y);
+    mat3 rotate_z = mat3(k.z, s.z, 0.0,  -s.z, k.z, 0.0,  0.0, 0.0, 1.0);
+    mat3 rotation_scale = rotate_x * rotate_y * rotate_z * mat3(scale.x, 0.0, 0.0,  0.0, scale.y, 0.0,  0.0, 0.0, scale.z);
+    return mat4(vec4(rotation_scale[0], 0.0), vec4(rotation_scale[1], 0.0), vec4(rotation_scale[2], 0.0), vec4(position, 1.0));
+}
+
+void main(){
+    mat4 instanceMatrix = decode_instance(instance_offset + gl_InstanceID);
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));
+
+    // The quad stands on the bottom of the bounds and is as wide as their widest side
+    vec3 center = (impostor_min + impostor_max) * 0.5;
+    float half_width = max(impostor_max.x - impostor_min.x, impostor_max.z - impostor_min.z) * 0.5;
+    vec3 origin = (instanceMatrix * vec4(center.x, impostor_min.y, center.z, 1.0)).xyz;
+    vec3 up = mat3(instanceMatrix) * vec3(0.0, impostor_max.y - impostor_min.y, 0.0);
+    vec3 to_camera = camera_position - origin;
+    vec3 right = normalize(cross(up, to_camera)) * half_width * length(instanceMatrix[0].xyz);
+
+    vs_out.world_position = origin + right * (corner.x * 2.0 - 1.0) + up * corner.y;
+    vs_out.normal = normalize(cross(right, up));
+    vs_out.tex_coord = corner;
+    gl_Position = VP * vec4(vs_out.world_position, 1.0);
+}
@@ -9,10 +9,11 @@ out vec4 frag_color;
 
 uniform vec4 tint;
 uniform sampler2D tex;
+uniform float alphaThreshold;
 
 void main(){
     frag_color = tint * fs_in.color * texture(tex, fs_in.tex_coord);
-    if(frag_color.a < 0.08) {
+    if(frag_color.a < alphaThreshold) {
         discard;
     }
 }
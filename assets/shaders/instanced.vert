@@ -4,16 +4,59 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec4 color;
 layout(location = 2) in vec2 tex_coord;
 layout(location = 3) in vec3 normal;
-layout(location = 4) in mat4 instanceMatrix;
 
 out Varyings {
     vec4 color;
     vec2 tex_coord;
 } vs_out;
 
+// The depth pre-pass computes the same position (see depth.vert)
+invariant gl_Position;
+
 uniform mat4 VP;
+uniform usamplerBuffer instance_data;  // The transforms of all the instances (see decode_instance)
+uniform bool compact_instances;  // The format of instance_data (see InstanceFormat)
+uniform int instance_offset;  // The index of the first instance of the draw (GL 3.3 has no base instance)
+
+// Converts a half float (in the lower 16 bits) to a float (GLSL 3.30 has no unpackHalf2x16)
+float half_to_float(uint bits) {
+    uint exponent = (bits >> 10u) & 31u;
+    float mantissa = float(bits & 1023u) / 1024.0;
+    float value = exponent == 0u ? mantissa * exp2(-14.0) : (1.0 + mantissa) * exp2(float(exponent) - 15.0);
+    return (bits & 32768u) != 0u ? -value : value;
+}
+
+// Reads the model matrix of an instance. The matrix format is 4 RGBA32UI texels holding the bits of the columns.
+// The compact format is 3 RG32UI texels holding the position (floats) then the rotation and the scale (half floats),
+// and the matrix is rebuilt as translate(position) * rotateX * rotateY * rotateZ * scale (like InstanceTransform::toMatrix).
+mat4 decode_instance(int index) {
+    if (!compact_instances) {
+        int first_texel = index * 4;
+        return mat4(
+            uintBitsToFloat(texelFetch(instance_data, first_texel)),
+            uintBitsToFloat(texelFetch(instance_data, first_texel + 1)),
+            uintBitsToFloat(texelFetch(instance_data, first_texel + 2)),
+            uintBitsToFloat(texelFetch(instance_data, first_texel + 3))
+        );
+    }
+    int first_texel = index * 3;
+    uvec2 a = texelFetch(instance_data, first_texel).xy;
+    uvec2 b = texelFetch(instance_data, first_texel + 1).xy;
+    uvec2 c = texelFetch(instance_data, first_texel + 2).xy;
+    vec3 position = vec3(uintBitsToFloat(a.x), uintBitsToFloat(a.y), uintBitsToFloat(b.x));
+    vec3 rotation = vec3(half_to_float(b.y & 65535u), half_to_float(b.y >> 16u), half_to_float(c.x & 65535u));
+    vec3 scale = vec3(half_to_float(c.x >> 16u), half_to_float(c.y & 65535u), half_to_float(c.y >> 16u));
+
+    vec3 s = sin(rotation), k = cos(rotation);
+    mat3 rotate_x = mat3(1.0, 0.0, 0.0,  0.0, k.x, s.x,  0.0, -s.x, k.x);
+    mat3 rotate_y = mat3(k.y, 0.0, -s.y,  0.0, 1.0, 0.0,  s.y, 0.0, k.y);
+    mat3 rotate_z = mat3(k.z, s.z, 0.0,  -s.z, k.z, 0.0,  0.0, 0.0, 1.0);
+    mat3 rotation_scale = rotate_x * rotate_y * rotate_z * mat3(scale.x, 0.0, 0.0,  0.0, scale.y, 0.0,  0.0, 0.0, scale.z);
+    return mat4(vec4(rotation_scale[0], 0.0), vec4(rotation_scale[1], 0.0), vec4(rotation_scale[2], 0.0), vec4(position, 1.0));
+}
 
 void main(){
+    mat4 instanceMatrix = decode_instance(instance_offset + gl_InstanceID);
     gl_Position = VP * instanceMatrix * vec4(position, 1.0);
     vs_out.color = color;
     vs_out.tex_coord = tex_coord;
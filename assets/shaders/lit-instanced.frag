@@ -1,6 +1,5 @@
 #version 330 core
 
-#define MAX_LIGHTS 8
 #define LIGHT_DIRECTIONAL 0
 #define LIGHT_POINT 1
 #define LIGHT_SPOT 2
@@ -19,24 +18,87 @@ out vec4 frag_color;
 uniform vec4 tint;
 uniform sampler2D tex;
 uniform float alphaThreshold;
+
+// The per frame data, uploaded once per frame by the forward renderer.
+// It must match "FrameUniforms" in forward-renderer.hpp (and the block in the other shaders)
+layout(std140) uniform FrameData {
+    vec3 camera_position;
+    int directional_light_count;
+    vec3 fog_color;
+    bool fog_enabled;
+    float fog_start;
+    float fog_end;
+    float horizon_threshold;
+    bool has_spotlight_cookie;
+    vec3 camera_forward;
+    float cluster_near;
+    ivec3 cluster_grid;
+    float cluster_depth_scale;
+    vec2 viewport_size;
+    // The first texel of light_data, light_clusters and light_indices (see "LightClusters::getTexelOffsets")
+    int light_data_offset;
+    int light_clusters_offset;
+    int light_indices_offset;
+};
+
+// The features of the renderer can be fixed when the shader is compiled (see "ForwardRenderer::getShaderFeatures"),
+// which removes their branches. Without a define, they are read from the frame data.
+#ifndef FOG_ENABLED
+#define FOG_ENABLED fog_enabled
+#endif
+#ifndef SPOTLIGHT_COOKIE
+#define SPOTLIGHT_COOKIE has_spotlight_cookie
+#endif
+
 struct Light {
-    int type;
     vec3 position;
+    int type;
     vec3 direction;
-    vec3 color;
-    vec3 attenuation;       
-    //Necessary for spotlight
     float inner_cone_angle;
+    vec3 color;
     float outer_cone_angle;
-    bool isFlashlight;  // Whether this light uses the cookie texture
+    vec3 attenuation;
+    bool isFlashlight;
 };
-uniform int light_count;
-uniform Light lights[MAX_LIGHTS];
-uniform vec3 camera_position;
+
+// The lights of the frame (see "LightClusters"). The directional lights come first and reach every fragment, the others
+// are only listed (in light_indices) by the clusters that they reach. A cluster is a tile of the screen and a depth slice.
+uniform samplerBuffer light_data;
+uniform usamplerBuffer light_clusters;  // The (first index, count) of the lights of each cluster
+uniform usamplerBuffer light_indices;
+
+// Reads a light from its 4 texels (see "LightData" in light-clusters.hpp)
+Light read_light(int index) {
+    vec4 t0 = texelFetch(light_data, light_data_offset + index * 4);
+    vec4 t1 = texelFetch(light_data, light_data_offset + index * 4 + 1);
+    vec4 t2 = texelFetch(light_data, light_data_offset + index * 4 + 2);
+    vec4 t3 = texelFetch(light_data, light_data_offset + index * 4 + 3);
+    return Light(t0.xyz, int(t0.w), t1.xyz, t1.w, t2.xyz, t2.w, t3.xyz, t3.w > 0.5);
+}
+
+// When the renderer assigns the lights per object (see "LightClusters::selectLights"), it gives each draw its own
+// lights instead of the clusters (-1 means that the clusters are used)
+uniform int object_light_count = -1;
+uniform ivec4 object_lights[2];
+
+// Returns the (first index, count) of the point and spot lights that reach this fragment: the lights of its cluster or
+// the lights of the object
+uvec2 find_lights(vec3 world_position) {
+    if (object_light_count >= 0) return uvec2(0u, uint(object_light_count));
+    float depth = max(dot(world_position - camera_position, camera_forward), cluster_near);
+    int slice = clamp(int(log(depth / cluster_near) * cluster_depth_scale), 0, cluster_grid.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / viewport_size * vec2(cluster_grid.xy)), ivec2(0), cluster_grid.xy - 1);
+    return texelFetch(light_clusters, light_clusters_offset + tile.x + cluster_grid.x * (tile.y + cluster_grid.y * slice)).xy;
+}
+
+// Returns the index (in light_data) of the k-th light of the list found by find_lights
+int get_light_index(uvec2 lights, int k) {
+    if (object_light_count >= 0) return object_lights[k / 4][k % 4];
+    return int(texelFetch(light_indices, light_indices_offset + int(lights.x) + k).r);
+}
 
 // Spotlight cookie texture (projects pattern through spotlight)
 uniform sampler2D spotlight_cookie;
-uniform bool has_spotlight_cookie = false;
 
 // Material properties (Blinn-Phong)
 uniform vec3 ambient_color = vec3(0.1);
@@ -46,9 +108,15 @@ uniform float shininess = 32.0;
 uniform int illuminationModel = 1;
 uniform vec2 textureScale = vec2(1.0);  // Texture UV scaling from MTL -s option
 
+// The maps that the material has can be fixed when the shader is compiled (by the "HAS_*_MAP" defines of the
+// permutation picked by "LitMaterial"), which removes their branches. Without a define, they are read from the uniforms.
+
 // Normal mapping
 uniform sampler2D normalMap;
+#ifndef HAS_NORMAL_MAP
 uniform bool hasNormalMap = false;
+#define HAS_NORMAL_MAP hasNormalMap
+#endif
 uniform vec2 normalTextureScale = vec2(1.0);
 uniform float bumpMultiplier = 1.0;
 
@@ -58,17 +126,22 @@ uniform sampler2D roughnessMap;
 uniform sampler2D aoMap;
 uniform sampler2D emissiveMap;
 
+#ifndef HAS_SPECULAR_MAP
 uniform bool hasSpecularMap = false;
+#define HAS_SPECULAR_MAP hasSpecularMap
+#endif
+#ifndef HAS_ROUGHNESS_MAP
 uniform bool hasRoughnessMap = false;
+#define HAS_ROUGHNESS_MAP hasRoughnessMap
+#endif
+#ifndef HAS_AO_MAP
 uniform bool hasAoMap = false;
+#define HAS_AO_MAP hasAoMap
+#endif
+#ifndef HAS_EMISSIVE_MAP
 uniform bool hasEmissiveMap = false;
-
-// Fog properties
-uniform vec3 fog_color = vec3(0.02, 0.02, 0.02);  // Dark bluish fog
-uniform float fog_density = 0.01;
-uniform float fog_start = 30.0;
-uniform float fog_end = 100.0;
-uniform bool fog_enabled = true;
+#define HAS_EMISSIVE_MAP hasEmissiveMap
+#endif
 
 void main(){
     // Apply texture scaling to UV coordinates
@@ -81,7 +154,7 @@ void main(){
     // Calculate the normal - either from normal map or vertex normal
     vec3 normal = normalize(fs_in.normal);
     
-    if (hasNormalMap) {
+    if (HAS_NORMAL_MAP) {
         // Construct TBN matrix for transforming normal map to world space
         vec3 T = normalize(fs_in.tangent);
         vec3 N = normal;
@@ -104,24 +177,24 @@ void main(){
     }
     
     // Sample material texture maps (fallback to uniforms if no map)
-    vec3 material_specular = hasSpecularMap 
+    vec3 material_specular = HAS_SPECULAR_MAP 
         ? texture(specularMap, scaled_tex_coord).rgb 
         : specular_color;
     
     // Roughness to shininess conversion: shininess = 2 / roughness^4 - 2
     // Inverse: roughness = pow(2 / (shininess + 2), 0.25)
-    float material_shininess = hasRoughnessMap 
+    float material_shininess = HAS_ROUGHNESS_MAP 
         ? (2.0 / pow(clamp(texture(roughnessMap, scaled_tex_coord).r, 0.001, 0.999), 4.0) - 2.0)
         : shininess;
     
-    float material_ao = hasAoMap 
+    float material_ao = HAS_AO_MAP 
         ? texture(aoMap, scaled_tex_coord).r 
         : 1.0;
     
     // Apply AO to diffuse color (represents indirect light occlusion)
     vec3 material_diffuse = diffuse_color * texture_color.rgb * material_ao;
     
-    vec3 material_emissive = hasEmissiveMap 
+    vec3 material_emissive = HAS_EMISSIVE_MAP 
         ? texture(emissiveMap, scaled_tex_coord).rgb 
         : vec3(0.0);
     
@@ -131,38 +204,42 @@ void main(){
     // No ambient light - only flashlight illuminates (horror game atmosphere)
     // Start with emissive only (if present)
     vec3 result = material_emissive;
-    //Loop over all lights to add their effects to our rendered pixel
-    for (int i = 0;i< light_count && i<MAX_LIGHTS;i++){
+    //Loop over the directional lights then the other lights that reach this fragment to add their effects to our rendered pixel
+    uvec2 found_lights = find_lights(fs_in.world_position);
+    int light_total = directional_light_count + int(found_lights.y);
+    for (int k = 0; k < light_total; k++){
+        int i = k < directional_light_count ? k : get_light_index(found_lights, k - directional_light_count);
+        Light light = read_light(i);
         vec3 light_direction;
         float attenuation = 1.0;
-        if(lights[i].type == LIGHT_DIRECTIONAL){
+        if(light.type == LIGHT_DIRECTIONAL){
             // We assume directional light like sun or such does not attenuate
             // Global Illumination as an example
-            light_direction = -normalize(lights[i].direction);
+            light_direction = -normalize(light.direction);
         }
         else{
             //Handling spot/point light, we do physics calculations in world space
-        vec3 to_light = lights[i].position - fs_in.world_position;
+        vec3 to_light = light.position - fs_in.world_position;
         float distance = length(to_light);
         light_direction = to_light/distance;
-        attenuation = 1.0 / (lights[i].attenuation.x +
-                             lights[i].attenuation.y * distance +
-                             lights[i].attenuation.z * distance * distance);
-        if(lights[i].type == LIGHT_SPOT){
-            float theta = dot(light_direction,-normalize(lights[i].direction));
+        attenuation = 1.0 / (light.attenuation.x +
+                             light.attenuation.y * distance +
+                             light.attenuation.z * distance * distance);
+        if(light.type == LIGHT_SPOT){
+            float theta = dot(light_direction,-normalize(light.direction));
             // Hard cutoff - anything outside outer cone is pitch black
-            if(theta < lights[i].outer_cone_angle) {
+            if(theta < light.outer_cone_angle) {
                 continue;
             } else {
                 // Smooth transition only between outer and inner cone
-                float intensity = smoothstep(lights[i].outer_cone_angle, lights[i].inner_cone_angle, theta);
+                float intensity = smoothstep(light.outer_cone_angle, light.inner_cone_angle, theta);
                 attenuation *= intensity;
                 
                 // Apply spotlight cookie texture if available for flashlights
-                if (has_spotlight_cookie && lights[i].isFlashlight) {
+                if (SPOTLIGHT_COOKIE && light.isFlashlight) {
                     // Efficient planar projection for cookie UV
-                    vec3 spotDir = normalize(lights[i].direction);
-                    vec3 toFrag = fs_in.world_position - lights[i].position;
+                    vec3 spotDir = normalize(light.direction);
+                    vec3 toFrag = fs_in.world_position - light.position;
                     
                     // Create a coordinate system for the spotlight
                     vec3 spotRight = normalize(cross(spotDir, vec3(0.0, 1.0, 0.0)));
@@ -172,7 +249,7 @@ void main(){
                     float distAlongSpot = dot(toFrag, spotDir);
                     
                     // Calculate cone spread at this distance (tan of outer angle)
-                    float outerAngle = lights[i].outer_cone_angle;
+                    float outerAngle = light.outer_cone_angle;
                     float coneRadius = distAlongSpot * sqrt(1.0 - outerAngle*outerAngle) / outerAngle;
                     
                     // UV from projection onto plane, normalized by cone radius
@@ -188,20 +265,20 @@ void main(){
         }
         // Diffuse: using abs() for two-sided lighting (lights surfaces regardless of normal direction)
         float  diff = abs(dot(normal, light_direction));
-        vec3 diffuse = diff * material_diffuse * lights[i].color;
+        vec3 diffuse = diff * material_diffuse * light.color;
         
         // Specular - only if illuminationModel is 2 (full Blinn-Phong)
         vec3 specular = vec3(0.0);
         if (illuminationModel == 2) {
             vec3 halfway = normalize(light_direction+view_dir);
             float spec = pow(max(0,dot(halfway,normal)), material_shininess);
-            specular = spec * material_specular * lights[i].color;
+            specular = spec * material_specular * light.color;
         }
         result += attenuation * (diffuse + specular);
     }
     
     // Calculate fog only if enabled and there's any light
-    if (fog_enabled && length(result) > 0.001) {
+    if (FOG_ENABLED && length(result) > 0.001) {
         float distance_to_camera = length(camera_position - fs_in.world_position);
         
         // Linear fog that increases between fog_start and fog_end
@@ -14,6 +14,9 @@ out Varyings {
     vec3 tangent;
 } vs_out;
 
+// The depth pre-pass computes the same position (see depth.vert)
+invariant gl_Position;
+
 uniform mat4 transform;
 uniform mat4 M;
 uniform mat4 M_IT;
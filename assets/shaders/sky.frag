@@ -11,15 +11,38 @@ out vec4 frag_color;
 uniform vec4 tint;
 uniform sampler2D tex;
 
-// Fog properties
-uniform vec3 fog_color = vec3(0.0, 0.0, 0.0);  // Pitch black
-uniform float horizon_threshold = 0.3;  // Y threshold for steep upward viewing
-uniform bool fog_enabled = true;
+// The per frame data, uploaded once per frame by the forward renderer (only the fog is used here).
+// It must match "FrameUniforms" in forward-renderer.hpp (and the block in the other shaders)
+layout(std140) uniform FrameData {
+    vec3 camera_position;
+    int directional_light_count;
+    vec3 fog_color;
+    bool fog_enabled;
+    float fog_start;
+    float fog_end;
+    float horizon_threshold;
+    bool has_spotlight_cookie;
+    vec3 camera_forward;
+    float cluster_near;
+    ivec3 cluster_grid;
+    float cluster_depth_scale;
+    vec2 viewport_size;
+    // The first texel of light_data, light_clusters and light_indices (see "LightClusters::getTexelOffsets")
+    int light_data_offset;
+    int light_clusters_offset;
+    int light_indices_offset;
+};
+
+// The fog can be fixed when the shader is compiled (see "ForwardRenderer::getShaderFeatures"),
+// which removes its branch. Without a define, it is read from the frame data.
+#ifndef FOG_ENABLED
+#define FOG_ENABLED fog_enabled
+#endif
 
 void main(){
     vec4 result = tint * fs_in.color * texture(tex, fs_in.tex_coord);
     
-    if (fog_enabled) {
+    if (FOG_ENABLED) {
         // Use the sphere's local Y coordinate to determine if we're at horizon level
         // For a sphere centered at origin with radius ~1: Y ranges from -1 (straight down) to +1 (straight up)
         // We want fog everywhere except when looking steeply upward
@@ -9,6 +9,9 @@ out Varyings {
     vec2 tex_coord;
 } vs_out;
 
+// The depth pre-pass computes the same position (see depth.vert)
+invariant gl_Position;
+
 uniform mat4 transform;
 
 void main(){
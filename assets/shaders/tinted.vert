@@ -7,6 +7,9 @@ out Varyings {
     vec4 color;
 } vs_out;
 
+// The depth pre-pass computes the same position (see depth.vert)
+invariant gl_Position;
+
 uniform mat4 transform;
 
 void main(){
@@ -24,6 +24,9 @@
 #endif
 
 #include "texture/screenshot.hpp"
+#include "gl-state.hpp"
+#include "shader/shader-cache.hpp"
+#include "stream-buffer.hpp"
 
 std::string default_screenshot_filepath() {
     std::stringstream stream;
@@ -201,6 +204,9 @@ int our::Application::run(int run_for_frames) {
     std::cout << "VERSION         : " << glGetString(GL_VERSION) << std::endl;
     std::cout << "GLSL VERSION    : " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 
+    // Keep the compiled shader programs on the disk so the next runs don't have to compile them again
+    ShaderCache::initialize(app_config.value("shader_cache", ""));
+
 #if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
     // if we have OpenGL debug messages enabled, set the message callback
     glDebugMessageCallback(opengl_callback, nullptr);
@@ -283,8 +289,15 @@ int our::Application::run(int run_for_frames) {
         // Get the current time (the time at which we are starting the current frame).
         double current_frame_time = glfwGetTime();
 
+        // ImGui changes the OpenGL state behind the back of the state shadow, so it starts each frame from scratch
+        our::gl_state::invalidate();
+
+        // The per frame data (uniforms, lights, text) is streamed into the segment of this frame, which the GPU may still be reading
+        // if it is more than "stream_buffer::FRAMES_IN_FLIGHT" frames behind
+        our::stream_buffer::beginFrame();
         // Call onDraw, in which we will draw the current frame, and send to it the time difference between the last and current frame
         if(currentState) currentState->onDraw(current_frame_time - last_frame_time);
+        our::stream_buffer::endFrame();
         last_frame_time = current_frame_time; // Then update the last frame start time (this frame is now the last frame)
 
 #if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
@@ -344,6 +357,11 @@ int our::Application::run(int run_for_frames) {
 
     // Call for cleaning up
     if(currentState) currentState->onDestroy();
+    // The states that aren't running may still keep their resources alive (see "keep_resident" in the play state)
+    for (auto& [name, state] : states) state->onShutdown();
+    // The shared shader programs and the stream buffer outlive the states, so they are deleted last (while the context still exists)
+    ShaderCache::clear();
+    our::stream_buffer::destroy();
 
     // Shutdown ImGui & destroy the context
     ImGui_ImplOpenGL3_Shutdown();
@@ -35,6 +35,8 @@ namespace our {
         virtual void onImmediateGui(){}                 // Called every frame to draw the Immediate GUI (if any).
         virtual void onDraw(double deltaTime){}         // Called every frame in the game loop passing the time taken to draw the frame "Delta time".
         virtual void onDestroy(){}                      // Called once after the game loop ends for house cleaning.
+        virtual void onShutdown(){}                     // Called for every state when the application closes (while the OpenGL context still exists),
+                                                        // to release what a state keeps alive between its runs.
 
 
         // Override these functions to get mouse and keyboard event.
@@ -46,6 +48,8 @@ namespace our {
 
         //Returns a pointer
         Application* getApp() { return application; }
+
+        virtual ~State() = default;
     };
 
     // This class act as base class for all the Applications covered in the examples.
@@ -27,8 +27,9 @@ namespace our
                 auto shader = new ShaderProgram();
                 shader->attach(vsPath, GL_VERTEX_SHADER);
                 shader->attach(fsPath, GL_FRAGMENT_SHADER);
-                shader->link();
-                assets[name] = shader;
+                // The link is finished when the shader is first used, so the driver can compile it in the background
+                shader->beginLink();
+                set(name, shader);
             }
         }
     };
@@ -44,7 +45,7 @@ namespace our
             for (auto &[name, desc] : data.items())
             {
                 std::string path = desc.get<std::string>();
-                assets[name] = texture_utils::loadImage(path);
+                set(name, texture_utils::loadImage(path));
             }
         }
     };
@@ -65,7 +66,7 @@ namespace our
             {
                 auto sampler = new Sampler();
                 sampler->deserialize(desc);
-                assets[name] = sampler;
+                set(name, sampler);
             }
         }
     };
@@ -87,7 +88,7 @@ namespace our
                     keepCPUCopy = desc.value("keepCPUCopy", false);
                 }
                 // Use loadOBJWithMaterials for better material support
-                assets[name] = mesh_utils::loadOBJWithMaterials(path,keepCPUCopy);
+                set(name, mesh_utils::loadOBJWithMaterials(path,keepCPUCopy));
 
             }
         }
@@ -116,7 +117,7 @@ namespace our
                 auto material = createMaterialFromType(type);
                 material->materialName = name; // Set material name from JSON key
                 material->deserialize(desc);
-                assets[name] = material;
+                set(name, material);
             }
         }
     };
@@ -146,4 +147,24 @@ namespace our
         AssetLoader<Material>::clear();
     }
 
+    ReleasedAssets releaseAllAssets()
+    {
+        ReleasedAssets released;
+        released.shaders = AssetLoader<ShaderProgram>::release();
+        released.textures = AssetLoader<Texture2D>::release();
+        released.samplers = AssetLoader<Sampler>::release();
+        released.meshes = AssetLoader<Mesh>::release();
+        released.materials = AssetLoader<Material>::release();
+        return released;
+    }
+
+    void restoreAllAssets(ReleasedAssets released)
+    {
+        AssetLoader<ShaderProgram>::restore(std::move(released.shaders));
+        AssetLoader<Texture2D>::restore(std::move(released.textures));
+        AssetLoader<Sampler>::restore(std::move(released.samplers));
+        AssetLoader<Mesh>::restore(std::move(released.meshes));
+        AssetLoader<Material>::restore(std::move(released.materials));
+    }
+
 }
\ No newline at end of file
@@ -2,10 +2,17 @@
 
 #include <unordered_map>
 #include <string>
+#include <utility>
 #include <json/json.hpp>
 
 namespace our {
 
+    class ShaderProgram;
+    class Texture2D;
+    class Sampler;
+    class Mesh;
+    class Material;
+
     // This static template class will hold the loaded assets
     // and can be called from anywhere to get an asset by its name.
     // Since we have different types of assets, this declared as a template class
@@ -39,6 +46,24 @@ namespace our {
             }
             assets.clear();
         }
+        // Takes all the assets out of this class without deleting them, so "get" and "clear" don't see them anymore.
+        // They belong to the caller until they are given back by "restore".
+        static std::unordered_map<std::string, T*> release(){
+            return std::exchange(assets, {});
+        }
+        // Gives back the assets taken by "release" (replacing the assets with the same names that were loaded since)
+        static void restore(std::unordered_map<std::string, T*> released){
+            for(auto& [name, asset] : released) set(name, asset);
+        }
+    private:
+        // Stores an asset under the given name, deleting the asset that had this name before (if any)
+        static void set(const std::string& name, T* asset){
+            auto [it, inserted] = assets.try_emplace(name, asset);
+            if(!inserted && it->second != asset){
+                delete it->second;
+                it->second = asset;
+            }
+        }
     };
 
     // Given a json holding the data for all the assets
@@ -48,4 +73,17 @@ namespace our {
     void deserializeAllAssets(const nlohmann::json& assetData);
     // This will call "AssetLoader<T>::clear" for all the different asset types T
     void clearAllAssets();
+
+    // The assets of every type taken out of the asset loaders by "releaseAllAssets"
+    struct ReleasedAssets {
+        std::unordered_map<std::string, ShaderProgram*> shaders;
+        std::unordered_map<std::string, Texture2D*> textures;
+        std::unordered_map<std::string, Sampler*> samplers;
+        std::unordered_map<std::string, Mesh*> meshes;
+        std::unordered_map<std::string, Material*> materials;
+    };
+    // These call "AssetLoader<T>::release" and "AssetLoader<T>::restore" for all the different asset types T.
+    // A state that keeps its objects alive while another state runs uses them so the other state can't replace or delete its assets.
+    ReleasedAssets releaseAllAssets();
+    void restoreAllAssets(ReleasedAssets released);
 }
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "bounding-volume-hierarchy.hpp"
+
+#include <algorithm>
+
+namespace our {
+
+    void BoundingVolumeHierarchy::build(std::vector<Item> newItems) {
+        nodes.clear();
+        items = std::move(newItems);
+        if (items.empty()) return;
+        // A binary tree with n leaves has 2n - 1 nodes
+        nodes.reserve(2 * (items.size() / LEAF_SIZE + 1));
+        nodes.emplace_back();
+        buildNode(0, 0, (std::uint32_t)items.size());
+    }
+
+    void BoundingVolumeHierarchy::buildNode(std::uint32_t index, std::uint32_t first, std::uint32_t count) {
+        Node node;
+        node.first = first;
+        node.count = count;
+        node.minBound = items[first].minBound;
+        node.maxBound = items[first].maxBound;
+        glm::vec3 minCenter = items[first].minBound + items[first].maxBound, maxCenter = minCenter;
+        for (std::uint32_t i = first; i < first + count; i++) {
+            node.minBound = glm::min(node.minBound, items[i].minBound);
+            node.maxBound = glm::max(node.maxBound, items[i].maxBound);
+            glm::vec3 center = items[i].minBound + items[i].maxBound; // Twice the center (only the order matters)
+            minCenter = glm::min(minCenter, center);
+            maxCenter = glm::max(maxCenter, center);
+        }
+        if (count <= LEAF_SIZE) {
+            nodes[index] = node;
+            return;
+        }
+
+        // Split the items at the median of the axis along which their centers are the most spread
+        glm::vec3 spread = maxCenter - minCenter;
+        int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+        std::uint32_t half = count / 2;
+        std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+                         [axis](const Item& a, const Item& b) {
+                             return a.minBound[axis] + a.maxBound[axis] < b.minBound[axis] + b.maxBound[axis];
+                         });
+        // The children are added next to each other, so the right one is always at "left + 1"
+        node.left = (std::uint32_t)nodes.size();
+        nodes[index] = node;
+        nodes.emplace_back();
+        nodes.emplace_back();
+        buildNode(node.left, first, half);
+        buildNode(node.left + 1, first + half, count - half);
+    }
+
+    void BoundingVolumeHierarchy::query(const Frustum& frustum, const glm::vec3& eye, float maxDistance,
+                                        std::vector<std::uint32_t>& out) const {
+        if (nodes.empty()) return;
+        float maxDistanceSquared = maxDistance * maxDistance;
+        // Returns whether the box is beyond the distance (-1), partially within it (0) or completely within it (1)
+        auto classifyDistance = [&](const glm::vec3& minBound, const glm::vec3& maxBound) {
+            if (maxDistance <= 0.0f) return 1;
+            glm::vec3 nearest = glm::clamp(eye, minBound, maxBound) - eye;
+            if (glm::dot(nearest, nearest) > maxDistanceSquared) return -1;
+            glm::vec3 farthest = glm::max(glm::abs(minBound - eye), glm::abs(maxBound - eye));
+            return glm::dot(farthest, farthest) <= maxDistanceSquared ? 1 : 0;
+        };
+
+        std::vector<std::uint32_t> stack; // The nodes left to visit
+        stack.push_back(0);
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            FrustumTest test = frustum.classifyBox(node.minBound, node.maxBound);
+            if (test == FrustumTest::OUTSIDE) continue;
+            int distance = classifyDistance(node.minBound, node.maxBound);
+            if (distance < 0) continue;
+            bool accepted = test == FrustumTest::INSIDE && distance > 0;
+            if (accepted) {
+                // The whole branch is visible, so its items are added without testing them
+                for (std::uint32_t i = node.first; i < node.first + node.count; i++) out.push_back(items[i].value);
+            } else if (node.left == 0) {
+                for (std::uint32_t i = node.first; i < node.first + node.count; i++) {
+                    const Item& item = items[i];
+                    if (frustum.isBoxInside(item.minBound, item.maxBound) &&
+                        classifyDistance(item.minBound, item.maxBound) >= 0) {
+                        out.push_back(item.value);
+                    }
+                }
+            } else {
+                stack.push_back(node.left);
+                stack.push_back(node.left + 1);
+            }
+        }
+    }
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+namespace our {
+
+    // A bounding volume hierarchy over axis aligned boxes which don't move (e.g. the render commands of static entities).
+    // It is a binary tree in which every node holds the bounds of the boxes below it, so a query can reject (or accept)
+    // a whole branch with a single test instead of testing each box.
+    class BoundingVolumeHierarchy {
+    public:
+        struct Item {
+            glm::vec3 minBound, maxBound;
+            std::uint32_t value; // What the query returns for this item (e.g. the index of a render command)
+        };
+
+        // Builds the hierarchy from the given items (replacing the previous ones)
+        void build(std::vector<Item> items);
+        void clear() { nodes.clear(); items.clear(); }
+        bool empty() const { return items.empty(); }
+
+        // Appends to "out" the values of the items that are (at least partially) inside the frustum and closer to "eye"
+        // than "maxDistance" (0 means that the distance is not checked)
+        void query(const Frustum& frustum, const glm::vec3& eye, float maxDistance, std::vector<std::uint32_t>& out) const;
+
+    private:
+        // The items below a node are "items[first, first + count)". A node with no children is a leaf, otherwise its
+        // children are "nodes[left]" and "nodes[left + 1]".
+        struct Node {
+            glm::vec3 minBound, maxBound;
+            std::uint32_t first, count;
+            std::uint32_t left = 0;
+        };
+        static constexpr std::uint32_t LEAF_SIZE = 4; // The most items in a leaf
+
+        std::vector<Node> nodes;
+        std::vector<Item> items;
+
+        // Fills "nodes[index]" with the node of the items in [first, first + count) and builds its children
+        void buildNode(std::uint32_t index, std::uint32_t first, std::uint32_t count);
+    };
+
+}
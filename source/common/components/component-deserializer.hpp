@@ -16,39 +16,48 @@
 
 namespace our {
 
-// Given a json object, this function picks and creates a component in the given
-// entity based on the "type" specified in the json object which is later
-// deserialized from the rest of the json object
-inline void deserializeComponent(const nlohmann::json& data, Entity* entity) {
-    std::string type = data.value("type", "");
-    Component* component = nullptr;
+// A function that adds a component of a specific type to the given entity
+typedef Component* (*ComponentFactory)(Entity* entity);
+
+// Given the "type" string of a component, this function returns the factory
+// that adds a component of that type (or nullptr if the type is unknown)
+inline ComponentFactory findComponentFactory(const std::string& type) {
     if (type == CameraComponent::getID()) {
-        component = entity->addComponent<CameraComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<CameraComponent>(); };
     } else if (type == FreeCameraControllerComponent::getID()) {
-        component = entity->addComponent<FreeCameraControllerComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<FreeCameraControllerComponent>(); };
     } else if (type == MovementComponent::getID()) {
-        component = entity->addComponent<MovementComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<MovementComponent>(); };
     } else if (type == MeshRendererComponent::getID()) {
-        component = entity->addComponent<MeshRendererComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<MeshRendererComponent>(); };
     } else if (type == InstancedRendererComponent::getID()) {
-        component = entity->addComponent<InstancedRendererComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<InstancedRendererComponent>(); };
     } else if (type == AudioController::getID()) {
-        component = entity->addComponent<AudioController>();
+        return [](Entity* e) -> Component* { return e->addComponent<AudioController>(); };
     } else if (type == LightComponent::getID()) {
-        component = entity->addComponent<LightComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<LightComponent>(); };
     } else if (type == our::PlayerComponent::getID()) {
-        component = entity->addComponent<our::PlayerComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<our::PlayerComponent>(); };
     } else if (type == our::SlendermanComponent::getID()) {
-        component = entity->addComponent<our::SlendermanComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<our::SlendermanComponent>(); };
     } else if (type == our::PageSpawnerComponent::getID()) {
-        component = entity->addComponent<our::PageSpawnerComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<our::PageSpawnerComponent>(); };
     } else if (type == our::PageComponent::getID()) {
-        component = entity->addComponent<our::PageComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<our::PageComponent>(); };
     } else if (type == our::ColliderComponent::getID()) {
-        component = entity->addComponent<our::ColliderComponent>();
+        return [](Entity* e) -> Component* { return e->addComponent<our::ColliderComponent>(); };
     }
+    return nullptr;
+}
 
-    if (component) component->deserialize(data);
+// Given a json object, this function picks and creates a component in the given
+// entity based on the "type" specified in the json object which is later
+// deserialized from the rest of the json object
+inline void deserializeComponent(const nlohmann::json& data, Entity* entity) {
+    ComponentFactory factory = findComponentFactory(data.value("type", ""));
+    if (!factory) return;
+    Component* component = factory(entity);
+    component->deserialize(data);
 }
 
 }  // namespace our
\ No newline at end of file
@@ -1,11 +1,297 @@
 #include "instanced-renderer.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
 #include <iostream>
+#include <numeric>
 
 #include "../asset-loader.hpp"
+#include "../mesh/mesh-utils.hpp"
 #include "../texture/tree-utils.hpp"
+
+// SSE2 is part of every x86-64 CPU, so it is used whenever the target supports it (AVX would need extra compiler flags)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OUR_CULLING_SSE2 1
+#include <emmintrin.h>
+#endif
+
 namespace our {
+
+namespace {
+    struct CullingParameters {
+        glm::vec3 cameraPos;
+        float maxDistanceSquared;
+        glm::vec4 planes[6];
+        float radius;
+        bool distanceCulling, frustumCulling;
+    };
+
+    // Tests the spheres in [begin, end) and writes the indices of the visible ones to "out" (which must have room for
+    // end - begin indices). Returns the number of visible spheres.
+    size_t cullRange(const CullingParameters& params, const float* xs, const float* ys, const float* zs,
+                     size_t begin, size_t end, std::uint32_t* out) {
+        size_t count = 0;
+        size_t i = begin;
+#ifdef OUR_CULLING_SSE2
+        // 4 spheres are tested at once against the distance and all the planes, then their lanes are compacted
+        const __m128 cameraX = _mm_set1_ps(params.cameraPos.x);
+        const __m128 cameraY = _mm_set1_ps(params.cameraPos.y);
+        const __m128 cameraZ = _mm_set1_ps(params.cameraPos.z);
+        const __m128 maxDistanceSquared = _mm_set1_ps(params.maxDistanceSquared);
+        const __m128 negativeRadius = _mm_set1_ps(-params.radius);
+        const __m128 allLanes = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (; i + 4 <= end; i += 4) {
+            __m128 x = _mm_loadu_ps(xs + i), y = _mm_loadu_ps(ys + i), z = _mm_loadu_ps(zs + i);
+            __m128 visible = allLanes;
+            if (params.distanceCulling) {
+                __m128 dx = _mm_sub_ps(x, cameraX), dy = _mm_sub_ps(y, cameraY), dz = _mm_sub_ps(z, cameraZ);
+                __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                visible = _mm_and_ps(visible, _mm_cmple_ps(distanceSquared, maxDistanceSquared));
+            }
+            if (params.frustumCulling) {
+                for (const glm::vec4& plane : params.planes) {
+                    __m128 distance = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+                        _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                    visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negativeRadius));
+                }
+            }
+            // Every lane is written but the count only moves past the visible ones, so there are no branches
+            int mask = _mm_movemask_ps(visible);
+            for (int lane = 0; lane < 4; lane++) {
+                out[count] = (std::uint32_t)(i + lane);
+                count += (mask >> lane) & 1;
+            }
+        }
+#endif
+        // The remaining spheres (or all of them if SSE2 is not available)
+        for (; i < end; i++) {
+            glm::vec3 position(xs[i], ys[i], zs[i]);
+            bool visible = true;
+            if (params.distanceCulling) {
+                glm::vec3 offset = position - params.cameraPos;
+                visible = glm::dot(offset, offset) <= params.maxDistanceSquared;
+            }
+            if (visible && params.frustumCulling) {
+                for (const glm::vec4& plane : params.planes) {
+                    if (glm::dot(glm::vec3(plane), position) + plane.w < -params.radius) {
+                        visible = false;
+                        break;
+                    }
+                }
+            }
+            out[count] = (std::uint32_t)i;
+            count += visible;
+        }
+        return count;
+    }
+}
+
+InstancedRendererComponent::~InstancedRendererComponent() {
+    if (instanceTexture) {
+        gl_state::forgetTexture(instanceTexture);
+        glDeleteTextures(1, &instanceTexture);
+    }
+    if (instanceBuffer) glDeleteBuffers(1, &instanceBuffer);
+    // The first level is the shared mesh from the asset loader, the others are owned
+    for (size_t level = 1; level < lods.size(); level++) delete lods[level].mesh;
+    delete impostorTexture;
+}
+
+void InstancedRendererComponent::buildCells() {
+    cells.clear();
+    cullingX.clear();
+    cullingY.clear();
+    cullingZ.clear();
+    cellRadius = 0.0f;
+    if (instances.empty()) return;
+
+    // Find the cell of each instance (relative to the lowest position so the cell coordinates are never negative)
+    glm::vec3 origin = instances[0].position;
+    for (const auto& instance : instances) origin = glm::min(origin, instance.position);
+    float size = cellSize > 0.0f ? cellSize : 1.0f;
+    auto cellOf = [&](const glm::vec3& pos) {
+        std::uint64_t x = (std::uint64_t)((pos.x - origin.x) / size);
+        std::uint64_t z = (std::uint64_t)((pos.z - origin.z) / size);
+        return (z << 32) | x;
+    };
+
+    // Sort the instances by cell (row by row, so the neighbouring cells of a row are next to each other)
+    std::vector<std::uint32_t> order(instances.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::vector<std::uint64_t> keys(instances.size());
+    for (size_t i = 0; i < keys.size(); i++) keys[i] = cellOf(instances[i].position);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::uint32_t a, std::uint32_t b) { return keys[a] < keys[b]; });
+
+    std::vector<InstanceTransform> sorted(order.size());
+    for (size_t i = 0; i < order.size(); i++) sorted[i] = instances[order[i]];
+    instances.swap(sorted);
+
+    // Build the cells from the runs of equal keys
+    glm::vec3 padding(cullingBoundingRadius);
+    for (size_t i = 0; i < order.size(); i++) {
+        const glm::vec3& pos = instances[i].position;
+        // The world bounds of the instance's mesh (the bounds of the transformed box, see Arvo's method)
+        glm::vec3 meshMin = pos, meshMax = pos;
+        if (mesh) {
+            glm::mat4 M = instances[i].toMatrix();
+            glm::vec3 localMin = mesh->getMinBound(), localMax = mesh->getMaxBound();
+            for (int column = 0; column < 3; column++) {
+                glm::vec3 a = glm::vec3(M[column]) * localMin[column], b = glm::vec3(M[column]) * localMax[column];
+                meshMin += glm::min(a, b);
+                meshMax += glm::max(a, b);
+            }
+        } else {
+            meshMin -= padding;
+            meshMax += padding;
+        }
+        if (i == 0 || keys[order[i]] != keys[order[i - 1]]) {
+            cells.push_back({(std::uint32_t)i, 0, pos - padding, pos + padding, meshMin, meshMax});
+        }
+        InstanceCell& cell = cells.back();
+        cell.count++;
+        cell.minBound = glm::min(cell.minBound, pos - padding);
+        cell.maxBound = glm::max(cell.maxBound, pos + padding);
+        cell.meshMinBound = glm::min(cell.meshMinBound, meshMin);
+        cell.meshMaxBound = glm::max(cell.meshMaxBound, meshMax);
+    }
+    for (const InstanceCell& cell : cells) {
+        glm::vec3 center = (cell.minBound + cell.maxBound) * 0.5f;
+        cullingX.push_back(center.x);
+        cullingY.push_back(center.y);
+        cullingZ.push_back(center.z);
+        cellRadius = std::max(cellRadius, glm::length(cell.maxBound - cell.minBound) * 0.5f);
+    }
+}
+
+bool InstancedRendererComponent::updateVisibleInstances(const glm::vec3& cameraPos,
+                                                        const Frustum& frustum,
+                                                        ThreadPool* pool,
+                                                        const OcclusionCuller* occlusion) {
+    size_t cellCount = cells.size();
+    if (!enableDistanceCulling && !enableFrustumCulling) {
+        // Without culling, every cell is visible
+        visibleCells.resize(cellCount);
+        std::iota(visibleCells.begin(), visibleCells.end(), 0u);
+    } else {
+        CullingParameters params;
+        params.cameraPos = cameraPos;
+        // The cell's radius already contains the instances' bounding radius
+        float effectiveMaxDist = maxRenderDistance + cellRadius;
+        params.maxDistanceSquared = effectiveMaxDist * effectiveMaxDist;
+        for (int i = 0; i < 6; i++) params.planes[i] = frustum.planes[i];
+        params.radius = cellRadius;
+        params.distanceCulling = enableDistanceCulling;
+        params.frustumCulling = enableFrustumCulling;
+
+        size_t chunkCount = (cellCount + CULLING_CHUNK_SIZE - 1) / CULLING_CHUNK_SIZE;
+        if (!pool || chunkCount <= 1) {
+            visibleCells.resize(cellCount);
+            visibleCells.resize(cullRange(params, cullingX.data(), cullingY.data(), cullingZ.data(),
+                                          0, cellCount, visibleCells.data()));
+        } else {
+            // Each chunk writes to its own list, then the lists are joined in order (so the result is the same as a single thread's)
+            chunkVisibleCells.resize(chunkCount);
+            pool->parallelFor(cellCount, CULLING_CHUNK_SIZE, [&](size_t begin, size_t end) {
+                std::vector<std::uint32_t>& chunk = chunkVisibleCells[begin / CULLING_CHUNK_SIZE];
+                chunk.resize(end - begin);
+                chunk.resize(cullRange(params, cullingX.data(), cullingY.data(), cullingZ.data(), begin, end, chunk.data()));
+            });
+            visibleCells.clear();
+            for (const auto& chunk : chunkVisibleCells) {
+                visibleCells.insert(visibleCells.end(), chunk.begin(), chunk.end());
+            }
+        }
+    }
+
+    // Pick the level of each visible cell by the distance to its center, and merge the cells of a level whose instances
+    // follow each other into a single range
+    for (InstanceLod& lod : lods) {
+        lod.visibleRanges.clear();
+        lod.visibleBounds.clear();
+    }
+    impostorRanges.clear();
+    impostorBounds.clear();
+    bool anyVisible = false;
+    for (std::uint32_t index : visibleCells) {
+        const InstanceCell& cell = cells[index];
+        if (occlusion && !occlusion->isBoxVisible(cell.meshMinBound, cell.meshMaxBound)) continue;
+        anyVisible = true;
+        glm::vec3 offset = glm::vec3(cullingX[index], cullingY[index], cullingZ[index]) - cameraPos;
+        float distanceSquared = glm::dot(offset, offset);
+        std::vector<std::pair<std::uint32_t, std::uint32_t>>* ranges;
+        std::vector<std::pair<glm::vec3, glm::vec3>>* bounds;
+        if (impostorDistance > 0.0f && distanceSquared >= impostorDistance * impostorDistance) {
+            ranges = &impostorRanges;
+            bounds = &impostorBounds;
+        } else {
+            size_t level = lods.size() - 1;
+            while (level > 0 && distanceSquared < lods[level].distance * lods[level].distance) level--;
+            ranges = &lods[level].visibleRanges;
+            bounds = &lods[level].visibleBounds;
+        }
+        if (!ranges->empty() && ranges->back().first + ranges->back().second == cell.first) {
+            ranges->back().second += cell.count;
+            bounds->back().first = glm::min(bounds->back().first, cell.meshMinBound);
+            bounds->back().second = glm::max(bounds->back().second, cell.meshMaxBound);
+        } else {
+            ranges->emplace_back(cell.first, cell.count);
+            bounds->emplace_back(cell.meshMinBound, cell.meshMaxBound);
+        }
+    }
+    return anyVisible;
+}
+
+void InstancedRendererComponent::bindInstanceData() {
+    if (!instanceTexture) {
+        // The transforms never change, so they are uploaded once
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+        GLenum texelFormat;
+        if (instanceFormat == InstanceFormat::COMPACT) {
+            // 3 RG32UI texels: (position.x, position.y), (position.z, rotation.x | rotation.y),
+            // (rotation.z | scale.x, scale.y | scale.z) where the rotation and the scale are half floats
+            std::vector<std::uint32_t> data;
+            data.reserve(instances.size() * 6);
+            auto halves = [](float low, float high) {
+                return (std::uint32_t)glm::packHalf1x16(low) | ((std::uint32_t)glm::packHalf1x16(high) << 16);
+            };
+            for (const InstanceTransform& instance : instances) {
+                data.push_back(glm::floatBitsToUint(instance.position.x));
+                data.push_back(glm::floatBitsToUint(instance.position.y));
+                data.push_back(glm::floatBitsToUint(instance.position.z));
+                data.push_back(halves(instance.rotation.x, instance.rotation.y));
+                data.push_back(halves(instance.rotation.z, instance.scale.x));
+                data.push_back(halves(instance.scale.y, instance.scale.z));
+            }
+            glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(std::uint32_t), data.data(), GL_STATIC_DRAW);
+            texelFormat = GL_RG32UI;
+        } else {
+            // 4 RGBA32UI texels (one per column) holding the bits of the matrix
+            std::vector<glm::mat4> matrices;
+            matrices.reserve(instances.size());
+            for (const InstanceTransform& instance : instances) matrices.push_back(instance.toMatrix());
+            glBufferData(GL_TEXTURE_BUFFER, matrices.size() * sizeof(glm::mat4), matrices.data(), GL_STATIC_DRAW);
+            texelFormat = GL_RGBA32UI;
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glGenTextures(1, &instanceTexture);
+        gl_state::bindBufferTexture(reserved_texture_units::INSTANCE_DATA, instanceTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, texelFormat, instanceBuffer);
+    }
+    gl_state::bindBufferTexture(reserved_texture_units::INSTANCE_DATA, instanceTexture);
+}
+
+glm::mat4 InstanceTransform::toMatrix() const {
+    glm::mat4 transform = glm::translate(glm::mat4(1.0), position);
+    transform = glm::rotate(transform, rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
+    transform = glm::rotate(transform, rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
+    transform = glm::rotate(transform, rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+    return glm::scale(transform, scale);
+}
+
 // Receives the mesh & material from the AssetLoader by the names given in the
 // json object
 void InstancedRendererComponent::deserialize(const nlohmann::json& data) {
@@ -15,6 +301,24 @@ void InstancedRendererComponent::deserialize(const nlohmann::json& data) {
     mesh = AssetLoader<Mesh>::get(meshName);
     material = AssetLoader<Material>::get(data["material"].get<std::string>());
 
+    // Load the levels of detail (optional). Each level is a copy of the mesh simplified to "ratio" of its triangles,
+    // which is used for the cells beyond "distance" (so the mesh must be loaded with "keepCPUCopy").
+    lods.push_back({mesh, 0.0f});
+    if (mesh && data.contains("lods") && data["lods"].is_array()) {
+        for (const auto& lod : data["lods"]) {
+            Mesh* simplified = mesh_utils::simplify(mesh, lod.value("ratio", 0.5f));
+            if (!simplified) {
+                std::cerr << "Failed to simplify the mesh \"" << meshName << "\" for a level of detail "
+                          << "(is it loaded with keepCPUCopy?)" << std::endl;
+                continue;
+            }
+            lods.push_back({simplified, lod.value("distance", 0.0f)});
+        }
+        std::sort(lods.begin() + 1, lods.end(),
+                  [](const InstanceLod& a, const InstanceLod& b) { return a.distance < b.distance; });
+    }
+    impostorDistance = data.value("impostorDistance", 0.0f);
+
     // Load submesh materials if specified
     if (data.contains("submeshMaterials") &&
         data["submeshMaterials"].is_object()) {
@@ -77,15 +381,18 @@ void InstancedRendererComponent::deserialize(const nlohmann::json& data) {
 
         // Load culling configuration (optional)
         maxRenderDistance = data.value("maxRenderDistance", 100.0f);
+        instanceFormat = data.value("instanceFormat", std::string("matrix")) == "compact"
+                             ? InstanceFormat::COMPACT : InstanceFormat::MATRIX;
+        cellSize = data.value("cellSize", 16.0f);
         cullingBoundingRadius = data.value("cullingBoundingRadius", 10.0f);
         enableDistanceCulling = data.value("enableDistanceCulling", true);
         enableFrustumCulling = data.value("enableFrustumCulling", true);
 
-        auto instances =
+        auto generated =
             generateFromMap(filename, worldSize, density, positionRandomRange,
                             rotationRandomRange, scaleRandomRange);
 
-        for (const auto& inst : instances) {
+        for (const auto& inst : generated) {
             // Apply position
             glm::vec3 finalPos = inst.pos + inst.posRandom;
             if (hasPositionOffset) {
@@ -108,19 +415,10 @@ void InstancedRendererComponent::deserialize(const nlohmann::json& data) {
                 finalScale *= scaleMultiplier;
             }
 
-            glm::mat4 transform = glm::translate(glm::mat4(1.0), finalPos);
-            transform = glm::rotate(transform, finalRotation.x,
-                                    glm::vec3(1.0f, 0.0f, 0.0f));
-            transform = glm::rotate(transform, finalRotation.y,
-                                    glm::vec3(0.0f, 1.0f, 0.0f));
-            transform = glm::rotate(transform, finalRotation.z,
-                                    glm::vec3(0.0f, 0.0f, 1.0f));
-            transform = glm::scale(transform, finalScale);
-            
-            InstanceMats.push_back(transform);
-            instancePositions.push_back(
-                finalPos);  // Cache position for culling
+            // Only the components are kept, the matrix is made when needed (see "InstanceTransform::toMatrix")
+            instances.push_back({finalPos, finalRotation, finalScale});
         }
+        buildCells();
 
         
     }
@@ -129,16 +427,16 @@ void InstancedRendererComponent::deserialize(const nlohmann::json& data) {
 
 
 std::pair<glm::vec3, glm::vec3> InstancedRendererComponent::getBoundingBox() const {
-            if (instancePositions.empty()) {
+            if (instances.empty()) {
                 return {glm::vec3(0), glm::vec3(0)};
             }
             
-            glm::vec3 min = instancePositions[0];
-            glm::vec3 max = instancePositions[0];
+            glm::vec3 min = instances[0].position;
+            glm::vec3 max = instances[0].position;
             
-            for (const auto& pos : instancePositions) {
-                min = glm::min(min, pos);
-                max = glm::max(max, pos);
+            for (const auto& instance : instances) {
+                min = glm::min(min, instance.position);
+                max = glm::max(max, instance.position);
             }
             
             return {min, max};
@@ -1,66 +1,86 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <unordered_map>
 
 #include "../ecs/component.hpp"
 #include "../material/material.hpp"
 #include "../mesh/mesh.hpp"
+#include "../thread-pool.hpp"
+#include "../frustum.hpp"
+#include "../occlusion-culler.hpp"
 
 namespace our {
 
-// Frustum planes for culling
-struct Frustum {
-    glm::vec4 planes[6];  // left, right, bottom, top, near, far
-
-    void extractFromVP(const glm::mat4& VP) {
-        // Extract frustum planes from view-projection matrix
-        // Left plane
-        planes[0] = glm::vec4(VP[0][3] + VP[0][0], VP[1][3] + VP[1][0],
-                              VP[2][3] + VP[2][0], VP[3][3] + VP[3][0]);
-        // Right plane
-        planes[1] = glm::vec4(VP[0][3] - VP[0][0], VP[1][3] - VP[1][0],
-                              VP[2][3] - VP[2][0], VP[3][3] - VP[3][0]);
-        // Bottom plane
-        planes[2] = glm::vec4(VP[0][3] + VP[0][1], VP[1][3] + VP[1][1],
-                              VP[2][3] + VP[2][1], VP[3][3] + VP[3][1]);
-        // Top plane
-        planes[3] = glm::vec4(VP[0][3] - VP[0][1], VP[1][3] - VP[1][1],
-                              VP[2][3] - VP[2][1], VP[3][3] - VP[3][1]);
-        // Near plane
-        planes[4] = glm::vec4(VP[0][3] + VP[0][2], VP[1][3] + VP[1][2],
-                              VP[2][3] + VP[2][2], VP[3][3] + VP[3][2]);
-        // Far plane
-        planes[5] = glm::vec4(VP[0][3] - VP[0][2], VP[1][3] - VP[1][2],
-                              VP[2][3] - VP[2][2], VP[3][3] - VP[3][2]);
-        // Normalize planes
-        for (int i = 0; i < 6; i++) {
-            float length = glm::length(glm::vec3(planes[i]));
-            planes[i] /= length;
-        }
-    }
+// The transform of a single instance. The matrix is "translate(position) * rotateX * rotateY * rotateZ * scale".
+struct InstanceTransform {
+    glm::vec3 position;
+    glm::vec3 rotation;  // Euler angles in radians (applied in the order X, Y then Z)
+    glm::vec3 scale;
 
-    // Check if a sphere is inside or intersects the frustum
-    bool isSphereInside(const glm::vec3& center, float radius) const {
-        for (int i = 0; i < 6; i++) {
-            float distance =
-                glm::dot(glm::vec3(planes[i]), center) + planes[i].w;
-            if (distance < -radius) {
-                return false;  // Sphere is completely outside this plane
-            }
-        }
-        return true;
-    }
+    glm::mat4 toMatrix() const;
+};
+
+// How the instance transforms are stored on the GPU
+enum class InstanceFormat {
+    MATRIX,  // The full matrix (64 bytes per instance)
+    COMPACT  // The position as floats, the rotation and the scale as half floats (24 bytes per instance)
 };
 
 class InstancedRendererComponent : public Component {
+    // The scratch index lists of the culling chunks (kept to avoid reallocating them every frame)
+    std::vector<std::vector<std::uint32_t>> chunkVisibleCells;
+    // A buffer texture holding all the instance transforms (sorted by cell) in the instance format. It is uploaded once,
+    // and the shaders fetch the transform of each instance from it by "instance_offset + gl_InstanceID", so nothing
+    // is uploaded per frame.
+    GLuint instanceBuffer = 0, instanceTexture = 0;
+
+    // Sorts the instances by the grid cell in which they lie and computes the bounds of the cells
+    void buildCells();
+
    public:
+    // The number of grid cells (not instances) culled by a single thread. Larger grids are split over the thread pool.
+    // The grids only have a few hundred cells (e.g. ~625 for the forest, culled in 3 chunks), so the chunks are small.
+    static constexpr size_t CULLING_CHUNK_SIZE = 256;
+
+    // A cell of the grid (on the x & z axes) in which the instances are bucketed at load time.
+    // The instances of a cell are contiguous in "instances", so a visible cell is drawn as a single range of instances.
+    struct InstanceCell {
+        std::uint32_t first, count;  // The range of the cell's instances
+        glm::vec3 minBound, maxBound;  // The bounds of the cell's instances (including their culling radius)
+        // The bounds of the meshes of the cell's instances (tighter than the culling bounds, used by the occlusion culling)
+        glm::vec3 meshMinBound, meshMaxBound;
+    };
+
+    // A level of detail. Each visible cell is drawn with the last level whose distance it is beyond, and the cells of a
+    // level are drawn together (one instanced draw per range of the level).
+    struct InstanceLod {
+        Mesh* mesh = nullptr;  // The first level is "mesh" itself, the others are simplified copies owned by the component
+        float distance = 0.0f;  // The distance from the camera (to the cell's center) from which this level is used
+        // The visible instances drawn with this level as (first, count) ranges. The consecutive cells are merged into one range.
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> visibleRanges = {};
+        // The (min, max) world bounds of the meshes of each visible range (used to pick the lights of the range)
+        std::vector<std::pair<glm::vec3, glm::vec3>> visibleBounds = {};
+    };
+
     Mesh* mesh = nullptr;
     Material* material = nullptr;
-    std::vector<glm::mat4> InstanceMats;       // All instance matrices
-    std::vector<glm::vec3> instancePositions;  // Cached positions for culling
-    std::vector<glm::mat4>
-        visibleInstanceMats;  // Visible instances after culling
+    std::vector<InstanceLod> lods;  // Never empty once deserialized (the first level is the full mesh)
+    // The farthest level: each instance is a single quad facing the camera and textured with a picture of the mesh.
+    // The picture is baked by the renderer the first time the impostors are drawn (see "ForwardRenderer::bakeImpostor").
+    float impostorDistance = 0.0f;  // The distance from which the impostors are used (0 means no impostors)
+    Texture2D* impostorTexture = nullptr;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> impostorRanges;  // Like "InstanceLod::visibleRanges"
+    std::vector<std::pair<glm::vec3, glm::vec3>> impostorBounds;  // Like "InstanceLod::visibleBounds"
+    std::vector<InstanceTransform> instances;  // All the instances (sorted by cell)
+    InstanceFormat instanceFormat = InstanceFormat::MATRIX;
+    std::vector<InstanceCell> cells;
+    float cellSize = 16.0f;  // The size of the grid cells
+    float cellRadius = 0.0f;  // The radius of the bounding sphere of the largest cell (used for all of them)
+    // The centers of the cells as separate arrays (structure of arrays) so that the culling can test 4 cells at once
+    std::vector<float> cullingX, cullingY, cullingZ;
+    std::vector<std::uint32_t> visibleCells;  // Indices of the visible cells after culling
     std::unordered_map<std::string, Material*> submeshMaterials;
     std::string meshName;
 
@@ -84,43 +104,30 @@ class InstancedRendererComponent : public Component {
 
     static std::string getID() { return "Instanced Renderer"; }
 
+    InstancedRendererComponent() = default;
+    ~InstancedRendererComponent() override;
+
     Material* getMaterialForSubmesh(const std::string& submeshName) const {
         auto it = submeshMaterials.find(submeshName);
         return (it != submeshMaterials.end()) ? it->second : material;
     }
 
-    // Perform culling and update visible instances
-    void updateVisibleInstances(const glm::vec3& cameraPos,
-                                const Frustum& frustum) {
-        visibleInstanceMats.clear();
-        float maxDistSq = maxRenderDistance * maxRenderDistance;
-
-        for (size_t i = 0; i < InstanceMats.size(); i++) {
-            const glm::vec3& pos = instancePositions[i];
-
-            // Distance culling (use bounding radius for more accurate check)
-            if (enableDistanceCulling) {
-                float distSq = glm::dot(pos - cameraPos, pos - cameraPos);
-                // Add bounding radius to effective max distance
-                float effectiveMaxDist =
-                    maxRenderDistance + cullingBoundingRadius;
-                if (distSq > effectiveMaxDist * effectiveMaxDist) {
-                    continue;
-                }
-            }
-
-            // Frustum culling using bounding sphere
-            if (enableFrustumCulling &&
-                !frustum.isSphereInside(pos, cullingBoundingRadius)) {
-                continue;
-            }
-
-            visibleInstanceMats.push_back(InstanceMats[i]);
-        }
-    }
+    // Culls the cells, fills "visibleCells" and splits them into the ranges of the levels of detail (and the impostors).
+    // If a pool is given, large cell sets are culled in parallel. If an occlusion culler is given, the cells hidden
+    // behind its occluders are dropped too. Returns false if no instance is visible.
+    bool updateVisibleInstances(const glm::vec3& cameraPos,
+                                const Frustum& frustum,
+                                ThreadPool* pool = nullptr,
+                                const OcclusionCuller* occlusion = nullptr);
+    // Binds the buffer texture of the instance transforms to its reserved texture unit (uploading them the first time)
+    void bindInstanceData();
 
     void deserialize(const nlohmann::json& data) override;
     std::pair<glm::vec3, glm::vec3> getBoundingBox() const;
+
+    // The component owns OpenGL objects so it should not be copyable
+    InstancedRendererComponent(const InstancedRendererComponent&) = delete;
+    InstancedRendererComponent& operator=(const InstancedRendererComponent&) = delete;
 };
 
-}  // namespace our
\ No newline at end of file
+}  // namespace our
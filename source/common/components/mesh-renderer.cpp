@@ -7,6 +7,8 @@ namespace our {
         if(!data.is_object()) return;
         mesh = AssetLoader<Mesh>::get(data["mesh"].get<std::string>());
         material = AssetLoader<Material>::get(data["material"].get<std::string>());
+        isStatic = data.value("static", false);
+        isOccluder = data.value("occluder", false);
         
         // Auto-load submesh materials based on mesh submeshes
         if (mesh && mesh->getSubmeshCount() > 0) {
@@ -13,6 +13,12 @@ namespace our {
         Mesh* mesh; // The mesh that should be drawn
         Material* material; // Default material (used if no submesh materials)
         std::unordered_map<std::string, Material*> submeshMaterials; // Materials per submesh
+        // If true, the entity never moves, so the renderer may merge its opaque geometry with the other static
+        // mesh renderers into shared batches (see "StaticBatcher"). Its mesh must keep a CPU copy to be batched.
+        bool isStatic = false;
+        // If true (and the renderer is static), a simplified copy of its opaque geometry hides the objects behind it
+        // in the renderer's software occlusion culling (see "OcclusionCuller"). Its mesh must keep a CPU copy.
+        bool isOccluder = false;
 
         // The ID of this component type is "Mesh Renderer"
         static std::string getID() { return "Mesh Renderer"; }
@@ -0,0 +1,55 @@
+#include "archetype.hpp"
+#include "component.hpp"
+
+namespace our {
+
+    Archetype::Archetype(ComponentMask mask) : mask(mask) {
+        columnIndices.fill(-1);
+        for(ComponentTypeId type = 0; type < MAX_COMPONENT_TYPES; type++){
+            if(mask & getComponentMask(type)){
+                columnIndices[type] = (int)types.size();
+                types.push_back(type);
+            }
+        }
+        columns.resize(types.size());
+    }
+
+    // Finds the first component of the given type in the list (or nullptr if there is none)
+    static Component* findFirst(const std::vector<Component*>& components, ComponentTypeId type){
+        for(auto component : components)
+            if(component->getTypeId() == type) return component;
+        return nullptr;
+    }
+
+    size_t Archetype::insert(Entity* entity, const std::vector<Component*>& components){
+        size_t row = entities.size();
+        entities.push_back(entity);
+        for(size_t index = 0; index < types.size(); index++)
+            columns[index].push_back(findFirst(components, types[index]));
+        return row;
+    }
+
+    void Archetype::refresh(size_t row, const std::vector<Component*>& components){
+        for(size_t index = 0; index < types.size(); index++)
+            columns[index][row] = findFirst(components, types[index]);
+    }
+
+    Entity* Archetype::remove(size_t row){
+        size_t last = entities.size() - 1;
+        Entity* moved = nullptr;
+        if(row != last){
+            moved = entities[last];
+            entities[row] = moved;
+            for(auto& column : columns) column[row] = column[last];
+        }
+        entities.pop_back();
+        for(auto& column : columns) column.pop_back();
+        return moved;
+    }
+
+    void Archetype::clear(){
+        entities.clear();
+        for(auto& column : columns) column.clear();
+    }
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "component-type.hpp"
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace our {
+
+    class Entity;    // A forward declaration of the Entity Class
+    class Component; // A forward declaration of the Component Class
+
+    // An archetype groups all the entities that hold exactly the same set of component types.
+    // The data is stored as a structure of arrays: there is one column per component type and row "i" of every column
+    // belongs to the entity "entities[i]". So, a system that needs a certain set of components can walk the columns of the
+    // matching archetypes linearly instead of probing every entity in the world for its components.
+    // If an entity holds more than one component of the same type (e.g. multiple audio controllers), the column stores
+    // the first one (in the order they were added) and the rest can still be reached through "Entity::getComponents".
+    class Archetype {
+        ComponentMask mask; // The set of component types held by the entities of this archetype
+        std::vector<ComponentTypeId> types; // The component types of this archetype in ascending order
+        std::array<int, MAX_COMPONENT_TYPES> columnIndices; // Maps a component type ID to its column (-1 if it has none)
+        std::vector<Entity*> entities; // The entity stored in each row
+        std::vector<std::vector<Component*>> columns; // columns[c][row] is the component of type "types[c]" in that row
+    public:
+        explicit Archetype(ComponentMask mask);
+
+        // Returns the set of component types held by this archetype
+        ComponentMask getMask() const { return mask; }
+        // Returns true if every component type in the given mask is held by this archetype
+        bool matches(ComponentMask required) const { return (mask & required) == required; }
+        // Returns the number of entities (rows) in this archetype
+        size_t size() const { return entities.size(); }
+
+        // Returns the entities of this archetype (one per row)
+        const std::vector<Entity*>& getEntities() const { return entities; }
+
+        // Returns the column of the given component type or nullptr if this archetype doesn't have that component type
+        Component* const* getColumn(ComponentTypeId type) const {
+            int index = columnIndices[type];
+            return index < 0 ? nullptr : columns[index].data();
+        }
+
+        // Returns the component of the given type in the given row or nullptr if this archetype doesn't have that type
+        Component* get(ComponentTypeId type, size_t row) const {
+            int index = columnIndices[type];
+            return index < 0 ? nullptr : columns[index][row];
+        }
+
+        // Appends a row for the given entity and fills it from the entity's components. Returns the index of the new row.
+        size_t insert(Entity* entity, const std::vector<Component*>& components);
+        // Refills an existing row from the entity's components (used when a component is replaced by another of the same type)
+        void refresh(size_t row, const std::vector<Component*>& components);
+        // Removes the given row by moving the last row into its place.
+        // Returns the entity that was moved into the row (so its row index can be updated) or nullptr if no entity was moved.
+        Entity* remove(size_t row);
+        // Removes all the rows
+        void clear();
+    };
+
+}
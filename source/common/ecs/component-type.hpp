@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+namespace our {
+
+    // Each component type is identified by a small integer ID instead of RTTI.
+    // The ID is handed out the first time "getComponentTypeId<T>()" is called for a type T and stays the same for the
+    // rest of the run, so looking it up afterwards is just a load of a static variable.
+    using ComponentTypeId = std::uint32_t;
+
+    // A component mask has one bit per component type. It tells which component types an entity (or an archetype) holds.
+    using ComponentMask = std::uint64_t;
+
+    // Since the mask is a 64-bit integer, we can have at most 64 different component types
+    constexpr ComponentTypeId MAX_COMPONENT_TYPES = 64;
+
+    namespace detail {
+        // The counter used to generate the IDs (atomic since systems may touch new types from worker threads)
+        inline std::atomic<ComponentTypeId> nextComponentTypeId{0};
+    }
+
+    // Returns the unique ID of the component type T
+    template<typename T>
+    ComponentTypeId getComponentTypeId() {
+        static const ComponentTypeId id = detail::nextComponentTypeId++;
+        assert(id < MAX_COMPONENT_TYPES && "Too many component types, increase the size of ComponentMask");
+        return id;
+    }
+
+    // Returns a mask with only the bit of the given component type set
+    inline ComponentMask getComponentMask(ComponentTypeId id) {
+        return ComponentMask(1) << id;
+    }
+
+    // Returns a mask with the bits of all the given component types set
+    template<typename... T>
+    ComponentMask getComponentMask() {
+        return (ComponentMask(0) | ... | getComponentMask(getComponentTypeId<T>()));
+    }
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "component-type.hpp"
 #include <json/json.hpp>
 #include <string>
 
@@ -13,6 +14,7 @@ namespace our {
     // Thus any renderer system should look for an entity holding a camera component in order to compute the camera related uniforms (e.g. VP matrix)
     class Component {
         Entity* owner; // A pointer to the entity that owns this component
+        ComponentTypeId typeId = 0; // The type ID of the concrete component class (set by the entity when the component is added)
         friend Entity; // The entity is a friend since it is the only one allowed to set itself as an owner of a certain component.
     public:
         // This static method returns a unique string that identifies each type of components
@@ -24,6 +26,8 @@ namespace our {
         virtual void deserialize(const nlohmann::json& data) = 0;
         // Returns the owner of this component
         Entity* getOwner() const { return owner; }
+        // Returns the type ID of the concrete class of this component
+        ComponentTypeId getTypeId() const { return typeId; }
         // Define a virtual destructor
         virtual ~Component(){}
     };
@@ -0,0 +1,208 @@
+#include "cooked-scene.hpp"
+#include "transform.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+namespace our {
+
+    namespace cooked_scene {
+
+        // Collects the sections of the file while walking the scene
+        struct Cooker {
+            std::vector<char> strings;
+            std::unordered_map<std::string, std::uint32_t> stringOffsets; // Used to store each string only once
+            std::vector<std::uint32_t> kinds;
+            std::unordered_map<std::string, std::uint32_t> kindIndices;
+            std::vector<Entity> entities;
+            std::vector<Component> components;
+            std::vector<std::uint8_t> payloads;
+
+            std::uint32_t addString(const std::string& string){
+                auto it = stringOffsets.find(string);
+                if(it != stringOffsets.end()) return it->second;
+                std::uint32_t offset = (std::uint32_t)strings.size();
+                strings.insert(strings.end(), string.begin(), string.end());
+                strings.push_back('\0');
+                stringOffsets.emplace(string, offset);
+                return offset;
+            }
+
+            std::uint32_t addKind(const std::string& type){
+                auto it = kindIndices.find(type);
+                if(it != kindIndices.end()) return it->second;
+                std::uint32_t index = (std::uint32_t)kinds.size();
+                kinds.push_back(addString(type));
+                kindIndices.emplace(type, index);
+                return index;
+            }
+
+            // Appends the MessagePack encoding of the data to the payload section and returns its offset (relative to the section)
+            std::uint32_t addPayload(const nlohmann::json& data, std::uint32_t& size){
+                std::uint32_t offset = (std::uint32_t)payloads.size();
+                nlohmann::json::to_msgpack(data, payloads);
+                size = (std::uint32_t)payloads.size() - offset;
+                return offset;
+            }
+
+            // Adds the entities in the same order as "World::deserialize" would create them (parents before children)
+            void addEntities(const nlohmann::json& data, std::uint32_t parent){
+                if(!data.is_array()) return;
+                for(const auto& entityData : data){
+                    if(!entityData.is_object()) continue;
+                    Entity entity = {};
+                    entity.name = addString(entityData.value("name", std::string()));
+                    entity.parent = parent;
+                    // The transform is converted here exactly like "Entity::deserialize" does it
+                    Transform transform;
+                    transform.deserialize(entityData);
+                    for(int axis = 0; axis < 3; axis++){
+                        entity.position[axis] = transform.position[axis];
+                        entity.rotation[axis] = transform.rotation[axis];
+                        entity.scale[axis] = transform.scale[axis];
+                    }
+                    entity.firstComponent = (std::uint32_t)components.size();
+                    if(entityData.contains("components") && entityData["components"].is_array()){
+                        for(const auto& componentData : entityData["components"]){
+                            Component component = {};
+                            component.kind = addKind(componentData.value("type", std::string()));
+                            component.payloadOffset = addPayload(componentData, component.payloadSize);
+                            components.push_back(component);
+                        }
+                    }
+                    entity.componentCount = (std::uint32_t)components.size() - entity.firstComponent;
+                    std::uint32_t index = (std::uint32_t)entities.size();
+                    entities.push_back(entity);
+                    if(entityData.contains("children")) addEntities(entityData["children"], index);
+                }
+            }
+        };
+
+        bool cook(const nlohmann::json& scene, const std::string& sourcePath, const std::string& outputPath){
+            Cooker cooker;
+            Header header = {};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = VERSION;
+            header.sourcePath = cooker.addString(sourcePath);
+            if(scene.contains("world")) cooker.addEntities(scene["world"], NO_PARENT);
+            if(scene.contains("assets") && scene["assets"].is_object())
+                header.assetsOffset = cooker.addPayload(scene["assets"], header.assetsSize);
+
+            // The tables come first (right after the header) to keep them 4 bytes aligned, then the strings and the payloads
+            std::uint32_t offset = sizeof(Header);
+            header.entitiesOffset = offset;
+            header.entityCount = (std::uint32_t)cooker.entities.size();
+            offset += header.entityCount * sizeof(Entity);
+            header.componentsOffset = offset;
+            header.componentCount = (std::uint32_t)cooker.components.size();
+            offset += header.componentCount * sizeof(Component);
+            header.kindsOffset = offset;
+            header.kindCount = (std::uint32_t)cooker.kinds.size();
+            offset += header.kindCount * sizeof(std::uint32_t);
+            header.stringsOffset = offset;
+            header.stringsSize = (std::uint32_t)cooker.strings.size();
+            offset += header.stringsSize;
+            // The payload offsets were relative to the payload section, now that we know where it starts we fix them
+            for(auto& component : cooker.components) component.payloadOffset += offset;
+            if(header.assetsSize > 0) header.assetsOffset += offset;
+
+            std::ofstream file(outputPath, std::ios::binary);
+            if(!file){
+                std::cerr << "Couldn't open file: " << outputPath << std::endl;
+                return false;
+            }
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(cooker.entities.data()), cooker.entities.size() * sizeof(Entity));
+            file.write(reinterpret_cast<const char*>(cooker.components.data()), cooker.components.size() * sizeof(Component));
+            file.write(reinterpret_cast<const char*>(cooker.kinds.data()), cooker.kinds.size() * sizeof(std::uint32_t));
+            file.write(cooker.strings.data(), cooker.strings.size());
+            file.write(reinterpret_cast<const char*>(cooker.payloads.data()), cooker.payloads.size());
+            return (bool)file;
+        }
+
+    }
+
+    bool CookedScene::open(const std::string& path){
+        using namespace cooked_scene;
+        close();
+        if(!file.open(path)) return false;
+        auto fail = [this, &path](const char* reason){
+            std::cerr << "Ignoring cooked scene " << path << ": " << reason << std::endl;
+            file.close();
+            return false;
+        };
+        if(file.size() < sizeof(Header)) return fail("the file is truncated");
+        const Header* candidate = reinterpret_cast<const Header*>(file.data());
+        if(std::memcmp(candidate->magic, MAGIC, sizeof(MAGIC)) != 0) return fail("not a cooked scene");
+        if(candidate->version != VERSION) return fail("cooked by a different version, cook it again");
+        if(!contains(candidate->entitiesOffset, (std::uint64_t)candidate->entityCount * sizeof(Entity)) ||
+           !contains(candidate->componentsOffset, (std::uint64_t)candidate->componentCount * sizeof(Component)) ||
+           !contains(candidate->kindsOffset, (std::uint64_t)candidate->kindCount * sizeof(std::uint32_t)) ||
+           !contains(candidate->stringsOffset, candidate->stringsSize) ||
+           !contains(candidate->assetsOffset, candidate->assetsSize) ||
+           candidate->stringsSize == 0 || file.data()[candidate->stringsOffset + candidate->stringsSize - 1] != '\0')
+            return fail("the file is corrupted");
+        header = candidate;
+
+        // Validate every reference once here so that the accessors don't have to
+        bool valid = header->sourcePath < header->stringsSize;
+        for(std::uint32_t index = 0; valid && index < header->kindCount; index++)
+            valid = reinterpret_cast<const std::uint32_t*>(file.data() + header->kindsOffset)[index] < header->stringsSize;
+        for(std::uint32_t index = 0; valid && index < header->entityCount; index++){
+            const Entity& entity = getEntity(index);
+            valid = entity.name < header->stringsSize &&
+                    (entity.parent == NO_PARENT || entity.parent < index) &&
+                    (std::uint64_t)entity.firstComponent + entity.componentCount <= header->componentCount;
+        }
+        for(std::uint32_t index = 0; valid && index < header->componentCount; index++){
+            const Component& component = getComponent(index);
+            valid = component.kind < header->kindCount && contains(component.payloadOffset, component.payloadSize);
+        }
+        if(!valid){
+            header = nullptr;
+            return fail("the file is corrupted");
+        }
+
+        // If the config was edited after cooking, the cooked scene no longer matches it
+        std::error_code error;
+        std::string sourcePath = getString(header->sourcePath);
+        if(!sourcePath.empty() && std::filesystem::exists(sourcePath, error) &&
+           std::filesystem::last_write_time(sourcePath, error) > std::filesystem::last_write_time(path, error)){
+            header = nullptr;
+            return fail("the config was modified after cooking, cook it again");
+        }
+        return true;
+    }
+
+    const cooked_scene::Entity& CookedScene::getEntity(std::uint32_t index) const {
+        return reinterpret_cast<const cooked_scene::Entity*>(file.data() + header->entitiesOffset)[index];
+    }
+
+    const cooked_scene::Component& CookedScene::getComponent(std::uint32_t index) const {
+        return reinterpret_cast<const cooked_scene::Component*>(file.data() + header->componentsOffset)[index];
+    }
+
+    const char* CookedScene::getKind(std::uint32_t kind) const {
+        return getString(reinterpret_cast<const std::uint32_t*>(file.data() + header->kindsOffset)[kind]);
+    }
+
+    const char* CookedScene::getString(std::uint32_t offset) const {
+        return reinterpret_cast<const char*>(file.data() + header->stringsOffset + offset);
+    }
+
+    nlohmann::json CookedScene::getComponentData(const cooked_scene::Component& component) const {
+        const unsigned char* begin = file.data() + component.payloadOffset;
+        return nlohmann::json::from_msgpack(begin, begin + component.payloadSize);
+    }
+
+    nlohmann::json CookedScene::getAssets() const {
+        if(header->assetsSize == 0) return nullptr;
+        const unsigned char* begin = file.data() + header->assetsOffset;
+        return nlohmann::json::from_msgpack(begin, begin + header->assetsSize);
+    }
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../mapped-file.hpp"
+
+#include <cstdint>
+#include <string>
+#include <json/json.hpp>
+
+namespace our {
+
+    // A cooked scene is the "scene.world" and "scene.assets" sections of the app config compiled offline
+    // (by the scene cooker tool) into a flat binary file, so that loading a scene doesn't need to walk a json tree.
+    // The file is laid out as follows (all the offsets are in bytes from the start of the file):
+    // - A header which points to the other sections.
+    // - A string table which holds all the strings as null terminated strings. Strings are referenced by their offset.
+    // - A component kind table which holds the string of every component type used in the file. The components
+    //   reference their kind by index, so the type of each component is resolved once per kind instead of once per component.
+    // - An entity table where each entity has its name, its already converted local transform, the index of its parent
+    //   (parents always come before their children) and the range of its components in the component table.
+    // - A component table where each component has its kind and the range of its data in the payload section.
+    // - A payload section which holds the data of every component (and the assets section) encoded as MessagePack.
+    namespace cooked_scene {
+        constexpr char MAGIC[4] = {'S', 'L', 'S', 'C'};
+        // This should be incremented whenever the layout changes, old files are then ignored until they are cooked again
+        constexpr std::uint32_t VERSION = 1;
+        constexpr std::uint32_t NO_PARENT = UINT32_MAX;
+
+        struct Header {
+            char magic[4];
+            std::uint32_t version;
+            std::uint32_t sourcePath; // The string of the config that was cooked (used to detect stale files)
+            std::uint32_t stringsOffset, stringsSize;
+            std::uint32_t kindsOffset, kindCount;
+            std::uint32_t entitiesOffset, entityCount;
+            std::uint32_t componentsOffset, componentCount;
+            std::uint32_t assetsOffset, assetsSize; // The MessagePack encoded "scene.assets" object (size 0 if none)
+        };
+
+        struct Entity {
+            std::uint32_t name;
+            std::uint32_t parent; // The index of the parent entity or NO_PARENT
+            float position[3], rotation[3], scale[3]; // The rotation is already in radians
+            std::uint32_t firstComponent, componentCount;
+        };
+
+        struct Component {
+            std::uint32_t kind;
+            std::uint32_t payloadOffset, payloadSize;
+        };
+
+        // Compiles the "world" and "assets" of the given scene config into a cooked scene file.
+        // "sourcePath" is the path of the config file that contains the scene.
+        // Returns false if the file couldn't be written.
+        bool cook(const nlohmann::json& scene, const std::string& sourcePath, const std::string& outputPath);
+    }
+
+    // A cooked scene file mapped into memory. All the accessors read directly from the mapped file.
+    class CookedScene {
+        MappedFile file;
+        const cooked_scene::Header* header = nullptr;
+
+        // Returns true if the given range lies inside the file
+        bool contains(std::uint32_t offset, std::uint64_t size) const { return (std::uint64_t)offset + size <= file.size(); }
+    public:
+        // Maps and validates the cooked scene at the given path.
+        // Returns false if the file doesn't exist, is corrupted, was cooked by a different version
+        // or is older than the config it was cooked from (in that case, the scene should be read from the json config).
+        bool open(const std::string& path);
+        void close() { file.close(); header = nullptr; }
+        bool isOpen() const { return header != nullptr; }
+
+        std::uint32_t getEntityCount() const { return header->entityCount; }
+        const cooked_scene::Entity& getEntity(std::uint32_t index) const;
+        const cooked_scene::Component& getComponent(std::uint32_t index) const;
+        std::uint32_t getKindCount() const { return header->kindCount; }
+        // Returns the type string of the given component kind (e.g. "Mesh Renderer")
+        const char* getKind(std::uint32_t kind) const;
+        const char* getString(std::uint32_t offset) const;
+        // Decodes the data of the given component into a json object
+        nlohmann::json getComponentData(const cooked_scene::Component& component) const;
+        // Decodes the assets section into a json object (null if there were no assets)
+        nlohmann::json getAssets() const;
+    };
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace our {
+
+    // An entity handle is a safe reference to an entity. It stores the index of the entity's slot in the world and
+    // the generation of that slot. Whenever an entity is deleted, the generation of its slot is incremented, so a
+    // handle to a deleted entity no longer matches and "World::get" returns a nullptr instead of a dangling pointer.
+    struct EntityHandle {
+        std::uint32_t index = UINT32_MAX; // The slot of the entity in the world (UINT32_MAX means a null handle)
+        std::uint32_t generation = 0; // The generation of the slot when the handle was created
+
+        // Returns true if this handle doesn't refer to any entity
+        bool isNull() const { return index == UINT32_MAX; }
+
+        bool operator==(const EntityHandle& other) const { return index == other.index && generation == other.generation; }
+        bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+    };
+
+}
+
+namespace std {
+    // This allows entity handles to be used as keys in unordered containers
+    template<>
+    struct hash<our::EntityHandle> {
+        size_t operator()(const our::EntityHandle& handle) const {
+            return hash<std::uint64_t>()((std::uint64_t(handle.generation) << 32) | handle.index);
+        }
+    };
+}
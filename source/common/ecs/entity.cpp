@@ -1,4 +1,5 @@
 #include "entity.hpp"
+#include "world.hpp"
 #include "../deserialize-utils.hpp"
 #include "../components/component-deserializer.hpp"
 
@@ -10,17 +11,26 @@ namespace our {
     // Remember that you can get the transformation matrix from this entity to its parent from "localTransform"
     // To get the local to world matrix, you need to combine this entities matrix with its parent's matrix and
     // its parent's parent's matrix and so on till you reach the root.
+    // If neither this entity nor any of its ancestors changed since the last "World::updateTransforms", the matrix cached
+    // in the world's transform store is still valid so we just return it.
     glm::mat4 Entity::getLocalToWorldMatrix() const {
+        if (world && !world->transforms.isDirty(this)) return world->transforms.get(this);
         glm::mat4 localToWorld = localTransform.toMat4();
         if (parent) localToWorld = parent->getLocalToWorldMatrix() * localToWorld;
         return localToWorld;
     }
 
+    // This function marks the local transform as changed so that the world rebuilds its matrix (and its children's)
+    void Entity::markTransformDirty(){
+        if (world) world->transforms.markDirty(this);
+    }
+
     // Deserializes the entity data and components from a json object
     void Entity::deserialize(const nlohmann::json& data){
         if(!data.is_object()) return;
         name = data.value("name", name);
         localTransform.deserialize(data);
+        markTransformDirty();
         if(data.contains("components")){
             if(const auto& components = data["components"]; components.is_array()){
                 for(auto& component: components){
@@ -30,4 +40,29 @@ namespace our {
         }
     }
 
-}
\ No newline at end of file
+    // The components are allocated by the world, so the world is responsible for destroying them
+    Entity::~Entity(){
+        for (auto component : components){
+            world->destroyComponent(component);
+        }
+        components.clear();
+    }
+
+    void* Entity::allocateComponent(ComponentTypeId type, size_t size, size_t alignment){
+        return world->allocateComponent(type, size, alignment);
+    }
+
+    // Adds the component to the components list then moves the entity to the archetype of its new component set
+    void Entity::attachComponent(Component* component){
+        components.push_back(component);
+        world->relocate(this);
+    }
+
+    // Deletes the component at the given index then moves the entity to the archetype of its new component set
+    void Entity::detachComponent(size_t index){
+        world->destroyComponent(components[index]);
+        components.erase(components.begin() + index);
+        world->relocate(this);
+    }
+
+}
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "component.hpp"
+#include "archetype.hpp"
 #include "transform.hpp"
-#include <list>
-#include <iterator>
+#include <cstdint>
+#include <new>
+#include <vector>
 #include <string>
 #include <glm/glm.hpp>
 
@@ -13,39 +15,67 @@ namespace our {
 
     class Entity{
         World *world; // This defines what world own this entity
-        std::list<Component*> components; // A list of components that are owned by this entity
+        std::vector<Component*> components; // A list of components that are owned by this entity (in the order they were added)
+        Archetype* archetype = nullptr; // The archetype that currently stores this entity's components
+        size_t archetypeRow = 0; // The row of this entity inside its archetype
+        size_t transformIndex = 0; // The slot of this entity inside the world's transform store
+        size_t denseIndex = 0; // The index of this entity inside the world's entities list
+        std::uint32_t slotIndex = 0; // The slot of this entity inside the world's handle table
+        bool pendingRemoval = false; // Whether this entity was marked for removal
 
         friend World; // The world is a friend since it is the only class that is allowed to instantiate an entity
+        friend class TransformStore; // The transform store keeps track of the slot of each entity
         Entity() = default; // The entity constructor is private since only the world is allowed to instantiate an entity
+        ~Entity(); // The entity destructor is private too since the memory of the entity is owned by the world.
+                   // It deletes the components since the entity owns them.
+
+        // This function returns memory for a new component from the world's allocator of the given component type
+        void* allocateComponent(ComponentTypeId type, size_t size, size_t alignment);
+        // These functions add/remove the component to/from the components list and ask the world to move
+        // this entity to the archetype matching its new set of component types
+        void attachComponent(Component* component);
+        void detachComponent(size_t index);
     public:
         std::string name; // The name of the entity. It could be useful to refer to an entity by its name
         Entity* parent;   // The parent of the entity. The transform of the entity is relative to its parent.
                           // If parent is null, the entity is a root entity (has no parent).
         Transform localTransform; // The transform of this entity relative to its parent.
+                                  // If you change it, call "markTransformDirty" so that the cached matrices get rebuilt.
 
         World* getWorld() const { return world; } // Returns the world to which this entity belongs
 
         glm::mat4 getLocalToWorldMatrix() const; // Computes and returns the transformation from the entities local space to the world space
+        void markTransformDirty(); // Tells the world that the local transform changed so the cached matrices of this entity and its children are stale
         void deserialize(const nlohmann::json&); // Deserializes the entity data and components from a json object
+
+        // Returns the set of component types held by this entity (empty if the entity was marked for removal)
+        ComponentMask getComponentMask() const { return archetype ? archetype->getMask() : 0; }
         
+        // Returns true if the entity was marked for removal (it will be deleted when "World::deleteMarkedEntities" is called)
+        bool isMarkedForRemoval() const { return pendingRemoval; }
+
         // This template method create a component of type T,
-        // adds it to the components map and returns a pointer to it 
+        // adds it to the components list and returns a pointer to it 
         template<typename T>
         T* addComponent(){
             static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
-            T* comp = new T();
+            T* comp = new (allocateComponent(getComponentTypeId<T>(), sizeof(T), alignof(T))) T();
             comp->owner = this;
-            components.push_back(comp);
+            comp->typeId = getComponentTypeId<T>();
+            attachComponent(comp);
             return comp;
         }
 
         // This template method searhes for a component of type T and returns a pointer to it
         // If no component of type T was found, it returns a nullptr 
+        // NOTE: Components are looked up by their exact type (through the archetype columns), not by their base classes
         template<typename T>
         T* getComponent(){
-            for(auto it = components.begin(); it != components.end(); it++){
-                T* component = dynamic_cast<T*>(*it);
-                if(component) return component;
+            ComponentTypeId type = getComponentTypeId<T>();
+            if(archetype) return static_cast<T*>(archetype->get(type, archetypeRow));
+            // If the entity was marked for removal, it is no longer in an archetype so we search its components instead
+            for(auto component : components){
+                if(component->typeId == type) return static_cast<T*>(component);
             }
             return nullptr;
         }
@@ -54,67 +84,51 @@ namespace our {
         template<typename T>
         std::vector<T*> getComponents(){
             std::vector<T*> result;
-            for(auto it = components.begin(); it != components.end(); it++){
-                T* component = dynamic_cast<T*>(*it);
-                if(component) result.push_back(component);
+            ComponentTypeId type = getComponentTypeId<T>();
+            for(auto component : components){
+                if(component->typeId == type) result.push_back(static_cast<T*>(component));
             }
             return result;
         }
 
-        // This template method dynamic_casts and returns a pointer to it
-        // If no component of type T was found, it returns a nullptr 
+        // This template method returns the component at the given index if it is of type T
+        // If the index is out of range or the component is not of type T, it returns a nullptr 
         template<typename T>
         T* getComponent(size_t index){
-            auto it = components.begin();
-            std::advance(it, index);
-            if(it != components.end())
-                return dynamic_cast<T*>(*it);
-            return nullptr;
+            if(index >= components.size()) return nullptr;
+            Component* component = components[index];
+            if constexpr (std::is_same<T, Component>::value) return component;
+            else return component->typeId == getComponentTypeId<T>() ? static_cast<T*>(component) : nullptr;
         }
 
         // This template method searhes for a component of type T and deletes it
         template<typename T>
         void deleteComponent(){
-            for(auto it = components.begin(); it != components.end(); it++){
-                T* component = dynamic_cast<T*>(*it);
-                if(component){
-                    delete component;
-                    components.erase(it);
+            ComponentTypeId type = getComponentTypeId<T>();
+            for(size_t index = 0; index < components.size(); index++){
+                if(components[index]->typeId == type){
+                    detachComponent(index);
                     break;
                 }
             }
         }
 
-        // This template method searhes for a component of type T and deletes it
+        // This method deletes the component at the given index
         void deleteComponent(size_t index){
-            auto it = components.begin();
-            std::advance(it, index);
-            if(it != components.end()) {
-                delete *it;
-                components.erase(it);
-            }
+            if(index < components.size()) detachComponent(index);
         }
 
         // This template method searhes for the given component and deletes it
         template<typename T>
         void deleteComponent(T const* component){
-            for (auto it = components.begin(); it != components.end(); ++it) {
-                if(*it == component) {
-                    delete *it;
-                    components.erase(it);
+            for(size_t index = 0; index < components.size(); index++){
+                if(components[index] == component) {
+                    detachComponent(index);
                     return;
                 }
             }
         }
 
-        // Since the entity owns its components, they should be deleted alongside the entity
-        ~Entity(){
-            for (auto component : components){
-                delete component;
-            }
-            components.clear();
-        }
-
         // Entities should not be copyable
         Entity(const Entity&) = delete;
         Entity &operator=(Entity const &) = delete;
@@ -0,0 +1,42 @@
+#include "slab-allocator.hpp"
+
+#include <algorithm>
+#include <new>
+
+namespace our {
+
+    SlabAllocator::SlabAllocator(size_t elementSize, size_t alignment, size_t elementsPerSlab)
+        : alignment(std::max(alignment, alignof(void*))), elementsPerSlab(elementsPerSlab) {
+        // Each free block must be able to hold the pointer to the next free block
+        size_t size = std::max(elementSize, sizeof(void*));
+        this->elementSize = (size + this->alignment - 1) / this->alignment * this->alignment;
+    }
+
+    SlabAllocator::~SlabAllocator(){
+        for(auto slab : slabs){
+            ::operator delete(slab, std::align_val_t(alignment));
+        }
+    }
+
+    void* SlabAllocator::allocate(){
+        if(!freeList){
+            char* slab = static_cast<char*>(::operator new(elementSize * elementsPerSlab, std::align_val_t(alignment)));
+            slabs.push_back(slab);
+            // Link the blocks in reverse so that they are handed out in ascending address order
+            for(size_t index = elementsPerSlab; index-- > 0;){
+                void* block = slab + index * elementSize;
+                *static_cast<void**>(block) = freeList;
+                freeList = block;
+            }
+        }
+        void* block = freeList;
+        freeList = *static_cast<void**>(block);
+        return block;
+    }
+
+    void SlabAllocator::deallocate(void* block){
+        *static_cast<void**>(block) = freeList;
+        freeList = block;
+    }
+
+}
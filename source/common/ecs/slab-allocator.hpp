@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace our {
+
+    // A slab allocator hands out fixed size blocks of memory carved from large slabs.
+    // Freed blocks are kept in a free list and reused by the next allocation, so creating and destroying objects
+    // (e.g. entities and components) doesn't go through the general purpose allocator every time and objects that are
+    // allocated together end up next to each other in memory.
+    // NOTE: It only manages memory, constructing and destroying the objects is up to the caller (using placement new).
+    class SlabAllocator {
+        size_t elementSize; // The size of each block (rounded up to a multiple of the alignment)
+        size_t alignment; // The alignment of each block
+        size_t elementsPerSlab; // The number of blocks in each slab
+        std::vector<void*> slabs; // The slabs allocated so far
+        void* freeList = nullptr; // The first free block (each free block stores a pointer to the next one)
+    public:
+        SlabAllocator(size_t elementSize, size_t alignment, size_t elementsPerSlab = 64);
+        ~SlabAllocator();
+
+        // Returns a free block (a new slab is allocated if there is none)
+        void* allocate();
+        // Returns the block to the free list
+        void deallocate(void* block);
+
+        // Returns the size and the alignment of the blocks
+        size_t getElementSize() const { return elementSize; }
+        size_t getAlignment() const { return alignment; }
+
+        // The allocator owns its slabs so it should not be copyable
+        SlabAllocator(const SlabAllocator&) = delete;
+        SlabAllocator &operator=(SlabAllocator const &) = delete;
+    };
+
+}
@@ -0,0 +1,248 @@
+#include "transform-store.hpp"
+#include "entity.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_STORE_SSE 1
+#endif
+
+namespace our {
+
+    // Computes "out = a * b". When SSE is available, each column of the result is computed as a linear combination
+    // of the columns of "a" in a single register.
+    static void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out){
+#ifdef TRANSFORM_STORE_SSE
+        __m128 a0 = _mm_loadu_ps(&a[0][0]);
+        __m128 a1 = _mm_loadu_ps(&a[1][0]);
+        __m128 a2 = _mm_loadu_ps(&a[2][0]);
+        __m128 a3 = _mm_loadu_ps(&a[3][0]);
+        for(int column = 0; column < 4; column++){
+            __m128 result = _mm_mul_ps(a0, _mm_set1_ps(b[column][0]));
+            result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(b[column][1])));
+            result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(b[column][2])));
+            result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(b[column][3])));
+            _mm_storeu_ps(&out[column][0], result);
+        }
+#else
+        out = a * b;
+#endif
+    }
+
+    void TransformStore::add(Entity* entity){
+        entity->transformIndex = entities.size();
+        entities.push_back(entity);
+        parents.push_back(-1);
+        worldMatrices.emplace_back(1.0f);
+        dirty.push_back(1);
+        previousTransforms.push_back(entity->localTransform);
+        changed.push_back(0);
+    }
+
+    void TransformStore::remove(Entity* entity){
+        // We erase the entity instead of swapping it with the last one to keep the hierarchy order
+        size_t index = entity->transformIndex;
+        if(changed[index]) changedEntities.erase(std::find(changedEntities.begin(), changedEntities.end(), entity));
+        entities.erase(entities.begin() + index);
+        parents.erase(parents.begin() + index);
+        worldMatrices.erase(worldMatrices.begin() + index);
+        dirty.erase(dirty.begin() + index);
+        previousTransforms.erase(previousTransforms.begin() + index);
+        changed.erase(changed.begin() + index);
+        for(size_t i = index; i < entities.size(); i++) entities[i]->transformIndex = i;
+    }
+
+    void TransformStore::clear(){
+        entities.clear();
+        parents.clear();
+        worldMatrices.clear();
+        dirty.clear();
+        previousTransforms.clear();
+        stashedTransforms.clear();
+        changedEntities.clear();
+        changed.clear();
+    }
+
+    void TransformStore::markDirty(const Entity* entity){
+        dirty[entity->transformIndex] = 1;
+    }
+
+    bool TransformStore::isDirty(const Entity* entity) const {
+        // A change in any ancestor affects the entity, so we walk up the hierarchy (which is shallow in practice)
+        for(; entity; entity = entity->parent){
+            if(dirty[entity->transformIndex]) return true;
+        }
+        return false;
+    }
+
+    const glm::mat4& TransformStore::get(const Entity* entity) const {
+        return worldMatrices[entity->transformIndex];
+    }
+
+    void TransformStore::sortByHierarchy(){
+        // Sorting by depth guarantees that every parent comes before its children
+        std::vector<std::pair<int, Entity*>> order;
+        order.reserve(entities.size());
+        for(auto entity : entities){
+            int depth = 0;
+            for(Entity* ancestor = entity->parent; ancestor; ancestor = ancestor->parent) depth++;
+            order.emplace_back(depth, entity);
+        }
+        std::stable_sort(order.begin(), order.end(), [](const auto& first, const auto& second){
+            return first.first < second.first;
+        });
+        for(size_t i = 0; i < order.size(); i++){
+            entities[i] = order[i].second;
+            entities[i]->transformIndex = i;
+            previousTransforms[i] = entities[i]->localTransform;
+        }
+        // The changed flags follow the entities (every entity will be reported anyway since they are all dirty now)
+        std::fill(changed.begin(), changed.end(), 0);
+        for(Entity* entity : changedEntities) changed[entity->transformIndex] = 1;
+        // The matrices no longer match their slots, so everything has to be rebuilt
+        std::fill(dirty.begin(), dirty.end(), 1);
+    }
+
+    void TransformStore::update(){
+        // The parent of an entity may be assigned after it was added, so we resolve the parent indices here
+        // and restore the hierarchy order if a parent ended up after its child
+        bool ordered = true;
+        for(size_t i = 0; i < entities.size(); i++){
+            Entity* parent = entities[i]->parent;
+            parents[i] = parent ? (int)parent->transformIndex : -1;
+            if(parents[i] >= (int)i) ordered = false;
+        }
+        if(!ordered){
+            sortByHierarchy();
+            for(size_t i = 0; i < entities.size(); i++){
+                Entity* parent = entities[i]->parent;
+                parents[i] = parent ? (int)parent->transformIndex : -1;
+            }
+        }
+
+        // Propagate the dirty flags down to the children and collect the dirty entities (in hierarchy order)
+        dirtyIndices.clear();
+        for(size_t i = 0; i < entities.size(); i++){
+            if(parents[i] >= 0 && dirty[parents[i]]) dirty[i] = 1;
+            if(dirty[i]) dirtyIndices.push_back((std::uint32_t)i);
+        }
+        size_t count = dirtyIndices.size();
+        if(count == 0) return;
+
+        // Gather the local transforms of the dirty entities into structure of arrays form
+        for(auto array : {&positionX, &positionY, &positionZ, &sinYaw, &cosYaw, &sinPitch, &cosPitch,
+                          &sinRoll, &cosRoll, &scaleX, &scaleY, &scaleZ}) array->resize(count);
+        localMatrices.resize(count);
+        for(size_t k = 0; k < count; k++){
+            const Transform& transform = entities[dirtyIndices[k]]->localTransform;
+            positionX[k] = transform.position.x; positionY[k] = transform.position.y; positionZ[k] = transform.position.z;
+            // Same convention as Transform::toMat4: yawPitchRoll(rotation.y, rotation.x, rotation.z)
+            sinYaw[k] = std::sin(transform.rotation.y); cosYaw[k] = std::cos(transform.rotation.y);
+            sinPitch[k] = std::sin(transform.rotation.x); cosPitch[k] = std::cos(transform.rotation.x);
+            sinRoll[k] = std::sin(transform.rotation.z); cosRoll[k] = std::cos(transform.rotation.z);
+            scaleX[k] = transform.scale.x; scaleY[k] = transform.scale.y; scaleZ[k] = transform.scale.z;
+        }
+
+        // Build the local matrices (Translation * Rotation * Scale). This is the expanded form of glm::yawPitchRoll
+        // with each rotation column multiplied by its scale.
+        size_t k = 0;
+#ifdef TRANSFORM_STORE_SSE
+        for(; k + 4 <= count; k += 4){
+            __m128 ch = _mm_loadu_ps(&cosYaw[k]), sh = _mm_loadu_ps(&sinYaw[k]);
+            __m128 cp = _mm_loadu_ps(&cosPitch[k]), sp = _mm_loadu_ps(&sinPitch[k]);
+            __m128 cb = _mm_loadu_ps(&cosRoll[k]), sb = _mm_loadu_ps(&sinRoll[k]);
+            __m128 sx = _mm_loadu_ps(&scaleX[k]), sy = _mm_loadu_ps(&scaleY[k]), sz = _mm_loadu_ps(&scaleZ[k]);
+            __m128 spsb = _mm_mul_ps(sp, sb), spcb = _mm_mul_ps(sp, cb);
+            // Each of these holds the same matrix element for the 4 entities
+            alignas(16) float elements[9][4];
+            _mm_store_ps(elements[0], _mm_mul_ps(sx, _mm_add_ps(_mm_mul_ps(ch, cb), _mm_mul_ps(sh, spsb))));
+            _mm_store_ps(elements[1], _mm_mul_ps(sx, _mm_mul_ps(sb, cp)));
+            _mm_store_ps(elements[2], _mm_mul_ps(sx, _mm_sub_ps(_mm_mul_ps(ch, spsb), _mm_mul_ps(sh, cb))));
+            _mm_store_ps(elements[3], _mm_mul_ps(sy, _mm_sub_ps(_mm_mul_ps(sh, spcb), _mm_mul_ps(ch, sb))));
+            _mm_store_ps(elements[4], _mm_mul_ps(sy, _mm_mul_ps(cb, cp)));
+            _mm_store_ps(elements[5], _mm_mul_ps(sy, _mm_add_ps(_mm_mul_ps(sb, sh), _mm_mul_ps(ch, spcb))));
+            _mm_store_ps(elements[6], _mm_mul_ps(sz, _mm_mul_ps(sh, cp)));
+            _mm_store_ps(elements[7], _mm_mul_ps(sz, _mm_sub_ps(_mm_setzero_ps(), sp)));
+            _mm_store_ps(elements[8], _mm_mul_ps(sz, _mm_mul_ps(ch, cp)));
+            for(int lane = 0; lane < 4; lane++){
+                glm::mat4& local = localMatrices[k + lane];
+                local[0] = glm::vec4(elements[0][lane], elements[1][lane], elements[2][lane], 0.0f);
+                local[1] = glm::vec4(elements[3][lane], elements[4][lane], elements[5][lane], 0.0f);
+                local[2] = glm::vec4(elements[6][lane], elements[7][lane], elements[8][lane], 0.0f);
+                local[3] = glm::vec4(positionX[k + lane], positionY[k + lane], positionZ[k + lane], 1.0f);
+            }
+        }
+#endif
+        for(; k < count; k++){
+            float ch = cosYaw[k], sh = sinYaw[k], cp = cosPitch[k], sp = sinPitch[k], cb = cosRoll[k], sb = sinRoll[k];
+            glm::mat4& local = localMatrices[k];
+            local[0] = scaleX[k] * glm::vec4(ch * cb + sh * sp * sb, sb * cp, -sh * cb + ch * sp * sb, 0.0f);
+            local[1] = scaleY[k] * glm::vec4(-ch * sb + sh * sp * cb, cb * cp, sb * sh + ch * sp * cb, 0.0f);
+            local[2] = scaleZ[k] * glm::vec4(sh * cp, -sp, ch * cp, 0.0f);
+            local[3] = glm::vec4(positionX[k], positionY[k], positionZ[k], 1.0f);
+        }
+
+        // Combine with the parent matrices. Since the dirty entities are in hierarchy order,
+        // the parent's matrix is always up to date by the time we reach its children.
+        for(size_t k = 0; k < count; k++){
+            std::uint32_t index = dirtyIndices[k];
+            if(parents[index] >= 0) multiply(worldMatrices[parents[index]], localMatrices[k], worldMatrices[index]);
+            else worldMatrices[index] = localMatrices[k];
+        }
+        for(auto index : dirtyIndices){
+            dirty[index] = 0;
+            if(!changed[index]){
+                changed[index] = 1;
+                changedEntities.push_back(entities[index]);
+            }
+        }
+    }
+
+    void TransformStore::takeChanged(std::vector<Entity*>& out){
+        out.clear();
+        out.swap(changedEntities);
+        for(Entity* entity : out) changed[entity->transformIndex] = 0;
+    }
+
+    void TransformStore::beginTick(){
+        for(size_t i = 0; i < entities.size(); i++) previousTransforms[i] = entities[i]->localTransform;
+    }
+
+    // Returns the angle "to" shifted by whole turns such that it is as close as possible to "from"
+    // (so that blending a yaw that wrapped from +pi to -pi doesn't spin the entity around)
+    static glm::vec3 closestAngles(const glm::vec3& from, const glm::vec3& to){
+        glm::vec3 difference = to - from;
+        difference -= glm::two_pi<float>() * glm::round(difference / glm::two_pi<float>());
+        return from + difference;
+    }
+
+    void TransformStore::interpolate(float alpha, float snapDistance){
+        stashedTransforms.clear();
+        for(size_t i = 0; i < entities.size(); i++){
+            Transform& current = entities[i]->localTransform;
+            const Transform& previous = previousTransforms[i];
+            if(current.position == previous.position && current.rotation == previous.rotation && current.scale == previous.scale) continue;
+            if(glm::distance(current.position, previous.position) > snapDistance) continue;
+            stashedTransforms.emplace_back(i, current);
+            Transform blended;
+            blended.position = glm::mix(previous.position, current.position, alpha);
+            blended.rotation = glm::mix(previous.rotation, closestAngles(previous.rotation, current.rotation), alpha);
+            blended.scale = glm::mix(previous.scale, current.scale, alpha);
+            current = blended;
+            dirty[i] = 1;
+        }
+        update();
+    }
+
+    void TransformStore::restore(){
+        for(auto& [index, transform] : stashedTransforms){
+            entities[index]->localTransform = transform;
+            dirty[index] = 1;
+        }
+        stashedTransforms.clear();
+    }
+
+}
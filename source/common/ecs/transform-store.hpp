@@ -0,0 +1,69 @@
+#pragma once
+
+#include "transform.hpp"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace our {
+
+    class Entity; // A forward declaration of the Entity Class
+
+    // The transform store caches the local to world matrix of every entity in the world.
+    // Whenever the local transform of an entity changes, the entity should be marked as dirty (see "Entity::markTransformDirty").
+    // Then "update" rebuilds the matrices of the dirty entities (and their children) in one batch:
+    // the entities are kept in hierarchy order (a parent always comes before its children) so a single pass is enough
+    // to propagate the changes down the hierarchy, and the local matrices are built from structure of arrays data
+    // four entities at a time using SIMD. Between updates, reading the matrix of a clean entity is just a load.
+    class TransformStore {
+        std::vector<Entity*> entities; // The entities in hierarchy order (parents before children)
+        std::vector<int> parents; // The index of the parent of each entity (-1 for root entities)
+        std::vector<glm::mat4> worldMatrices; // The cached local to world matrix of each entity
+        std::vector<std::uint8_t> dirty; // Whether the local transform of each entity changed since the last update
+        std::vector<Transform> previousTransforms; // The local transform of each entity at the start of the current simulation tick
+        std::vector<std::pair<size_t, Transform>> stashedTransforms; // The simulated transforms replaced by "interpolate"
+        std::vector<Entity*> changedEntities; // The entities whose matrices were rebuilt since the last "takeChanged"
+        std::vector<std::uint8_t> changed; // Whether each entity is already in "changedEntities"
+
+        // Scratch arrays used by "update" (kept here to prevent reallocating them every frame)
+        std::vector<std::uint32_t> dirtyIndices;
+        std::vector<float> positionX, positionY, positionZ;
+        std::vector<float> sinYaw, cosYaw, sinPitch, cosPitch, sinRoll, cosRoll;
+        std::vector<float> scaleX, scaleY, scaleZ;
+        std::vector<glm::mat4> localMatrices;
+
+        // Reorders the entities such that every parent comes before its children
+        void sortByHierarchy();
+    public:
+        // Adds an entity to the store (it starts dirty)
+        void add(Entity* entity);
+        // Removes an entity from the store
+        void remove(Entity* entity);
+        // Removes all the entities from the store
+        void clear();
+
+        // Marks the entity's local transform as changed
+        void markDirty(const Entity* entity);
+        // Returns true if the entity or any of its ancestors changed since the last update (so its cached matrix is stale)
+        bool isDirty(const Entity* entity) const;
+        // Returns the cached local to world matrix of the entity (only valid if the entity is not dirty)
+        const glm::mat4& get(const Entity* entity) const;
+
+        // Rebuilds the local to world matrices of all the dirty entities and their children
+        void update();
+        // Moves the entities whose matrices were rebuilt since the last call into "out" (each entity is listed once).
+        // This lets a single consumer (the renderer) follow the changes without checking every entity.
+        void takeChanged(std::vector<Entity*>& out);
+
+        // Remembers the local transforms at the start of a simulation tick (used later by "interpolate")
+        void beginTick();
+        // Replaces the local transform of every entity that moved during the last tick by a blend between its transform
+        // before and after that tick (alpha = 0 gives the previous one and alpha = 1 the current one), then rebuilds the matrices.
+        // Entities that moved further than "snapDistance" (e.g. teleported) are not blended.
+        // The simulated transforms must be put back using "restore" before the next tick.
+        void interpolate(float alpha, float snapDistance);
+        // Puts back the simulated transforms replaced by "interpolate"
+        void restore();
+    };
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "archetype.hpp"
+#include <tuple>
+#include <vector>
+
+namespace our {
+
+    // A view is the result of a query on the world for the entities that hold at least one component of each of the types "T..."
+    // It doesn't copy any entity, it only refers to the list of matching archetypes which the world keeps up to date
+    // (an archetype is added to the list once it is created and the archetypes themselves are updated whenever an entity
+    // gains or loses a component or is marked for removal). So a view can be stored and reused across frames.
+    // The cost of walking a view depends on the number of matching entities, not on the number of entities in the world.
+    template<typename... T>
+    class View {
+        const std::vector<Archetype*>* archetypes; // The archetypes matching this query (owned by the world)
+    public:
+        explicit View(const std::vector<Archetype*>& archetypes) : archetypes(&archetypes) {}
+
+        // This calls the given function for every matching entity.
+        // The function receives the entity followed by a pointer to its (first) component of each type, for example:
+        //     world->view<CameraComponent, FreeCameraControllerComponent>().each([](Entity* entity, CameraComponent* camera, FreeCameraControllerComponent* controller){ ... });
+        // WARNING: Don't add or delete components inside the function since this moves entities between archetypes.
+        template<typename Function>
+        void each(Function&& function) const {
+            for(auto archetype : *archetypes){
+                if(archetype->size() == 0) continue;
+                auto columns = std::make_tuple(archetype->getColumn(getComponentTypeId<T>())...);
+                const auto& entities = archetype->getEntities();
+                for(size_t row = 0; row < entities.size(); row++){
+                    std::apply([&](auto... column){
+                        function(entities[row], static_cast<T*>(column[row])...);
+                    }, columns);
+                }
+            }
+        }
+
+        // Returns the first matching entity or nullptr if there is none
+        Entity* first() const {
+            for(auto archetype : *archetypes)
+                if(archetype->size() > 0) return archetype->getEntities()[0];
+            return nullptr;
+        }
+
+        // Returns the number of matching entities
+        size_t size() const {
+            size_t count = 0;
+            for(auto archetype : *archetypes) count += archetype->size();
+            return count;
+        }
+
+        // Returns true if no entity matches this query
+        bool empty() const { return first() == nullptr; }
+    };
+
+}
@@ -0,0 +1,45 @@
+#include "world-snapshot.hpp"
+
+#include <iostream>
+#include <unordered_set>
+
+namespace our {
+
+    bool WorldSnapshot::restore(World* world) const {
+        // Remove the entities that were not there when the snapshot was captured (e.g. spawned during the game)
+        std::unordered_set<EntityHandle> saved;
+        saved.reserve(entities.size());
+        for(const auto& state : entities) saved.insert(state.handle);
+        std::vector<Entity*> added;
+        for(Entity* entity : world->getEntities()){
+            if(!saved.count(world->getHandle(entity))) added.push_back(entity);
+        }
+        for(Entity* entity : added) world->markForRemoval(entity);
+        world->deleteMarkedEntities();
+
+        for(const auto& state : entities){
+            Entity* entity = world->get(state.handle);
+            if(!entity){
+                std::cerr << "Can't restore the world: the entity \"" << state.name << "\" was deleted" << std::endl;
+                return false;
+            }
+            entity->parent = state.parent;
+            entity->name = state.name;
+            entity->localTransform = state.localTransform;
+            entity->markTransformDirty();
+        }
+        for(const auto& state : components){
+            Entity* entity = world->get(state.owner);
+            Component* component = entity ? state.find(entity, state.index) : nullptr;
+            if(!component){
+                std::cerr << "Can't restore the world: a component of \"" << (entity ? entity->name : "?") << "\" was deleted" << std::endl;
+                return false;
+            }
+            state.assign(component, state.copy.get());
+        }
+        // The restored components may refer to other assets than before
+        world->markStructureChanged();
+        return true;
+    }
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "world.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace our {
+
+    // A world snapshot remembers the entities of a world along with their transforms and the values of some of their components,
+    // so that the world can later be put back in that state without deserializing it again.
+    // Only the component types given to "capture" are saved. These should be the components whose data changes during
+    // the game (e.g. the player's health), the rest (meshes, materials, colliders, ...) are left untouched by "restore".
+    class WorldSnapshot {
+        struct EntityState {
+            EntityHandle handle;
+            Entity* parent;
+            std::string name;
+            Transform localTransform;
+        };
+        struct ComponentState {
+            EntityHandle owner;
+            size_t index; // The index of the component among the owner's components of the same type
+            std::unique_ptr<Component> copy;
+            // Finds the component in the owner (or returns nullptr if the owner no longer has it)
+            Component* (*find)(Entity* owner, size_t index);
+            // Copies the saved values into the component
+            void (*assign)(Component* target, const Component* source);
+        };
+        std::vector<EntityState> entities;
+        std::vector<ComponentState> components;
+
+        template<typename T>
+        void captureComponents(Entity* entity, EntityHandle handle){
+            std::vector<T*> list = entity->getComponents<T>();
+            for(size_t index = 0; index < list.size(); index++){
+                ComponentState state;
+                state.owner = handle;
+                state.index = index;
+                state.copy = std::make_unique<T>(*list[index]);
+                state.find = [](Entity* owner, size_t index) -> Component* {
+                    std::vector<T*> list = owner->getComponents<T>();
+                    return index < list.size() ? list[index] : nullptr;
+                };
+                state.assign = [](Component* target, const Component* source){
+                    *static_cast<T*>(target) = *static_cast<const T*>(source);
+                };
+                components.push_back(std::move(state));
+            }
+        }
+    public:
+        // Saves every entity of the world, its transform and the values of its components of the types "T..."
+        template<typename... T>
+        void capture(World* world){
+            clear();
+            for(Entity* entity : world->getEntities()){
+                EntityHandle handle = world->getHandle(entity);
+                entities.push_back({handle, entity->parent, entity->name, entity->localTransform});
+                (captureComponents<T>(entity, handle), ...);
+            }
+        }
+
+        // Deletes the entities that were added after the capture and puts the saved values back.
+        // Returns false if some of the saved entities or components no longer exist (in that case, the world should be rebuilt).
+        bool restore(World* world) const;
+
+        bool empty() const { return entities.empty(); }
+        void clear(){ entities.clear(); components.clear(); }
+    };
+
+}
@@ -1,4 +1,9 @@
 #include "world.hpp"
+#include "cooked-scene.hpp"
+#include "../deserialize-utils.hpp"
+#include "../components/component-deserializer.hpp"
+
+#include <new>
 
 namespace our {
 
@@ -18,4 +23,180 @@ namespace our {
         }
     }
 
-}
\ No newline at end of file
+    // The entities are stored with their parents first and their transforms already converted, so we just create them in order.
+    // The component types are resolved once per kind instead of comparing the type string of every component.
+    void World::deserialize(const CookedScene& scene){
+        std::vector<ComponentFactory> factories(scene.getKindCount());
+        for(std::uint32_t kind = 0; kind < scene.getKindCount(); kind++)
+            factories[kind] = findComponentFactory(scene.getKind(kind));
+
+        std::vector<Entity*> created(scene.getEntityCount());
+        for(std::uint32_t index = 0; index < scene.getEntityCount(); index++){
+            const cooked_scene::Entity& data = scene.getEntity(index);
+            Entity* entity = add();
+            entity->parent = data.parent == cooked_scene::NO_PARENT ? nullptr : created[data.parent];
+            entity->name = scene.getString(data.name);
+            entity->localTransform.position = glm::vec3(data.position[0], data.position[1], data.position[2]);
+            entity->localTransform.rotation = glm::vec3(data.rotation[0], data.rotation[1], data.rotation[2]);
+            entity->localTransform.scale = glm::vec3(data.scale[0], data.scale[1], data.scale[2]);
+            entity->markTransformDirty();
+            for(std::uint32_t offset = 0; offset < data.componentCount; offset++){
+                const cooked_scene::Component& component = scene.getComponent(data.firstComponent + offset);
+                if(ComponentFactory factory = factories[component.kind])
+                    factory(entity)->deserialize(scene.getComponentData(component));
+            }
+            created[index] = entity;
+        }
+    }
+
+    Entity* World::add(){
+        Entity* entity = new (entityAllocator.allocate()) Entity();
+        entity->world = this;
+        // Store the entity densely, removal swaps the last entity into its place
+        entity->denseIndex = entities.size();
+        entities.push_back(entity);
+        // Reuse a free slot if there is one, its generation was already incremented when its entity was deleted
+        if(freeSlots.empty()){
+            slots.emplace_back();
+            entity->slotIndex = (std::uint32_t)(slots.size() - 1);
+        } else {
+            entity->slotIndex = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        slots[entity->slotIndex].entity = entity;
+        relocate(entity);
+        transforms.add(entity);
+        return entity;
+    }
+
+    void World::markForRemoval(Entity* entity){
+        if(!entity || entity->world != this || entity->pendingRemoval) return;
+        structureVersion++;
+        entity->pendingRemoval = true;
+        markedForRemoval.push_back(entity);
+        ComponentMask before = entity->getComponentMask();
+        removeFromArchetype(entity);
+        updateSingletons(entity, before, 0);
+    }
+
+    void World::deleteMarkedEntities(){
+        for(auto entity : markedForRemoval){
+            // Swap the last entity into the removed entity's place to keep the list dense
+            Entity* last = entities.back();
+            entities[entity->denseIndex] = last;
+            last->denseIndex = entity->denseIndex;
+            entities.pop_back();
+            // Invalidate the handles to this entity and free its slot
+            EntitySlot& slot = slots[entity->slotIndex];
+            slot.entity = nullptr;
+            slot.generation++;
+            freeSlots.push_back(entity->slotIndex);
+            transforms.remove(entity);
+            destroyEntity(entity);
+        }
+        markedForRemoval.clear();
+    }
+
+    void World::clear(){
+        for(auto entity : entities){
+            destroyEntity(entity);
+        }
+        entities.clear();
+        markedForRemoval.clear();
+        // Invalidate all the handles
+        freeSlots.clear();
+        for(std::uint32_t index = (std::uint32_t)slots.size(); index-- > 0;){
+            if(slots[index].entity){
+                slots[index].entity = nullptr;
+                slots[index].generation++;
+            }
+            freeSlots.push_back(index);
+        }
+        for(auto& archetype : archetypes){
+            archetype->clear();
+        }
+        singletons.fill(nullptr);
+        transforms.clear();
+        structureVersion++;
+    }
+
+    void* World::allocateComponent(ComponentTypeId type, size_t size, size_t alignment){
+        auto& allocator = componentAllocators[type];
+        if(!allocator) allocator = std::make_unique<SlabAllocator>(size, alignment);
+        return allocator->allocate();
+    }
+
+    void World::destroyComponent(Component* component){
+        ComponentTypeId type = component->getTypeId();
+        // The memory block starts at the most derived object which may not be where the Component base lies
+        void* block = dynamic_cast<void*>(component);
+        component->~Component();
+        componentAllocators[type]->deallocate(block);
+    }
+
+    void World::destroyEntity(Entity* entity){
+        entity->~Entity();
+        entityAllocator.deallocate(entity);
+    }
+
+    Archetype* World::getArchetype(ComponentMask mask){
+        if(auto it = archetypeLookup.find(mask); it != archetypeLookup.end()) return it->second;
+        archetypes.push_back(std::make_unique<Archetype>(mask));
+        Archetype* archetype = archetypes.back().get();
+        archetypeLookup[mask] = archetype;
+        // Add the new archetype to every query it matches so that the existing views stay up to date
+        for(auto& [required, matching] : queries)
+            if(archetype->matches(required)) matching.push_back(archetype);
+        return archetype;
+    }
+
+    void World::relocate(Entity* entity){
+        // Entities marked for removal were already taken out of the archetypes, so we leave them out
+        if(entity->pendingRemoval) return;
+        structureVersion++;
+        ComponentMask mask = 0;
+        for(auto component : entity->components) mask |= getComponentMask(component->getTypeId());
+        // If the set of component types didn't change, we only need to refresh the row
+        // (e.g. the first component of some type was deleted and another one of the same type took its place)
+        if(entity->archetype && entity->archetype->getMask() == mask){
+            entity->archetype->refresh(entity->archetypeRow, entity->components);
+            return;
+        }
+        ComponentMask before = entity->getComponentMask();
+        removeFromArchetype(entity);
+        Archetype* archetype = getArchetype(mask);
+        entity->archetype = archetype;
+        entity->archetypeRow = archetype->insert(entity, entity->components);
+        updateSingletons(entity, before, mask);
+    }
+
+    void World::removeFromArchetype(Entity* entity){
+        if(!entity->archetype) return;
+        // The last row is moved into the removed row, so we need to update the index of the moved entity
+        if(Entity* moved = entity->archetype->remove(entity->archetypeRow); moved){
+            moved->archetypeRow = entity->archetypeRow;
+        }
+        entity->archetype = nullptr;
+        entity->archetypeRow = 0;
+    }
+
+    void World::updateSingletons(Entity* entity, ComponentMask before, ComponentMask after){
+        for(ComponentTypeId type = 0; type < MAX_COMPONENT_TYPES; type++){
+            ComponentMask bit = getComponentMask(type);
+            if((after & bit) && !singletons[type]){
+                // The entity gained a component type that had no singleton yet
+                singletons[type] = entity;
+            } else if((before & bit) && !(after & bit) && singletons[type] == entity){
+                // The singleton lost the component type, so we pick any other entity that still holds it
+                singletons[type] = nullptr;
+                for(auto& archetype : archetypes){
+                    if(archetype->size() > 0 && archetype->matches(bit)){
+                        singletons[type] = archetype->getEntities()[0];
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+}
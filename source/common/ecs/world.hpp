@@ -1,15 +1,62 @@
 #pragma once
 
-#include <unordered_set>
+#include <unordered_map>
+#include <memory>
+#include <array>
+#include <mutex>
 #include "entity.hpp"
+#include "entity-handle.hpp"
+#include "slab-allocator.hpp"
+#include "view.hpp"
+#include "transform-store.hpp"
 
 namespace our {
 
     // This class holds a set of entities
+    class CookedScene; // A forward declaration of the CookedScene Class
+
     class World {
-        std::unordered_set<Entity*> entities; // These are the entities held by this world
-        std::unordered_set<Entity*> markedForRemoval; // These are the entities that are awaiting to be deleted
-                                                      // when deleteMarkedEntities is called
+        std::vector<Entity*> entities; // These are the entities held by this world (stored densely, in a deterministic order)
+        std::vector<Entity*> markedForRemoval; // These are the entities that are awaiting to be deleted
+                                               // when deleteMarkedEntities is called
+
+        // Each entity occupies a slot which is used to resolve entity handles. When the entity is deleted,
+        // the slot generation is incremented (so old handles no longer match) and the slot is reused later.
+        struct EntitySlot {
+            Entity* entity = nullptr;
+            std::uint32_t generation = 0;
+        };
+        std::vector<EntitySlot> slots;
+        std::vector<std::uint32_t> freeSlots; // The slots that are not used by any entity
+
+        // The entities and the components are allocated from slabs instead of being allocated one by one on the heap
+        SlabAllocator entityAllocator{sizeof(Entity), alignof(Entity)};
+        std::array<std::unique_ptr<SlabAllocator>, MAX_COMPONENT_TYPES> componentAllocators; // One allocator per component type
+        std::vector<std::unique_ptr<Archetype>> archetypes; // The archetypes that store the components of the entities
+        std::unordered_map<ComponentMask, Archetype*> archetypeLookup; // Finds the archetype of a given set of component types
+        std::unordered_map<ComponentMask, std::vector<Archetype*>> queries; // The matching archetypes of every query requested via "view"
+        std::mutex queriesMutex; // Protects "queries" since systems running on worker threads may request views
+        std::array<Entity*, MAX_COMPONENT_TYPES> singletons{}; // For each component type, an entity holding it (used by "getSingleton")
+        TransformStore transforms; // The cached local to world matrices of the entities
+        std::uint64_t structureVersion = 0; // Incremented whenever entities or components are added or removed
+
+        friend Entity; // The entity is a friend since it notifies the world whenever its set of components changes
+
+        // Returns the archetype that holds exactly the given set of component types (it will be created if it doesn't exist)
+        Archetype* getArchetype(ComponentMask mask);
+        // Moves the entity to the archetype that matches its current components
+        void relocate(Entity* entity);
+        // Removes the entity's row from its archetype
+        void removeFromArchetype(Entity* entity);
+        // Updates the singleton entities of the component types that the entity gained or lost
+        void updateSingletons(Entity* entity, ComponentMask before, ComponentMask after);
+
+        // Returns memory for a component of the given type from the slab allocator of that type
+        void* allocateComponent(ComponentTypeId type, size_t size, size_t alignment);
+        // Destroys the component and returns its memory to the slab allocator of its type
+        void destroyComponent(Component* component);
+        // Destroys the entity (and its components) and returns its memory to the entity allocator
+        void destroyEntity(Entity* entity);
     public:
 
         World() = default;
@@ -18,50 +65,118 @@ namespace our {
         // If parent pointer is not null, the new entities will be have their parent set to that given pointer
         // If any of the entities has children, this function will be called recursively for these children
         void deserialize(const nlohmann::json& data, Entity* parent = nullptr);
+        // This adds all the entities of a cooked scene to the current world (see "cooked-scene.hpp")
+        void deserialize(const CookedScene& scene);
 
-        // This adds an entity to the entities set and returns a pointer to that entity
+        // This adds an entity to the entities list and returns a pointer to that entity
         // WARNING The entity is owned by this world so don't use "delete" to delete it, instead, call "markForRemoval"
-        // to put it in the "markedForRemoval" set. The elements in the "markedForRemoval" set will be removed and
+        // to put it in the "markedForRemoval" list. The elements in the "markedForRemoval" list will be removed and
         // deleted when "deleteMarkedEntities" is called.
-        Entity* add() {
-            Entity *entity = new Entity();
-            entity->world = this;
-            entities.insert(entity);
-            return entity;
+        Entity* add();
+
+        // This returns a handle to the given entity. Unlike the raw pointer, the handle can be safely kept after the
+        // entity is deleted since "get" will return a nullptr for it.
+        EntityHandle getHandle(const Entity* entity) const {
+            if(!entity) return EntityHandle();
+            return EntityHandle{entity->slotIndex, slots[entity->slotIndex].generation};
+        }
+
+        // This returns the entity referred to by the given handle or a nullptr if the handle is null or stale
+        // (the entity was deleted or marked for removal)
+        Entity* get(EntityHandle handle) const {
+            if(handle.index >= slots.size()) return nullptr;
+            const EntitySlot& slot = slots[handle.index];
+            if(slot.generation != handle.generation || !slot.entity || slot.entity->pendingRemoval) return nullptr;
+            return slot.entity;
+        }
+
+        // This rebuilds the cached local to world matrices of the entities whose transforms changed (and their children).
+        // It should be called after the systems that move entities, so that the matrix reads that follow are plain loads.
+        void updateTransforms() {
+            transforms.update();
+        }
+
+        // This moves the entities whose cached matrices were rebuilt since the last call into "out".
+        // Only one consumer (the renderer) should call it since each change is reported once.
+        void takeChangedTransforms(std::vector<Entity*>& out) {
+            transforms.takeChanged(out);
+        }
+
+        // This returns a number that changes whenever an entity or a component is added or removed (or "markStructureChanged" is called),
+        // so that the data derived from the components (e.g. the renderer's retained commands) knows when it must be rebuilt.
+        std::uint64_t getStructureVersion() const {
+            return structureVersion;
+        }
+
+        // This should be called after changing what a component refers to without adding or removing components
+        // (e.g. giving a mesh renderer another material), since the world can't detect that by itself.
+        void markStructureChanged() {
+            structureVersion++;
+        }
+
+        // This should be called before every simulation tick to remember where the entities were before it.
+        void beginTick() {
+            transforms.beginTick();
+        }
+
+        // For rendering between two simulation ticks, this blends the transforms of the entities that moved during the last
+        // tick by "alpha" (0 = before the tick, 1 = after it) and rebuilds their matrices. Entities that moved further than
+        // "snapDistance" are drawn where they are. "restoreTransforms" must be called after rendering.
+        void interpolateTransforms(float alpha, float snapDistance) {
+            transforms.interpolate(alpha, snapDistance);
+        }
+
+        // This puts back the simulated transforms that were replaced by "interpolateTransforms".
+        void restoreTransforms() {
+            transforms.restore();
         }
 
-        // This returns and immutable reference to the set of all entites in the world.
-        const std::unordered_set<Entity*>& getEntities() {
+        // This returns and immutable reference to the list of all entites in the world.
+        const std::vector<Entity*>& getEntities() {
             return entities;
         }
 
-        // This marks an entity for removal by adding it to the "markedForRemoval" set.
-        // The elements in the "markedForRemoval" set will be removed and deleted when "deleteMarkedEntities" is called.
-        void markForRemoval(Entity* entity){
-            if(entities.find(entity) != entities.end()){
-                markedForRemoval.insert(entity);
+        // This returns a view of all the entities that hold at least one component of each of the types "T..."
+        // The matching archetypes are found once per query and then kept up to date as new archetypes are created.
+        template<typename... T>
+        View<T...> view(){
+            ComponentMask required = getComponentMask<T...>();
+            std::lock_guard<std::mutex> lock(queriesMutex);
+            auto it = queries.find(required);
+            if(it == queries.end()){
+                std::vector<Archetype*> matching;
+                for(auto& archetype : archetypes)
+                    if(archetype->matches(required)) matching.push_back(archetype.get());
+                it = queries.emplace(required, std::move(matching)).first;
             }
+            return View<T...>(it->second);
         }
 
-        // This removes the elements in "markedForRemoval" from the "entities" set.
-        // Then each of these elements are deleted.
-        void deleteMarkedEntities(){
-            for(auto entity : markedForRemoval){
-                entities.erase(entity);
-                delete entity;
-            }
-            markedForRemoval.clear();
+        // This is a shorthand for "view<T...>().each(function)"
+        template<typename... T, typename Function>
+        void forEach(Function&& function){
+            view<T...>().each(std::forward<Function>(function));
         }
 
-        //This deletes all entities in the world
-        void clear(){
-            for(auto entity : entities){
-                delete entity;
-            }
-            entities.clear();
-            markedForRemoval.clear();
+        // This returns an entity holding a component of type T (or nullptr if there is none) in O(1).
+        // It is meant for components that exist only once in the world (e.g. the player, the slenderman and the page spawner).
+        template<typename T>
+        Entity* getSingleton() const {
+            return singletons[getComponentTypeId<T>()];
         }
 
+        // This marks an entity for removal by adding it to the "markedForRemoval" list.
+        // The elements in the "markedForRemoval" list will be removed and deleted when "deleteMarkedEntities" is called.
+        // The entity is removed from its archetype right away so it no longer shows up in any view.
+        void markForRemoval(Entity* entity);
+
+        // This removes the elements in "markedForRemoval" from the "entities" list.
+        // Then each of these elements are deleted.
+        void deleteMarkedEntities();
+
+        //This deletes all entities in the world
+        void clear();
+
         //Since the world owns all of its entities, they should be deleted alongside it.
         ~World(){
             clear();
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace our {
+
+// The result of testing a volume against the frustum
+enum class FrustumTest { OUTSIDE, INTERSECTS, INSIDE };
+
+// Frustum planes for culling
+struct Frustum {
+    glm::vec4 planes[6];  // left, right, bottom, top, near, far
+
+    void extractFromVP(const glm::mat4& VP) {
+        // Extract frustum planes from view-projection matrix
+        // Left plane
+        planes[0] = glm::vec4(VP[0][3] + VP[0][0], VP[1][3] + VP[1][0],
+                              VP[2][3] + VP[2][0], VP[3][3] + VP[3][0]);
+        // Right plane
+        planes[1] = glm::vec4(VP[0][3] - VP[0][0], VP[1][3] - VP[1][0],
+                              VP[2][3] - VP[2][0], VP[3][3] - VP[3][0]);
+        // Bottom plane
+        planes[2] = glm::vec4(VP[0][3] + VP[0][1], VP[1][3] + VP[1][1],
+                              VP[2][3] + VP[2][1], VP[3][3] + VP[3][1]);
+        // Top plane
+        planes[3] = glm::vec4(VP[0][3] - VP[0][1], VP[1][3] - VP[1][1],
+                              VP[2][3] - VP[2][1], VP[3][3] - VP[3][1]);
+        // Near plane
+        planes[4] = glm::vec4(VP[0][3] + VP[0][2], VP[1][3] + VP[1][2],
+                              VP[2][3] + VP[2][2], VP[3][3] + VP[3][2]);
+        // Far plane
+        planes[5] = glm::vec4(VP[0][3] - VP[0][2], VP[1][3] - VP[1][2],
+                              VP[2][3] - VP[2][2], VP[3][3] - VP[3][2]);
+        // Normalize planes
+        for (int i = 0; i < 6; i++) {
+            float length = glm::length(glm::vec3(planes[i]));
+            planes[i] /= length;
+        }
+    }
+
+    // Check if a sphere is inside or intersects the frustum
+    bool isSphereInside(const glm::vec3& center, float radius) const {
+        for (int i = 0; i < 6; i++) {
+            float distance =
+                glm::dot(glm::vec3(planes[i]), center) + planes[i].w;
+            if (distance < -radius) {
+                return false;  // Sphere is completely outside this plane
+            }
+        }
+        return true;
+    }
+
+    // Check whether an axis aligned box is outside, intersects or is completely inside the frustum
+    FrustumTest classifyBox(const glm::vec3& minBound, const glm::vec3& maxBound) const {
+        glm::vec3 center = (minBound + maxBound) * 0.5f;
+        glm::vec3 extent = (maxBound - minBound) * 0.5f;
+        FrustumTest result = FrustumTest::INSIDE;
+        for (int i = 0; i < 6; i++) {
+            glm::vec3 normal = glm::vec3(planes[i]);
+            // The distance of the center and the largest distance of a corner from the center along the plane normal
+            float distance = glm::dot(normal, center) + planes[i].w;
+            float reach = glm::dot(glm::abs(normal), extent);
+            if (distance < -reach) return FrustumTest::OUTSIDE;
+            if (distance < reach) result = FrustumTest::INTERSECTS;
+        }
+        return result;
+    }
+
+    // Check if an axis aligned box is inside or intersects the frustum
+    bool isBoxInside(const glm::vec3& minBound, const glm::vec3& maxBound) const {
+        return classifyBox(minBound, maxBound) != FrustumTest::OUTSIDE;
+    }
+};
+
+}  // namespace our
@@ -0,0 +1,184 @@
+#include "gl-state.hpp"
+
+#include <array>
+
+namespace our::gl_state {
+
+    namespace {
+
+        Stats stats;
+
+        // A shadowed value. "change" returns true (and remembers the value) if the call must be sent to OpenGL.
+        template<typename T>
+        struct Shadowed {
+            T value{};
+            bool known = false;
+
+            bool change(const T& newValue) {
+                if (known && value == newValue) {
+                    stats.filtered++;
+                    return false;
+                }
+                value = newValue;
+                known = true;
+                stats.issued++;
+                return true;
+            }
+            // Marks the value as unknown if it equals the given one (used when an object is deleted)
+            void forget(const T& oldValue) {
+                if (value == oldValue) known = false;
+            }
+        };
+
+        struct State {
+            Shadowed<GLuint> program, vertexArray, activeUnit;
+            std::array<Shadowed<GLuint>, TRACKED_TEXTURE_UNITS> textures, bufferTextures, samplers;
+            Shadowed<bool> cullFaceEnabled, depthTestEnabled, blendEnabled;
+            Shadowed<GLenum> cullFace, frontFace, depthFunc, blendEquation;
+            Shadowed<std::array<GLenum, 2>> blendFunc;
+            Shadowed<std::array<GLfloat, 4>> blendColor;
+            Shadowed<std::array<GLboolean, 4>> colorMask;
+            Shadowed<GLboolean> depthMask;
+        } state;
+
+        Shadowed<bool>* findCapability(GLenum capability) {
+            switch (capability) {
+                case GL_CULL_FACE: return &state.cullFaceEnabled;
+                case GL_DEPTH_TEST: return &state.depthTestEnabled;
+                case GL_BLEND: return &state.blendEnabled;
+                default: return nullptr;
+            }
+        }
+
+    }
+
+    void invalidate() {
+        state = State();
+    }
+
+    void useProgram(GLuint program) {
+        if (state.program.change(program)) glUseProgram(program);
+    }
+
+    void bindVertexArray(GLuint vertexArray) {
+        if (state.vertexArray.change(vertexArray)) glBindVertexArray(vertexArray);
+    }
+
+    void activeTexture(GLuint unit) {
+        if (state.activeUnit.change(unit)) glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void bindTexture(GLuint texture) {
+        // If the active unit is unknown, we can't know which unit the texture will be bound to, so all the units are forgotten
+        if (!state.activeUnit.known) {
+            for (auto& binding : state.textures) binding.known = false;
+            stats.issued++;
+            glBindTexture(GL_TEXTURE_2D, texture);
+            return;
+        }
+        bindTexture(state.activeUnit.value, texture);
+    }
+
+    void bindTexture(GLuint unit, GLuint texture) {
+        if (unit >= TRACKED_TEXTURE_UNITS) {
+            activeTexture(unit);
+            stats.issued++;
+            glBindTexture(GL_TEXTURE_2D, texture);
+            return;
+        }
+        // The active unit is only changed if the binding itself has to be sent
+        if (state.textures[unit].change(texture)) {
+            activeTexture(unit);
+            glBindTexture(GL_TEXTURE_2D, texture);
+        }
+    }
+
+    void bindBufferTexture(GLuint unit, GLuint texture) {
+        if (unit >= TRACKED_TEXTURE_UNITS) {
+            activeTexture(unit);
+            stats.issued++;
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            return;
+        }
+        if (state.bufferTextures[unit].change(texture)) {
+            activeTexture(unit);
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+        }
+    }
+
+    void bindSampler(GLuint unit, GLuint sampler) {
+        if (unit >= TRACKED_TEXTURE_UNITS) {
+            stats.issued++;
+            glBindSampler(unit, sampler);
+            return;
+        }
+        if (state.samplers[unit].change(sampler)) glBindSampler(unit, sampler);
+    }
+
+    void setEnabled(GLenum capability, bool enabled) {
+        Shadowed<bool>* shadow = findCapability(capability);
+        if (shadow && !shadow->change(enabled)) return;
+        if (!shadow) stats.issued++;
+        if (enabled) glEnable(capability);
+        else glDisable(capability);
+    }
+
+    void cullFace(GLenum face) {
+        if (state.cullFace.change(face)) glCullFace(face);
+    }
+
+    void frontFace(GLenum winding) {
+        if (state.frontFace.change(winding)) glFrontFace(winding);
+    }
+
+    void depthFunc(GLenum function) {
+        if (state.depthFunc.change(function)) glDepthFunc(function);
+    }
+
+    void blendEquation(GLenum equation) {
+        if (state.blendEquation.change(equation)) glBlendEquation(equation);
+    }
+
+    void blendFunc(GLenum sourceFactor, GLenum destinationFactor) {
+        if (state.blendFunc.change({sourceFactor, destinationFactor})) glBlendFunc(sourceFactor, destinationFactor);
+    }
+
+    void blendColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+        if (state.blendColor.change({r, g, b, a})) glBlendColor(r, g, b, a);
+    }
+
+    void colorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a) {
+        if (state.colorMask.change({r, g, b, a})) glColorMask(r, g, b, a);
+    }
+
+    void depthMask(GLboolean mask) {
+        if (state.depthMask.change(mask)) glDepthMask(mask);
+    }
+
+    // OpenGL unbinds a deleted texture, vertex array or sampler from the current context, so its bindings are marked as unknown
+    void forgetProgram(GLuint program) {
+        state.program.forget(program);
+    }
+
+    void forgetVertexArray(GLuint vertexArray) {
+        state.vertexArray.forget(vertexArray);
+    }
+
+    void forgetTexture(GLuint texture) {
+        for (auto& binding : state.textures) binding.forget(texture);
+        for (auto& binding : state.bufferTextures) binding.forget(texture);
+    }
+
+    void forgetSampler(GLuint sampler) {
+        for (auto& binding : state.samplers) binding.forget(sampler);
+    }
+
+    const Stats& getStats() {
+        return stats;
+    }
+
+    void resetStats() {
+        stats = Stats();
+    }
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glad/gl.h>
+
+// A shadow of the OpenGL state that the renderer changes the most (program, vertex array, textures, samplers,
+// depth, culling, blending and the write masks). Every change goes through these functions which only call OpenGL
+// when the value actually differs from the last one that was set, so the code can "set up" whatever it needs without
+// worrying about redundant driver calls.
+// The shadow is only valid if nothing changes this state behind its back, so the code should never call the matching
+// OpenGL functions directly. If some code does (e.g. a third party library), "invalidate" should be called afterwards.
+// All the functions must be called from the thread that owns the OpenGL context.
+namespace our::gl_state {
+
+    // The number of calls that were sent to OpenGL and the number of calls that were dropped since they changed nothing
+    struct Stats {
+        std::uint64_t issued = 0;
+        std::uint64_t filtered = 0;
+    };
+
+    // The texture units tracked by the shadow (binding a texture to a higher unit is always sent to OpenGL)
+    constexpr GLuint TRACKED_TEXTURE_UNITS = 16;
+
+    // Forgets the whole shadow, so the next change of every state is sent to OpenGL
+    void invalidate();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    // Selects the texture unit that "bindTexture" binds to (the unit index, not GL_TEXTURE0 + index)
+    void activeTexture(GLuint unit);
+    // Binds a GL_TEXTURE_2D texture to the active texture unit
+    void bindTexture(GLuint texture);
+    // Binds a GL_TEXTURE_2D texture to the given texture unit
+    void bindTexture(GLuint unit, GLuint texture);
+    // Binds a GL_TEXTURE_BUFFER texture to the given texture unit (it doesn't affect the GL_TEXTURE_2D binding of the unit)
+    void bindBufferTexture(GLuint unit, GLuint texture);
+    void bindSampler(GLuint unit, GLuint sampler);
+
+    // Enables or disables a capability (only GL_CULL_FACE, GL_DEPTH_TEST and GL_BLEND are shadowed)
+    void setEnabled(GLenum capability, bool enabled);
+    void cullFace(GLenum face);
+    void frontFace(GLenum winding);
+    void depthFunc(GLenum function);
+    void blendEquation(GLenum equation);
+    void blendFunc(GLenum sourceFactor, GLenum destinationFactor);
+    void blendColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+    void colorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a);
+    void depthMask(GLboolean mask);
+
+    // These should be called right before deleting an object so that a new object that reuses its name is bound again
+    void forgetProgram(GLuint program);
+    void forgetVertexArray(GLuint vertexArray);
+    void forgetTexture(GLuint texture);
+    void forgetSampler(GLuint sampler);
+
+    const Stats& getStats();
+    void resetStats();
+
+}
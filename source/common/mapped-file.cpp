@@ -0,0 +1,73 @@
+#include "mapped-file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace our {
+
+    bool MappedFile::open(const std::string& path){
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0){
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(!mapping){
+            CloseHandle(file);
+            return false;
+        }
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!view){
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+        fileHandle = file;
+        mappingHandle = mapping;
+        bytes = static_cast<const unsigned char*>(view);
+        length = (size_t)fileSize.QuadPart;
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if(file < 0) return false;
+        struct stat info;
+        if(fstat(file, &info) != 0 || info.st_size == 0){
+            ::close(file);
+            return false;
+        }
+        void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        // The mapping stays valid after the descriptor is closed
+        ::close(file);
+        if(view == MAP_FAILED) return false;
+        bytes = static_cast<const unsigned char*>(view);
+        length = (size_t)info.st_size;
+#endif
+        return true;
+    }
+
+    void MappedFile::close(){
+        if(!bytes) return;
+#ifdef _WIN32
+        UnmapViewOfFile(bytes);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        fileHandle = mappingHandle = nullptr;
+#else
+        munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace our {
+
+    // A read only view of a whole file mapped into memory.
+    // The pages are loaded by the operating system on first access, so opening a large file is cheap
+    // and nothing is copied into a buffer of our own.
+    class MappedFile {
+        const unsigned char* bytes = nullptr;
+        size_t length = 0;
+#ifdef _WIN32
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+#endif
+    public:
+        MappedFile() = default;
+        ~MappedFile() { close(); }
+
+        // Maps the given file. Returns false (and leaves the object closed) if the file can't be opened or is empty.
+        bool open(const std::string& path);
+        // Unmaps the file (if any)
+        void close();
+
+        bool isOpen() const { return bytes != nullptr; }
+        const unsigned char* data() const { return bytes; }
+        size_t size() const { return length; }
+
+        // The mapping belongs to a single object so it should not be copyable
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+    };
+
+}
@@ -1,6 +1,7 @@
 #include "material.hpp"
 
 #include "../asset-loader.hpp"
+#include "../shader/shader-cache.hpp"
 #include "../texture/texture-utils.hpp"
 #include "deserialize-utils.hpp"
 #include "mtl-material-registry.hpp"
@@ -16,9 +17,29 @@ namespace our
         if (shader)
         {
             shader->use();
+            // The handles only need to be resolved again if the material was given another shader
+            if (resolvedShader != shader)
+            {
+                resolveUniforms();
+                resolvedShader = shader;
+            }
         }
     }
 
+    // This function resolves the per object matrices that the renderers set for every object
+    void Material::resolveUniforms() const
+    {
+        transformUniform = shader->getUniform<glm::mat4>("transform");
+        modelUniform = shader->getUniform<glm::mat4>("M");
+        modelInverseTransposeUniform = shader->getUniform<glm::mat4>("M_IT");
+        viewProjectionUniform = shader->getUniform<glm::mat4>("VP");
+        instanceOffsetUniform = shader->getUniform<GLint>("instance_offset");
+        compactInstancesUniform = shader->getUniform<bool>("compact_instances");
+        objectLightCountUniform = shader->getUniform<GLint>("object_light_count");
+        objectLightsUniform[0] = shader->getUniform<glm::ivec4>("object_lights[0]");
+        objectLightsUniform[1] = shader->getUniform<glm::ivec4>("object_lights[1]");
+    }
+
     // This function read the material data from a json object
     void Material::deserialize(const nlohmann::json &data)
     {
@@ -40,10 +61,16 @@ namespace our
         Material::setup();
         if (shader)
         {
-            shader->set("tint", tint);
+            shader->set(tintUniform, tint);
         }
     }
 
+    void TintedMaterial::resolveUniforms() const
+    {
+        Material::resolveUniforms();
+        tintUniform = shader->getUniform<glm::vec4>("tint");
+    }
+
     // This function read the material data from a json object
     void TintedMaterial::deserialize(const nlohmann::json &data)
     {
@@ -61,22 +88,28 @@ namespace our
         TintedMaterial::setup();
         if (shader)
         {
-            shader->set("alphaThreshold", alphaThreshold);
+            shader->set(alphaThresholdUniform, alphaThreshold);
             // Explicitly bind diffuse texture to unit 0
-            glActiveTexture(GL_TEXTURE0);
             if (texture)
             {
-                texture->bind();
+                texture->bind(0);
             }
             if (sampler)
             {
                 sampler->bind(0);
             }
             // Bind to texture unit 0
-            shader->set("tex", 0);
+            shader->set(textureUniform, 0);
         }
     }
 
+    void TexturedMaterial::resolveUniforms() const
+    {
+        TintedMaterial::resolveUniforms();
+        alphaThresholdUniform = shader->getUniform<GLfloat>("alphaThreshold");
+        textureUniform = shader->getUniform<GLint>("tex");
+    }
+
     // This function read the material data from a json object
     void TexturedMaterial::deserialize(const nlohmann::json &data)
     {
@@ -95,61 +128,79 @@ namespace our
         TexturedMaterial::setup();
         if (shader)
         {
-            shader->set("ambient_color", ambient);
-            shader->set("diffuse_color", diffuse);
-            shader->set("specular_color", specular);
-            shader->set("shininess", shininess);
-            shader->set("illuminationModel", illuminationModel);
+            shader->set(ambientUniform, ambient);
+            shader->set(diffuseUniform, diffuse);
+            shader->set(specularUniform, specular);
+            shader->set(shininessUniform, shininess);
+            shader->set(illuminationModelUniform, illuminationModel);
             // Send texture scale to shader (use xy for 2D textures)
-            shader->set("textureScale", glm::vec2(diffuseTextureScale.x, diffuseTextureScale.y));
+            shader->set(textureScaleUniform, glm::vec2(diffuseTextureScale.x, diffuseTextureScale.y));
             
             // Normal mapping (texture unit 1)
-            shader->set("hasNormalMap", hasNormalMap);
+            shader->set(hasNormalMapUniform, hasNormalMap);
             if (hasNormalMap && normalMap) {
-                glActiveTexture(GL_TEXTURE1);
-                normalMap->bind();
-                shader->set("normalMap", 1);
-                shader->set("normalTextureScale", glm::vec2(normalTextureScale.x, normalTextureScale.y));
-                shader->set("bumpMultiplier", bumpMultiplier);
+                normalMap->bind(1);
+                shader->set(normalMapUniform, 1);
+                shader->set(normalTextureScaleUniform, glm::vec2(normalTextureScale.x, normalTextureScale.y));
+                shader->set(bumpMultiplierUniform, bumpMultiplier);
             }
             
             // Specular map (texture unit 2)
-            shader->set("hasSpecularMap", hasSpecularMap);
+            shader->set(hasSpecularMapUniform, hasSpecularMap);
             if (hasSpecularMap && specularMap) {
-                glActiveTexture(GL_TEXTURE2);
-                specularMap->bind();
-                shader->set("specularMap", 2);
+                specularMap->bind(2);
+                shader->set(specularMapUniform, 2);
             }
             
             // Roughness map (texture unit 3)
-            shader->set("hasRoughnessMap", hasRoughnessMap);
+            shader->set(hasRoughnessMapUniform, hasRoughnessMap);
             if (hasRoughnessMap && roughnessMap) {
-                glActiveTexture(GL_TEXTURE3);
-                roughnessMap->bind();
-                shader->set("roughnessMap", 3);
+                roughnessMap->bind(3);
+                shader->set(roughnessMapUniform, 3);
             }
             
             // Ambient occlusion map (texture unit 4)
-            shader->set("hasAoMap", hasAoMap);
+            shader->set(hasAoMapUniform, hasAoMap);
             if (hasAoMap && aoMap) {
-                glActiveTexture(GL_TEXTURE4);
-                aoMap->bind();
-                shader->set("aoMap", 4);
+                aoMap->bind(4);
+                shader->set(aoMapUniform, 4);
             }
             
             // Emissive map (texture unit 5)
-            shader->set("hasEmissiveMap", hasEmissiveMap);
+            shader->set(hasEmissiveMapUniform, hasEmissiveMap);
             if (hasEmissiveMap && emissiveMap) {
-                glActiveTexture(GL_TEXTURE5);
-                emissiveMap->bind();
-                shader->set("emissiveMap", 5);
+                emissiveMap->bind(5);
+                shader->set(emissiveMapUniform, 5);
             }
             
             // Restore active texture unit to 0 for other operations
-            glActiveTexture(GL_TEXTURE0);
+            gl_state::activeTexture(0);
         }
     }
 
+    void LitMaterial::resolveUniforms() const
+    {
+        TexturedMaterial::resolveUniforms();
+        ambientUniform = shader->getUniform<glm::vec3>("ambient_color");
+        diffuseUniform = shader->getUniform<glm::vec3>("diffuse_color");
+        specularUniform = shader->getUniform<glm::vec3>("specular_color");
+        shininessUniform = shader->getUniform<GLfloat>("shininess");
+        illuminationModelUniform = shader->getUniform<GLint>("illuminationModel");
+        textureScaleUniform = shader->getUniform<glm::vec2>("textureScale");
+        hasNormalMapUniform = shader->getUniform<bool>("hasNormalMap");
+        normalMapUniform = shader->getUniform<GLint>("normalMap");
+        normalTextureScaleUniform = shader->getUniform<glm::vec2>("normalTextureScale");
+        bumpMultiplierUniform = shader->getUniform<GLfloat>("bumpMultiplier");
+        hasSpecularMapUniform = shader->getUniform<bool>("hasSpecularMap");
+        specularMapUniform = shader->getUniform<GLint>("specularMap");
+        hasRoughnessMapUniform = shader->getUniform<bool>("hasRoughnessMap");
+        roughnessMapUniform = shader->getUniform<GLint>("roughnessMap");
+        hasAoMapUniform = shader->getUniform<bool>("hasAoMap");
+        aoMapUniform = shader->getUniform<GLint>("aoMap");
+        hasEmissiveMapUniform = shader->getUniform<bool>("hasEmissiveMap");
+        emissiveMapUniform = shader->getUniform<GLint>("emissiveMap");
+    }
+
     // This function reads the lit material data from a json object
     // Priority for texture maps: 1. JSON values (highest), 2. MTL file values, 3. No texture (use uniforms)
     // Priority for color values: 1. MTL file values (highest), 2. JSON values, 3. Class defaults
@@ -286,6 +337,27 @@ namespace our
             hasEmissiveMap = (emissiveMap != nullptr);
             if (our::g_debugMode) std::cout << "Emissive map loaded: " << (hasEmissiveMap ? "yes" : "no") << std::endl;
         }
+
+        // The permutation is requested now so that it compiles while the rest of the scene loads
+        if (shader)
+        {
+            shader = ShaderCache::getVariant(shader, getVariantDefines());
+        }
+    }
+
+    std::vector<std::string> LitMaterial::getVariantDefines() const
+    {
+        auto feature = [](const char *name, bool enabled) { return std::string(name) + (enabled ? " true" : " false"); };
+        std::vector<std::string> defines = {
+            feature("HAS_NORMAL_MAP", hasNormalMap && normalMap),
+            feature("HAS_SPECULAR_MAP", hasSpecularMap && specularMap),
+            feature("HAS_ROUGHNESS_MAP", hasRoughnessMap && roughnessMap),
+            feature("HAS_AO_MAP", hasAoMap && aoMap),
+            feature("HAS_EMISSIVE_MAP", hasEmissiveMap && emissiveMap),
+        };
+        const auto &features = ShaderCache::getFeatureDefines();
+        defines.insert(defines.end(), features.begin(), features.end());
+        return defines;
     }
 
 }
@@ -25,10 +25,33 @@ namespace our
         bool transparent;
         std::string materialName; // Name from JSON key for MTL lookup
 
+        // The per object matrices set by the renderers ("transform", "M", "M_IT" and "VP").
+        // They are resolved from the shader by "setup" and are invalid if the shader doesn't use them.
+        mutable UniformHandle<glm::mat4> transformUniform, modelUniform, modelInverseTransposeUniform, viewProjectionUniform;
+        // The index of the first instance of an instanced draw ("instance_offset"), since GL 3.3 has no base instance,
+        // and whether the instances use the compact format ("compact_instances", see "InstanceFormat")
+        mutable UniformHandle<GLint> instanceOffsetUniform;
+        mutable UniformHandle<bool> compactInstancesUniform;
+        // The lights picked for the object when the renderer assigns the lights per object ("object_light_count" and
+        // "object_lights", see "LightClusters::selectLights")
+        mutable UniformHandle<GLint> objectLightCountUniform;
+        mutable UniformHandle<glm::ivec4> objectLightsUniform[2];
+
         // This function does 2 things: setup the pipeline state and set the shader program to be used
         virtual void setup() const;
         // This function read a material from a json object
         virtual void deserialize(const nlohmann::json &data);
+
+        // The materials are deleted through "Material*" (e.g. by the asset loader), so the destructor must be virtual
+        virtual ~Material() = default;
+
+    protected:
+        // This function resolves the uniform handles of the material from its shader.
+        // Materials that send uniforms should override it (and call the parent's version) to resolve their own handles.
+        virtual void resolveUniforms() const;
+
+    private:
+        mutable const ShaderProgram *resolvedShader = nullptr; // The shader from which the handles were resolved
     };
 
     // This material adds a uniform for a tint (a color that will be sent to the shader)
@@ -40,6 +63,11 @@ namespace our
 
         void setup() const override;
         void deserialize(const nlohmann::json &data) override;
+
+    protected:
+        mutable UniformHandle<glm::vec4> tintUniform;
+
+        void resolveUniforms() const override;
     };
 
     // This material adds two uniforms (besides the tint from Tinted Material)
@@ -56,6 +84,12 @@ namespace our
 
         void setup() const override;
         void deserialize(const nlohmann::json &data) override;
+
+    protected:
+        mutable UniformHandle<GLfloat> alphaThresholdUniform;
+        mutable UniformHandle<GLint> textureUniform;
+
+        void resolveUniforms() const override;
     };
 
     // This material extends TexturedMaterial with Blinn-Phong lighting properties
@@ -91,7 +125,21 @@ namespace our
         bool hasEmissiveMap = false;
 
         void setup() const override;
+        // After reading the material, this also swaps its shader for the permutation that fits it (see "getVariantDefines")
         void deserialize(const nlohmann::json &data) override;
+        // Returns the defines of the permutation of the lit shaders that fits this material: which maps it has and the
+        // features of the renderer (see "ShaderCache::getFeatureDefines")
+        std::vector<std::string> getVariantDefines() const;
+
+    protected:
+        mutable UniformHandle<glm::vec3> ambientUniform, diffuseUniform, specularUniform;
+        mutable UniformHandle<GLfloat> shininessUniform, bumpMultiplierUniform;
+        mutable UniformHandle<GLint> illuminationModelUniform;
+        mutable UniformHandle<glm::vec2> textureScaleUniform, normalTextureScaleUniform;
+        mutable UniformHandle<bool> hasNormalMapUniform, hasSpecularMapUniform, hasRoughnessMapUniform, hasAoMapUniform, hasEmissiveMapUniform;
+        mutable UniformHandle<GLint> normalMapUniform, specularMapUniform, roughnessMapUniform, aoMapUniform, emissiveMapUniform;
+
+        void resolveUniforms() const override;
     };
 
     // This function returns a new material instance based on the given type
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/gl.h>
+#include "../gl-state.hpp"
 #include <glm/vec4.hpp>
 #include <json/json.hpp>
 
@@ -39,38 +40,33 @@ namespace our {
 
 
         // This function should set the OpenGL options to the values specified by this structure
+        // (only the options that differ from the current OpenGL state are actually sent, see "gl-state.hpp")
         void setup() const {
 
             // Check face culling
+            gl_state::setEnabled(GL_CULL_FACE, faceCulling.enabled);
             if (faceCulling.enabled) {
-                glEnable(GL_CULL_FACE);
-                glCullFace(faceCulling.culledFace);
-                glFrontFace(faceCulling.frontFace);
-            } else {
-                glDisable(GL_CULL_FACE);
+                gl_state::cullFace(faceCulling.culledFace);
+                gl_state::frontFace(faceCulling.frontFace);
             }
 
             // Check depth testing
+            gl_state::setEnabled(GL_DEPTH_TEST, depthTesting.enabled);
             if (depthTesting.enabled) {
-                glEnable(GL_DEPTH_TEST);
-                glDepthFunc(depthTesting.function);
-            } else {
-                glDisable(GL_DEPTH_TEST);
+                gl_state::depthFunc(depthTesting.function);
             }
 
             // Check blending
+            gl_state::setEnabled(GL_BLEND, blending.enabled);
             if (blending.enabled) {
-                glEnable(GL_BLEND);
-                glBlendEquation(blending.equation);
-                glBlendFunc(blending.sourceFactor, blending.destinationFactor);
-                glBlendColor(blending.constantColor.r, blending.constantColor.g, blending.constantColor.b, blending.constantColor.a);
-            } else {
-                glDisable(GL_BLEND);
+                gl_state::blendEquation(blending.equation);
+                gl_state::blendFunc(blending.sourceFactor, blending.destinationFactor);
+                gl_state::blendColor(blending.constantColor.r, blending.constantColor.g, blending.constantColor.b, blending.constantColor.a);
             }
 
             // Set color and depth masks
-            glColorMask(colorMask.r, colorMask.g, colorMask.b, colorMask.a);
-            glDepthMask(depthMask);
+            gl_state::colorMask(colorMask.r, colorMask.g, colorMask.b, colorMask.a);
+            gl_state::depthMask(depthMask);
         }
 
         // Given a json object, this function deserializes a PipelineState structure
@@ -0,0 +1,282 @@
+#include "mesh-utils.hpp"
+#include "../debug-utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+    // The error quadric of a vertex (Garland & Heckbert): the sum of the squared distances to a set of planes, stored
+    // as the 10 unique coefficients of the symmetric 4x4 matrix. Doubles are used since the sums lose precision quickly.
+    struct Quadric {
+        double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+
+        Quadric() = default;
+        // The quadric of the plane "dot(normal, p) + d = 0" (normal must be normalized) scaled by "weight"
+        Quadric(const glm::dvec3& n, double d, double weight)
+            : xx(weight * n.x * n.x), xy(weight * n.x * n.y), xz(weight * n.x * n.z), xw(weight * n.x * d),
+              yy(weight * n.y * n.y), yz(weight * n.y * n.z), yw(weight * n.y * d),
+              zz(weight * n.z * n.z), zw(weight * n.z * d), ww(weight * d * d) {}
+
+        Quadric& operator+=(const Quadric& q) {
+            xx += q.xx; xy += q.xy; xz += q.xz; xw += q.xw;
+            yy += q.yy; yz += q.yz; yw += q.yw;
+            zz += q.zz; zw += q.zw; ww += q.ww;
+            return *this;
+        }
+
+        // The weighted sum of the squared distances from "p" to the planes
+        double evaluate(const glm::dvec3& p) const {
+            return xx * p.x * p.x + 2 * xy * p.x * p.y + 2 * xz * p.x * p.z + 2 * xw * p.x
+                 + yy * p.y * p.y + 2 * yz * p.y * p.z + 2 * yw * p.y
+                 + zz * p.z * p.z + 2 * zw * p.z + ww;
+        }
+    };
+
+    // A candidate collapse of the vertex "from" onto the vertex "to". The versions are those of the vertices when the
+    // error was computed, so an entry whose vertices changed since then is skipped instead of being searched and removed.
+    struct Collapse {
+        double error;
+        std::uint32_t from, to;
+        std::uint32_t fromVersion, toVersion;
+        bool operator>(const Collapse& other) const { return error > other.error; }
+    };
+
+    // The edges along the border of the surface (or between two materials) get a plane perpendicular to their triangle
+    // with this weight, so they are kept in place and the outline of the mesh doesn't erode.
+    constexpr double BORDER_WEIGHT = 100.0;
+    // A collapse is rejected if it turns a triangle by more than this (the cosine of the angle between the old and new normal)
+    constexpr double MIN_NORMAL_COSINE = 0.25;
+
+}
+
+our::Mesh* our::mesh_utils::simplify(const Mesh* mesh, float ratio, bool keepCPUCopy) {
+    const std::vector<Vertex>& vertices = mesh->getVertices();
+    const std::vector<unsigned int>& elements = mesh->getIndices();
+    if (vertices.empty() || elements.empty() || ratio <= 0.0f || ratio >= 1.0f) return nullptr;
+
+    // A mesh without submeshes is handled as a single submesh that covers all of its elements
+    std::vector<Submesh> sourceSubmeshes = mesh->getSubmeshes();
+    if (sourceSubmeshes.empty()) {
+        Submesh whole;
+        whole.elementCount = (GLsizei)elements.size();
+        whole.elementOffset = 0;
+        sourceSubmeshes.push_back(whole);
+    }
+
+    // Weld the vertices that share a position (the loader splits them wherever the normals or the texture coordinates
+    // differ), so the collapses see a connected surface. The output vertices keep their own attributes.
+    std::vector<std::uint32_t> order(vertices.size());
+    std::iota(order.begin(), order.end(), 0u);
+    auto lessPosition = [&](std::uint32_t a, std::uint32_t b) {
+        const glm::vec3 &p = vertices[a].position, &q = vertices[b].position;
+        return p.x != q.x ? p.x < q.x : (p.y != q.y ? p.y < q.y : p.z < q.z);
+    };
+    std::sort(order.begin(), order.end(), lessPosition);
+    std::vector<std::uint32_t> weldedOf(vertices.size());
+    std::vector<glm::dvec3> positions;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (i == 0 || vertices[order[i]].position != vertices[order[i - 1]].position) {
+            positions.push_back(glm::dvec3(vertices[order[i]].position));
+        }
+        weldedOf[order[i]] = (std::uint32_t)positions.size() - 1;
+    }
+
+    // The triangles refer to the welded vertices, while "corners" keeps the source vertex of each corner for the output
+    struct Triangle {
+        std::uint32_t welded[3];
+        std::uint32_t corners[3];
+        std::uint32_t submesh;
+    };
+    std::vector<Triangle> triangles;
+    for (std::uint32_t s = 0; s < sourceSubmeshes.size(); s++) {
+        const Submesh& submesh = sourceSubmeshes[s];
+        for (size_t e = submesh.elementOffset; e + 3 <= (size_t)submesh.elementOffset + submesh.elementCount; e += 3) {
+            Triangle triangle;
+            for (int k = 0; k < 3; k++) {
+                triangle.corners[k] = elements[e + k] + submesh.baseVertex;
+                triangle.welded[k] = weldedOf[triangle.corners[k]];
+            }
+            // Triangles that are already degenerate would vanish at the first collapse anyway
+            if (triangle.welded[0] == triangle.welded[1] || triangle.welded[1] == triangle.welded[2] ||
+                triangle.welded[0] == triangle.welded[2]) continue;
+            triangle.submesh = s;
+            triangles.push_back(triangle);
+        }
+    }
+    if (triangles.empty()) return nullptr;
+
+    auto normalOf = [&](const std::uint32_t (&welded)[3]) {
+        return glm::cross(positions[welded[1]] - positions[welded[0]], positions[welded[2]] - positions[welded[0]]);
+    };
+
+    // Every vertex starts with the planes of its triangles (weighted by their areas)
+    std::vector<Quadric> quadrics(positions.size());
+    std::vector<std::vector<std::uint32_t>> trianglesOf(positions.size());
+    // The triangles around each edge: (low << 32 | high) -> (count, the first two triangles), to find the border edges
+    struct EdgeUse {
+        std::uint32_t count;
+        std::uint32_t triangle, other;
+    };
+    std::unordered_map<std::uint64_t, EdgeUse> edges;
+    auto edgeKey = [](std::uint32_t a, std::uint32_t b) {
+        return ((std::uint64_t)std::min(a, b) << 32) | std::max(a, b);
+    };
+    for (std::uint32_t t = 0; t < triangles.size(); t++) {
+        const Triangle& triangle = triangles[t];
+        glm::dvec3 normal = normalOf(triangle.welded);
+        double doubleArea = glm::length(normal);
+        if (doubleArea > 0.0) {
+            normal /= doubleArea;
+            Quadric plane(normal, -glm::dot(normal, positions[triangle.welded[0]]), doubleArea * 0.5);
+            for (std::uint32_t v : triangle.welded) quadrics[v] += plane;
+        }
+        for (int k = 0; k < 3; k++) {
+            trianglesOf[triangle.welded[k]].push_back(t);
+            auto [it, inserted] = edges.try_emplace(edgeKey(triangle.welded[k], triangle.welded[(k + 1) % 3]), EdgeUse{0, t, t});
+            if (++it->second.count == 2) it->second.other = t;
+        }
+    }
+    for (const auto& [key, use] : edges) {
+        // Besides the real borders, these edges are kept like borders:
+        // - The edges between two materials, so the submeshes stay closed where they meet.
+        // - The edges between two triangles facing opposite ways (e.g. the two sides of a leaf card), since their planes
+        //   cancel out and the whole card would otherwise collapse for free.
+        if (use.count == 2 && triangles[use.triangle].submesh == triangles[use.other].submesh &&
+            glm::dot(normalOf(triangles[use.triangle].welded), normalOf(triangles[use.other].welded)) >= 0.0) continue;
+        std::uint32_t a = (std::uint32_t)(key >> 32), b = (std::uint32_t)key;
+        glm::dvec3 normal = normalOf(triangles[use.triangle].welded);
+        glm::dvec3 edge = positions[b] - positions[a];
+        glm::dvec3 border = glm::cross(edge, normal);
+        double length = glm::length(border);
+        if (length <= 0.0) continue;
+        border /= length;
+        Quadric plane(border, -glm::dot(border, positions[a]), BORDER_WEIGHT * glm::dot(edge, edge));
+        quadrics[a] += plane;
+        quadrics[b] += plane;
+    }
+
+    // The collapses are taken from the cheapest up. The cheaper direction of each edge is the one that is queued.
+    std::vector<std::uint32_t> versions(positions.size(), 0);
+    std::vector<bool> removedVertex(positions.size(), false), removedTriangle(triangles.size(), false);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+    auto pushEdge = [&](std::uint32_t a, std::uint32_t b) {
+        Quadric sum = quadrics[a];
+        sum += quadrics[b];
+        double aToB = sum.evaluate(positions[b]), bToA = sum.evaluate(positions[a]);
+        if (aToB <= bToA) queue.push({aToB, a, b, versions[a], versions[b]});
+        else queue.push({bToA, b, a, versions[b], versions[a]});
+    };
+    for (const auto& [key, use] : edges) pushEdge((std::uint32_t)(key >> 32), (std::uint32_t)key);
+
+    // Every submesh keeps its share of the triangles, so a cheap material (e.g. the trunk) isn't eaten to keep an expensive one
+    // (e.g. the leaf cards whose borders are all kept)
+    std::vector<size_t> liveTriangles(sourceSubmeshes.size(), 0), targetTriangles(sourceSubmeshes.size(), 0);
+    for (const Triangle& triangle : triangles) liveTriangles[triangle.submesh]++;
+    size_t unfinishedSubmeshes = 0;
+    for (size_t s = 0; s < sourceSubmeshes.size(); s++) {
+        targetTriangles[s] = (size_t)std::ceil(liveTriangles[s] * (double)ratio);
+        if (liveTriangles[s] > targetTriangles[s]) unfinishedSubmeshes++;
+    }
+
+    // Returns false if moving "from" onto "to" would remove triangles from a submesh that already reached its target,
+    // or would flip (or fold) one of the triangles that remain around "from"
+    auto canCollapse = [&](std::uint32_t from, std::uint32_t to) {
+        for (std::uint32_t t : trianglesOf[from]) {
+            if (removedTriangle[t]) continue;
+            const Triangle& triangle = triangles[t];
+            if (triangle.welded[0] == to || triangle.welded[1] == to || triangle.welded[2] == to) {
+                if (liveTriangles[triangle.submesh] <= targetTriangles[triangle.submesh]) return false;
+                continue;
+            }
+            std::uint32_t moved[3] = {triangle.welded[0], triangle.welded[1], triangle.welded[2]};
+            for (std::uint32_t& v : moved) if (v == from) v = to;
+            glm::dvec3 before = normalOf(triangle.welded), after = normalOf(moved);
+            double lengths = glm::length(before) * glm::length(after);
+            if (lengths <= 0.0 || glm::dot(before, after) < MIN_NORMAL_COSINE * lengths) return false;
+        }
+        return true;
+    };
+
+    std::vector<std::uint32_t> neighbours;
+    while (unfinishedSubmeshes > 0 && !queue.empty()) {
+        Collapse collapse = queue.top();
+        queue.pop();
+        std::uint32_t from = collapse.from, to = collapse.to;
+        if (removedVertex[from] || removedVertex[to] || versions[from] != collapse.fromVersion ||
+            versions[to] != collapse.toVersion) continue;
+        if (!canCollapse(from, to)) continue;
+
+        // The triangles on the edge disappear, the others around "from" now use "to"
+        removedVertex[from] = true;
+        quadrics[to] += quadrics[from];
+        for (std::uint32_t t : trianglesOf[from]) {
+            if (removedTriangle[t]) continue;
+            Triangle& triangle = triangles[t];
+            if (triangle.welded[0] == to || triangle.welded[1] == to || triangle.welded[2] == to) {
+                removedTriangle[t] = true;
+                if (liveTriangles[triangle.submesh]-- == targetTriangles[triangle.submesh] + 1) unfinishedSubmeshes--;
+                continue;
+            }
+            for (std::uint32_t& v : triangle.welded) if (v == from) v = to;
+            trianglesOf[to].push_back(t);
+        }
+        trianglesOf[from].clear();
+        std::vector<std::uint32_t>& around = trianglesOf[to];
+        around.erase(std::remove_if(around.begin(), around.end(), [&](std::uint32_t t) { return removedTriangle[t]; }),
+                     around.end());
+
+        // The queued edges of "to" are now stale (its version changed), so they are queued again with the new quadric
+        versions[to]++;
+        neighbours.clear();
+        for (std::uint32_t t : around) {
+            for (std::uint32_t v : triangles[t].welded) if (v != to) neighbours.push_back(v);
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (std::uint32_t v : neighbours) pushEdge(to, v);
+    }
+
+    // Each corner keeps the attributes of its source vertex but takes the position of the vertex it was collapsed onto
+    std::vector<Vertex> simplifiedVertices;
+    std::vector<unsigned int> simplifiedElements;
+    std::vector<Submesh> submeshes;
+    std::unordered_map<std::uint64_t, unsigned int> remap; // (source vertex << 32 | welded vertex) -> output vertex
+    for (std::uint32_t s = 0; s < sourceSubmeshes.size(); s++) {
+        Submesh submesh;
+        submesh.materialName = sourceSubmeshes[s].materialName;
+        submesh.elementOffset = (GLsizei)simplifiedElements.size();
+        for (std::uint32_t t = 0; t < triangles.size(); t++) {
+            const Triangle& triangle = triangles[t];
+            if (removedTriangle[t] || triangle.submesh != s) continue;
+            for (int k = 0; k < 3; k++) {
+                std::uint64_t key = ((std::uint64_t)triangle.corners[k] << 32) | triangle.welded[k];
+                auto [it, inserted] = remap.try_emplace(key, (unsigned int)simplifiedVertices.size());
+                if (inserted) {
+                    Vertex vertex = vertices[triangle.corners[k]];
+                    vertex.position = glm::vec3(positions[triangle.welded[k]]);
+                    simplifiedVertices.push_back(vertex);
+                }
+                // The vertices are shared between the submeshes, so the bounds grow with every corner (not only the new vertices)
+                const glm::vec3& position = simplifiedVertices[it->second].position;
+                submesh.minBound = glm::min(submesh.minBound, position);
+                submesh.maxBound = glm::max(submesh.maxBound, position);
+                simplifiedElements.push_back(it->second);
+            }
+        }
+        submesh.elementCount = (GLsizei)simplifiedElements.size() - submesh.elementOffset;
+        submeshes.push_back(submesh);
+    }
+    if (simplifiedElements.empty()) return nullptr;
+
+    Mesh* simplified = new Mesh(simplifiedVertices, simplifiedElements, keepCPUCopy);
+    if (!mesh->getSubmeshes().empty()) simplified->setSubmeshes(submeshes);
+    if (our::g_debugMode) std::cout << "Simplified a mesh from " << triangles.size() << " to "
+                                    << simplifiedElements.size() / 3 << " triangles" << std::endl;
+    return simplified;
+}
@@ -497,6 +497,16 @@ our::Mesh* our::mesh_utils::loadOBJWithMaterials(const std::string& filename,boo
     // Compute tangent vectors for normal mapping
     computeTangents(vertices, elements);
 
+    // The bounds of each submesh allow the renderer to cull the submeshes separately
+    for (auto &submesh : submeshes)
+    {
+        for (GLsizei i = submesh.elementOffset; i < submesh.elementOffset + submesh.elementCount; i++)
+        {
+            submesh.minBound = glm::min(submesh.minBound, vertices[elements[i]].position);
+            submesh.maxBound = glm::max(submesh.maxBound, vertices[elements[i]].position);
+        }
+    }
+
     auto mesh = new our::Mesh(vertices, elements,keepCPUCopy);
     mesh->setSubmeshes(submeshes);
     return mesh;
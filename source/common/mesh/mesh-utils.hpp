@@ -13,4 +13,9 @@ namespace our::mesh_utils {
     // Create a sphere (the vertex order in the triangles are CCW from the outside)
     // Segments define the number of divisions on the both the latitude and the longitude
     Mesh* sphere(const glm::ivec2& segments);
+
+    // Creates a simplified copy of a mesh (which must have been loaded with keepCPUCopy) with about "ratio" of its triangles,
+    // by collapsing the edges whose quadric error is the lowest. The submeshes (and their material names) are kept.
+    // Returns null if the mesh has no CPU copy or if the ratio doesn't remove anything.
+    Mesh* simplify(const Mesh* mesh, float ratio, bool keepCPUCopy = false);
 }
\ No newline at end of file
@@ -2,10 +2,13 @@
 
 #include <glad/gl.h>
 
+#include <cfloat>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 #include "vertex.hpp"
+#include "../gl-state.hpp"
 
 namespace our {
 
@@ -19,7 +22,12 @@ namespace our {
 struct Submesh {
     std::string materialName;  // Name of the material used by this submesh
     GLsizei elementCount;      // Number of elements in this submesh
-    GLsizei elementOffset;     // Offset in the element buffer (in bytes)
+    GLsizei elementOffset;     // Offset in the element buffer (in elements)
+    GLint baseVertex = 0;      // Added to every element of this submesh (so its elements can index its own part of the vertex buffer)
+    // The bounds of the submesh's vertices in the local space. If they are left empty (min > max), "Mesh::setSubmeshes"
+    // replaces them with the bounds of the whole mesh.
+    glm::vec3 minBound = glm::vec3(FLT_MAX);
+    glm::vec3 maxBound = glm::vec3(-FLT_MAX);
 };
 
 class Mesh {
@@ -29,10 +37,6 @@ class Mesh {
     std::vector<unsigned int> elements;
     unsigned int VBO, EBO;
     unsigned int VAO;
-    unsigned int instanceVBO = 0;     // Buffer for the instances only.
-    size_t currentInstanceCount = 0;  // Track current instance buffer size
-    bool instanceBufferInitialized =
-        false;  // Track if buffer is already set up
     // We need to remember the number of elements that will be draw by
     // glDrawElements
     GLsizei elementCount;
@@ -70,7 +74,7 @@ class Mesh {
         }
         // Generate and bind VAO
         glGenVertexArrays(1, &VAO);
-        glBindVertexArray(VAO);
+        gl_state::bindVertexArray(VAO);
 
         // Generate and bind VBO
         glGenBuffers(1, &VBO);
@@ -113,92 +117,14 @@ class Mesh {
                               sizeof(Vertex), (void*)offsetof(Vertex, tangent));
 
         // Unbind VAO to prevent accidental modification
-        glBindVertexArray(0);
+        gl_state::bindVertexArray(0);
     }
 
     // this function should render the mesh
     void draw() {
-        // Bind the VAO and draw the elements
-        glBindVertexArray(VAO);
+        // Bind the VAO and draw the elements (the VAO stays bound since the next draw will bind its own VAO anyway)
+        gl_state::bindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-    }
-
-    void setupInstancing(const std::vector<glm::mat4>& instanceMats) {
-        // instance mats are the position rotation and scale of each instance
-        // but in a mat format so we only do 1 draw call for the big amount of
-        // objs, here used for the trees which will be created using a greyscale
-        // image made on the map texture.
-
-        // Skip if already initialized with the same data (static instances)
-        if (instanceBufferInitialized &&
-            currentInstanceCount == instanceMats.size()) {
-            return;  // Buffer already set up, no need to re-upload
-        }
-
-        if (instanceVBO == 0) {
-            glGenBuffers(1, &instanceVBO);
-        }
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-
-        // Use GL_STATIC_DRAW for data that won't change
-        glBufferData(GL_ARRAY_BUFFER, instanceMats.size() * sizeof(glm::mat4),
-                     instanceMats.data(), GL_STATIC_DRAW);
-
-        // Only set up vertex attributes if not already done
-        if (!instanceBufferInitialized) {
-            for (int i = 0; i < 4; i++) {
-                glEnableVertexAttribArray(5 + i);
-                glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE,
-                                      sizeof(glm::mat4),
-                                      (void*)(sizeof(glm::vec4) * i));
-                glVertexAttribDivisor(5 + i, 1);
-            }
-        }
-
-        currentInstanceCount = instanceMats.size();
-        instanceBufferInitialized = true;
-        glBindVertexArray(0);
-    }
-
-    // Update instance buffer with culled instances (dynamic, uses
-    // GL_DYNAMIC_DRAW)
-    void updateInstanceBuffer(const std::vector<glm::mat4>& instanceMats) {
-        if (instanceMats.empty()) return;
-
-        if (instanceVBO == 0) {
-            glGenBuffers(1, &instanceVBO);
-        }
-
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-
-        // Reallocate if size changed, otherwise just update data
-        if (currentInstanceCount != instanceMats.size()) {
-            glBufferData(GL_ARRAY_BUFFER,
-                         instanceMats.size() * sizeof(glm::mat4),
-                         instanceMats.data(), GL_DYNAMIC_DRAW);
-            currentInstanceCount = instanceMats.size();
-        } else {
-            glBufferSubData(GL_ARRAY_BUFFER, 0,
-                            instanceMats.size() * sizeof(glm::mat4),
-                            instanceMats.data());
-        }
-
-        // Set up vertex attributes if not already done
-        if (!instanceBufferInitialized) {
-            for (int i = 0; i < 4; i++) {
-                glEnableVertexAttribArray(5 + i);
-                glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE,
-                                      sizeof(glm::mat4),
-                                      (void*)(sizeof(glm::vec4) * i));
-                glVertexAttribDivisor(5 + i, 1);
-            }
-            instanceBufferInitialized = true;
-        }
-
-        glBindVertexArray(0);
     }
 
     // this function should delete the vertex & element buffers and the vertex
@@ -207,9 +133,7 @@ class Mesh {
         // Delete the vertex buffer, element buffer, and vertex array object
         glDeleteBuffers(1, &VBO);
         glDeleteBuffers(1, &EBO);
-        if (instanceVBO != 0) {
-            glDeleteBuffers(1, &instanceVBO);
-        }
+        gl_state::forgetVertexArray(VAO);
         glDeleteVertexArrays(1, &VAO);
     }
 
@@ -218,21 +142,17 @@ class Mesh {
         if (submeshIndex >= submeshes.size()) return;
 
         // Bind the VAO before drawing
-        glBindVertexArray(VAO);
+        gl_state::bindVertexArray(VAO);
 
         const auto& submesh = submeshes[submeshIndex];
-        glDrawElements(GL_TRIANGLES, submesh.elementCount, GL_UNSIGNED_INT,
-                       (void*)(submesh.elementOffset * sizeof(GLuint)));
-
-        // Unbind VAO after drawing
-        glBindVertexArray(0);
+        glDrawElementsBaseVertex(GL_TRIANGLES, submesh.elementCount, GL_UNSIGNED_INT,
+                                 (void*)(submesh.elementOffset * sizeof(GLuint)), submesh.baseVertex);
     }
 
     void drawInstanced(GLsizei instanceCount) {
-        glBindVertexArray(VAO);
+        gl_state::bindVertexArray(VAO);
         glDrawElementsInstanced(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, 0,
                                 instanceCount);
-        glBindVertexArray(0);
     }
 
     // Get the number of submeshes
@@ -244,12 +164,25 @@ class Mesh {
     // Get all submeshes
     const std::vector<Submesh>& getSubmeshes() const { return submeshes; }
 
-    // Get verts and indices of this mesh
-    const std::vector<Vertex> getVertices() const{ return vertices;}
-    const std::vector<unsigned int> getIndices() const{ return elements;}
+    // Get verts and indices of this mesh (only available if the mesh was created with keepCPUCopy)
+    const std::vector<Vertex>& getVertices() const{ return vertices;}
+    const std::vector<unsigned int>& getIndices() const{ return elements;}
+    bool hasCPUCopy() const { return !elements.empty(); }
     
     // Set submeshes (used when loading multi-material meshes)
-    void setSubmeshes(const std::vector<Submesh>& subs) { submeshes = subs; }
+    void setSubmeshes(const std::vector<Submesh>& subs) {
+        submeshes = subs;
+        for (auto& submesh : submeshes) {
+            if (submesh.minBound.x > submesh.maxBound.x) {
+                submesh.minBound = minBound;
+                submesh.maxBound = maxBound;
+            }
+        }
+    }
+
+    // Get the bounds of all the vertices in the local space
+    const glm::vec3& getMinBound() const { return minBound; }
+    const glm::vec3& getMaxBound() const { return maxBound; }
 
     // Get VAO for manual drawing
     unsigned int getVAO() const { return VAO; }
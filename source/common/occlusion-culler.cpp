@@ -0,0 +1,213 @@
+#include "occlusion-culler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// SSE2 is part of every x86-64 CPU, so it is used whenever the target supports it (AVX would need extra compiler flags)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OUR_OCCLUSION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace our {
+
+    void OcclusionCuller::setOccluders(std::vector<glm::vec3> newVertices, std::vector<std::uint32_t> newIndices) {
+        vertices = std::move(newVertices);
+        indices = std::move(newIndices);
+        rendered = false;
+    }
+
+    void OcclusionCuller::clear() {
+        vertices.clear();
+        indices.clear();
+        rendered = false;
+    }
+
+    void OcclusionCuller::render(const glm::mat4& VP) {
+        if (levels.empty()) {
+            int width = WIDTH, height = HEIGHT;
+            while (true) {
+                levels.push_back({width, height, std::vector<float>((size_t)width * height, 0.0f)});
+                if (width == 1 && height == 1) break;
+                width = (width + 1) / 2;
+                height = (height + 1) / 2;
+            }
+        }
+        std::fill(levels[0].depths.begin(), levels[0].depths.end(), 0.0f);
+        viewProjection = VP;
+        rendered = true;
+
+        clipVertices.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) clipVertices[i] = VP * glm::vec4(vertices[i], 1.0f);
+
+        for (size_t i = 0; i + 3 <= indices.size(); i += 3) {
+            const glm::vec4& a = clipVertices[indices[i]];
+            const glm::vec4& b = clipVertices[indices[i + 1]];
+            const glm::vec4& c = clipVertices[indices[i + 2]];
+            // Skip the triangles that are completely outside one of the side planes
+            if ((a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+                (a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w)) continue;
+
+            bool inFront[3] = {a.w >= NEAR_W, b.w >= NEAR_W, c.w >= NEAR_W};
+            int inFrontCount = inFront[0] + inFront[1] + inFront[2];
+            if (inFrontCount == 0) continue;
+            if (inFrontCount == 3) {
+                rasterize(a, b, c);
+                continue;
+            }
+            // Clip the triangle against the near plane (keeping the order of the vertices), then draw it as a fan
+            const glm::vec4* corners[3] = {&a, &b, &c};
+            glm::vec4 polygon[4];
+            int count = 0;
+            for (int k = 0; k < 3; k++) {
+                const glm::vec4& current = *corners[k];
+                const glm::vec4& next = *corners[(k + 1) % 3];
+                if (inFront[k]) polygon[count++] = current;
+                if (inFront[k] != inFront[(k + 1) % 3]) {
+                    float t = (NEAR_W - current.w) / (next.w - current.w);
+                    polygon[count++] = current + (next - current) * t;
+                }
+            }
+            for (int k = 1; k + 1 < count; k++) rasterize(polygon[0], polygon[k], polygon[k + 1]);
+        }
+        buildHierarchy();
+    }
+
+    void OcclusionCuller::rasterize(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+        // To the screen space (in pixels) with the depth as 1/w
+        auto toScreen = [](const glm::vec4& v) {
+            double inverseW = 1.0 / v.w;
+            return glm::dvec3((v.x * inverseW * 0.5 + 0.5) * WIDTH, (v.y * inverseW * 0.5 + 0.5) * HEIGHT, inverseW);
+        };
+        glm::dvec3 p0 = toScreen(a), p1 = toScreen(b), p2 = toScreen(c);
+        // The back faces (and the degenerate triangles) are skipped. The screen's y goes up like the NDC's, so the
+        // front faces are still counter clockwise.
+        double area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+        if (!(area > 0.0)) return;
+
+        int minX = std::max(0, (int)std::floor(std::min({p0.x, p1.x, p2.x})));
+        int maxX = std::min(WIDTH - 1, (int)std::floor(std::max({p0.x, p1.x, p2.x})));
+        int minY = std::max(0, (int)std::floor(std::min({p0.y, p1.y, p2.y})));
+        int maxY = std::min(HEIGHT - 1, (int)std::floor(std::max({p0.y, p1.y, p2.y})));
+        if (minX > maxX || minY > maxY) return;
+
+        // Each edge function "A x + B y + C" is positive on the inner side of its edge. The edge facing a vertex is
+        // also that vertex's barycentric weight (times the area), so the depth is a plane "Dx x + Dy y + D0" too.
+        struct Edge {
+            double A, B, C;
+        };
+        auto makeEdge = [](const glm::dvec3& from, const glm::dvec3& to) {
+            return Edge{-(to.y - from.y), to.x - from.x, (to.y - from.y) * from.x - (to.x - from.x) * from.y};
+        };
+        Edge edges[3] = {makeEdge(p1, p2), makeEdge(p2, p0), makeEdge(p0, p1)};
+        double Dx = (p0.z * edges[0].A + p1.z * edges[1].A + p2.z * edges[2].A) / area;
+        double Dy = (p0.z * edges[0].B + p1.z * edges[1].B + p2.z * edges[2].B) / area;
+        double D0 = (p0.z * edges[0].C + p1.z * edges[1].C + p2.z * edges[2].C) / area;
+
+        std::vector<float>& depths = levels[0].depths;
+        // The rows start at a multiple of 4 so the 4 pixel blocks are aligned with the buffer
+        int startX = minX & ~3;
+        for (int y = minY; y <= maxY; y++) {
+            // The values at the first pixel's center of the row are computed in double (the coefficients can be large
+            // when a vertex is close to the near plane), then the row is stepped in float
+            double px = startX + 0.5, py = y + 0.5;
+            float rowEdge[3], stepEdge[3];
+            for (int k = 0; k < 3; k++) {
+                rowEdge[k] = (float)(edges[k].A * px + edges[k].B * py + edges[k].C);
+                stepEdge[k] = (float)edges[k].A;
+            }
+            float rowDepth = (float)(Dx * px + Dy * py + D0), stepDepth = (float)Dx;
+            float* row = depths.data() + (size_t)y * WIDTH;
+            int x = startX;
+#ifdef OUR_OCCLUSION_SSE2
+            const __m128 offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+            const __m128 zero = _mm_setzero_ps();
+            __m128 e0 = _mm_add_ps(_mm_set1_ps(rowEdge[0]), _mm_mul_ps(offsets, _mm_set1_ps(stepEdge[0])));
+            __m128 e1 = _mm_add_ps(_mm_set1_ps(rowEdge[1]), _mm_mul_ps(offsets, _mm_set1_ps(stepEdge[1])));
+            __m128 e2 = _mm_add_ps(_mm_set1_ps(rowEdge[2]), _mm_mul_ps(offsets, _mm_set1_ps(stepEdge[2])));
+            __m128 depth = _mm_add_ps(_mm_set1_ps(rowDepth), _mm_mul_ps(offsets, _mm_set1_ps(stepDepth)));
+            const __m128 step0 = _mm_set1_ps(4.0f * stepEdge[0]), step1 = _mm_set1_ps(4.0f * stepEdge[1]);
+            const __m128 step2 = _mm_set1_ps(4.0f * stepEdge[2]), stepD = _mm_set1_ps(4.0f * stepDepth);
+            for (; x <= maxX; x += 4) {
+                // The pixels inside the 3 edges keep the nearest depth (the largest 1/w)
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside)) {
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearest = _mm_max_ps(old, depth);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+                }
+                e0 = _mm_add_ps(e0, step0);
+                e1 = _mm_add_ps(e1, step1);
+                e2 = _mm_add_ps(e2, step2);
+                depth = _mm_add_ps(depth, stepD);
+            }
+#else
+            for (; x <= maxX; x++) {
+                float offset = (float)(x - startX);
+                float d = rowDepth + offset * stepDepth;
+                if (rowEdge[0] + offset * stepEdge[0] >= 0.0f && rowEdge[1] + offset * stepEdge[1] >= 0.0f &&
+                    rowEdge[2] + offset * stepEdge[2] >= 0.0f && d > row[x]) {
+                    row[x] = d;
+                }
+            }
+#endif
+        }
+    }
+
+    void OcclusionCuller::buildHierarchy() {
+        for (size_t l = 1; l < levels.size(); l++) {
+            const Level& below = levels[l - 1];
+            Level& level = levels[l];
+            for (int y = 0; y < level.height; y++) {
+                int y0 = 2 * y, y1 = std::min(2 * y + 1, below.height - 1);
+                for (int x = 0; x < level.width; x++) {
+                    int x0 = 2 * x, x1 = std::min(2 * x + 1, below.width - 1);
+                    // The farthest depth is the smallest 1/w
+                    level.depths[(size_t)y * level.width + x] = std::min(
+                        std::min(below.depths[(size_t)y0 * below.width + x0], below.depths[(size_t)y0 * below.width + x1]),
+                        std::min(below.depths[(size_t)y1 * below.width + x0], below.depths[(size_t)y1 * below.width + x1]));
+                }
+            }
+        }
+    }
+
+    bool OcclusionCuller::isBoxVisible(const glm::vec3& minBound, const glm::vec3& maxBound) const {
+        if (!rendered) return true;
+        glm::vec2 minScreen(INFINITY), maxScreen(-INFINITY);
+        // The nearest point of the box is one of its corners (w is linear), so its depth is the smallest corner w
+        float nearestW = INFINITY;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner((i & 1) ? maxBound.x : minBound.x, (i & 2) ? maxBound.y : minBound.y,
+                             (i & 4) ? maxBound.z : minBound.z);
+            glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+            if (clip.w < NEAR_W) return true;
+            glm::vec2 screen((clip.x / clip.w * 0.5f + 0.5f) * WIDTH, (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT);
+            minScreen = glm::min(minScreen, screen);
+            maxScreen = glm::max(maxScreen, screen);
+            nearestW = std::min(nearestW, clip.w);
+        }
+        int x0 = std::max(0, (int)std::floor(minScreen.x)), x1 = std::min(WIDTH - 1, (int)std::floor(maxScreen.x));
+        int y0 = std::max(0, (int)std::floor(minScreen.y)), y1 = std::min(HEIGHT - 1, (int)std::floor(maxScreen.y));
+        // The boxes outside the screen are left to the frustum culling
+        if (x0 > x1 || y0 > y1) return true;
+
+        // Pick the level at which the rectangle covers at most 2 texels along each axis (3 if it straddles a border)
+        size_t l = 0;
+        int size = std::max(x1 - x0, y1 - y0) + 1;
+        while (size > 2 && l + 1 < levels.size()) {
+            size = (size + 1) / 2;
+            l++;
+        }
+        const Level& level = levels[l];
+        float farthest = INFINITY;
+        for (int y = y0 >> l; y <= (y1 >> l); y++) {
+            for (int x = x0 >> l; x <= (x1 >> l); x++) {
+                farthest = std::min(farthest, level.depths[(size_t)y * level.width + x]);
+            }
+        }
+        // A texel without occluders can't hide anything
+        if (farthest <= 0.0f) return true;
+        return nearestW <= 1.0f / farthest + depthBias;
+    }
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace our {
+
+    // A software occlusion culler. The occluders (simplified triangles of large static objects) are rasterized on the CPU
+    // into a small depth buffer, which is then reduced into a hierarchy of levels where each texel holds the farthest
+    // depth of the texels below it (a hierarchical Z). A box is hidden if its nearest point is behind the farthest
+    // occluder depth over the whole screen rectangle that it covers, which only takes a few texels of the right level.
+    // It doesn't use OpenGL, so it runs (and can be checked) without a GPU.
+    // The depths are stored as 1/w (w being the clip space w, i.e. the distance along the view direction) since it can be
+    // interpolated linearly in the screen space. 0 means that no occluder covers the texel.
+    class OcclusionCuller {
+    public:
+        // The size of the depth buffer. The width must be a multiple of 4 since the rasterizer fills 4 pixels at a time.
+        static constexpr int WIDTH = 256, HEIGHT = 128;
+        // The occluders are clipped at this w, and the boxes that reach in front of it are always visible
+        static constexpr float NEAR_W = 0.05f;
+
+        // A box must be behind the occluders by more than this (in world units along the view direction) to be hidden.
+        // It hides the difference between the simplified occluders and the real objects.
+        float depthBias = 1.0f;
+
+        // Replaces the occluders with the given triangles (in the world space, 3 indices per triangle, front faces are CCW)
+        void setOccluders(std::vector<glm::vec3> vertices, std::vector<std::uint32_t> indices);
+        // Removes the occluders and forgets the last depth buffer (so every box is visible)
+        void clear();
+        bool hasOccluders() const { return !indices.empty(); }
+
+        // Rasterizes the occluders as seen through the given view projection matrix and rebuilds the hierarchy
+        void render(const glm::mat4& VP);
+        // Returns false if the box is certainly hidden behind the occluders of the last "render" (true if nothing was rendered)
+        bool isBoxVisible(const glm::vec3& minBound, const glm::vec3& maxBound) const;
+
+        // The depth (1/w) of a pixel of the full resolution buffer ((0, 0) is the bottom left corner)
+        float getDepth(int x, int y) const { return levels.empty() ? 0.0f : levels[0].depths[y * WIDTH + x]; }
+
+    private:
+        struct Level {
+            int width, height;
+            std::vector<float> depths;
+        };
+
+        std::vector<glm::vec3> vertices;
+        std::vector<std::uint32_t> indices;
+        std::vector<glm::vec4> clipVertices; // The vertices in the clip space (kept to avoid reallocating them every frame)
+        std::vector<Level> levels; // levels[0] is the depth buffer, each next level is half its size
+        glm::mat4 viewProjection = glm::mat4(1.0f);
+        bool rendered = false;
+
+        // Rasterizes a triangle whose vertices (in the clip space) are all in front of NEAR_W
+        void rasterize(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+        // Fills the levels above the depth buffer
+        void buildHierarchy();
+    };
+
+}
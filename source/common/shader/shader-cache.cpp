@@ -0,0 +1,190 @@
+#include "shader-cache.hpp"
+
+#include "../debug-utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace our {
+
+    namespace {
+        // The first bytes of a binary file, followed by the binary format and the binary itself
+        constexpr std::uint32_t BINARY_MAGIC = 0x4252474F; // "OGRB"
+
+        // FNV-1a, which (unlike std::hash) gives the same keys in every run
+        std::uint64_t hashBytes(std::uint64_t hash, const void* data, size_t size) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; i++) {
+                hash ^= bytes[i];
+                hash *= 0x100000001b3ULL;
+            }
+            return hash;
+        }
+        std::uint64_t hashString(std::uint64_t hash, const char* string) {
+            return string ? hashBytes(hash, string, std::char_traits<char>::length(string) + 1) : hash;
+        }
+    }
+
+    ShaderCache::Stats ShaderCache::stats;
+
+    void ShaderCache::initialize(const std::string& binaryDirectory) {
+        // The binaries only exist since GL 4.1, and a driver may support the extension without any binary format
+        GLint formatCount = 0;
+        if (GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        directory = formatCount > 0 ? binaryDirectory : std::string();
+        if (our::g_debugMode && !binaryDirectory.empty() && directory.empty()) {
+            std::cout << "The driver can't save program binaries, the shader cache is disabled" << std::endl;
+        }
+
+        driverKey = 0xcbf29ce484222325ULL;
+        driverKey = hashString(driverKey, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+        driverKey = hashString(driverKey, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+        driverKey = hashString(driverKey, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+
+        // Let the driver pick how many threads compile the shaders
+        if (GLAD_GL_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+            parallelCompile = true;
+        } else if (GLAD_GL_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+            parallelCompile = true;
+        }
+    }
+
+    ShaderProgram* ShaderCache::request(const std::string& vertexFile, const std::string& fragmentFile,
+                                        const std::vector<std::string>& defines) {
+        std::string key = vertexFile + '|' + fragmentFile;
+        for (const auto& define : defines) key += '|' + define;
+        if (auto it = programs.find(key); it != programs.end()) return it->second;
+
+        auto program = new ShaderProgram();
+        program->setDefines(defines);
+        program->attach(vertexFile, GL_VERTEX_SHADER);
+        program->attach(fragmentFile, GL_FRAGMENT_SHADER);
+        program->beginLink();
+        programs[key] = program;
+        pending.push_back(program);
+        return program;
+    }
+
+    ShaderProgram* ShaderCache::get(const std::string& vertexFile, const std::string& fragmentFile,
+                                    const std::vector<std::string>& defines) {
+        ShaderProgram* program = request(vertexFile, fragmentFile, defines);
+        if (program->isLinking()) program->finishLink();
+        return program;
+    }
+
+    ShaderProgram* ShaderCache::getVariant(ShaderProgram* base, const std::vector<std::string>& defines) {
+        const std::string& vertexFile = base->getStageFile(GL_VERTEX_SHADER);
+        const std::string& fragmentFile = base->getStageFile(GL_FRAGMENT_SHADER);
+        if (vertexFile.empty() || fragmentFile.empty()) return base;
+        std::vector<std::string> variantDefines = base->getDefines();
+        variantDefines.insert(variantDefines.end(), defines.begin(), defines.end());
+        return request(vertexFile, fragmentFile, variantDefines);
+    }
+
+    size_t ShaderCache::finishReady(double budget) {
+        auto start = std::chrono::steady_clock::now();
+        // Forget the programs that were already finished by their first use
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [](ShaderProgram* program) { return !program->isLinking(); }),
+                      pending.end());
+        int finished = 0;
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (finished > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= budget) break;
+            if ((*it)->isLinkReady()) {
+                (*it)->finishLink();
+                it = pending.erase(it);
+                finished++;
+            } else {
+                ++it;
+            }
+        }
+        return pending.size();
+    }
+
+    size_t ShaderCache::getPendingCount() {
+        return std::count_if(pending.begin(), pending.end(), [](ShaderProgram* program) { return program->isLinking(); });
+    }
+
+    void ShaderCache::clear() {
+        for (auto& [key, program] : programs) delete program;
+        programs.clear();
+        pending.clear();
+    }
+
+    std::uint64_t ShaderCache::getBinaryKey(const std::vector<std::pair<GLenum, std::string>>& sources) {
+        std::uint64_t key = driverKey;
+        for (const auto& [type, source] : sources) {
+            key = hashBytes(key, &type, sizeof(type));
+            key = hashString(key, source.c_str());
+        }
+        return key;
+    }
+
+    std::string ShaderCache::getBinaryPath(std::uint64_t key) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    bool ShaderCache::loadBinary(std::uint64_t key, GLuint program) {
+        if (!isBinaryCacheEnabled()) return false;
+        std::string path = getBinaryPath(key);
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        std::uint32_t magic = 0;
+        GLenum format = 0;
+        file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        file.read(reinterpret_cast<char*>(&format), sizeof(format));
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        file.close();
+
+        GLint status = GL_FALSE;
+        if (magic == BINARY_MAGIC && !binary.empty()) {
+            glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+            glGetProgramiv(program, GL_LINK_STATUS, &status);
+        }
+        // The driver rejects the binaries of its older versions (and the file may be truncated), so the program is
+        // compiled again and the file is replaced by the new binary
+        if (status != GL_TRUE) {
+            if (our::g_debugMode) std::cout << "Discarding the stale shader binary: " << path << std::endl;
+            std::error_code error;
+            std::filesystem::remove(path, error);
+            return false;
+        }
+        return true;
+    }
+
+    void ShaderCache::saveBinary(std::uint64_t key, GLuint program) {
+        if (!isBinaryCacheEnabled()) return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        std::ofstream file(getBinaryPath(key), std::ios::binary);
+        if (!file) {
+            std::cerr << "ERROR: Couldn't write to the shader cache: " << directory << std::endl;
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&BINARY_MAGIC), sizeof(BINARY_MAGIC));
+        file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        file.write(binary.data(), length);
+    }
+
+    void ShaderCache::recordLink(bool fromBinary, bool success, double seconds) {
+        if (!success) stats.failed++;
+        else if (fromBinary) stats.loaded++;
+        else stats.compiled++;
+        stats.seconds += seconds;
+    }
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "shader.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace our {
+
+    // This static class keeps the shader programs that are shared between the states and the systems. They are keyed by
+    // their files and their defines, so every program (and every permutation of it) is only compiled once per run.
+    // It also keeps the compiled programs on the disk ("glGetProgramBinary"), so the next runs can load them instead of
+    // compiling them, and it lets the loading screen finish the programs that the driver compiles in the background
+    // ("KHR_parallel_shader_compile") without waiting for them.
+    class ShaderCache {
+    public:
+        // What the programs linked since the last "resetStats" cost
+        struct Stats {
+            int compiled = 0; // The programs compiled from their sources
+            int loaded = 0; // The programs loaded from the binary cache
+            int failed = 0;
+            double seconds = 0.0; // The time spent in the link calls on the main thread
+        };
+
+        // Sets the directory of the binary cache (an empty directory disables it) and lets the driver compile on as many
+        // threads as it wants. It must be called after the OpenGL functions are loaded.
+        static void initialize(const std::string& binaryDirectory);
+
+        // These functions return the shared program made of the given files and defines, and start linking it if it is new.
+        // "request" doesn't wait for the driver (the program is finished when it is first used or by "finishReady"),
+        // while "get" returns a linked program.
+        // WARNING: never delete the returned program, they are all deleted by "clear".
+        static ShaderProgram* request(const std::string& vertexFile, const std::string& fragmentFile,
+                                      const std::vector<std::string>& defines = {});
+        static ShaderProgram* get(const std::string& vertexFile, const std::string& fragmentFile,
+                                  const std::vector<std::string>& defines = {});
+        // Returns the permutation of "base" with the given defines added to its own (it is requested if it is new).
+        // A program without a vertex and a fragment file is returned as is.
+        static ShaderProgram* getVariant(ShaderProgram* base, const std::vector<std::string>& defines);
+
+        // Finishes the requested programs that the driver is done with until "budget" seconds have passed
+        // (at least one is finished if any is ready). Returns the number of programs that are still being linked.
+        static size_t finishReady(double budget);
+        static size_t getPendingCount();
+
+        // The defines of the features that the renderer fixes for the whole session (see "ForwardRenderer::getShaderFeatures").
+        // The lit materials add them to their permutation.
+        static void setFeatureDefines(std::vector<std::string> defines) { featureDefines = std::move(defines); }
+        static const std::vector<std::string>& getFeatureDefines() { return featureDefines; }
+
+        static const Stats& getStats() { return stats; }
+        static void resetStats() { stats = Stats(); }
+
+        // Deletes all the shared programs
+        static void clear();
+
+        // These are used by "ShaderProgram" while linking
+        static bool hasParallelCompile() { return parallelCompile; }
+        static bool isBinaryCacheEnabled() { return !directory.empty(); }
+        // The key of a program in the binary cache. It covers the final sources and the driver, so a binary is never
+        // loaded by another version of the shaders or of the driver.
+        static std::uint64_t getBinaryKey(const std::vector<std::pair<GLenum, std::string>>& sources);
+        // Loads the binary of a program. It returns false (and removes the file if it was rejected) if the program
+        // has to be compiled.
+        static bool loadBinary(std::uint64_t key, GLuint program);
+        static void saveBinary(std::uint64_t key, GLuint program);
+        static void recordLink(bool fromBinary, bool success, double seconds);
+
+    private:
+        static inline std::unordered_map<std::string, ShaderProgram*> programs;
+        static inline std::vector<ShaderProgram*> pending; // The requested programs that may still be linking
+        static inline std::vector<std::string> featureDefines;
+        static inline std::string directory;
+        static inline std::uint64_t driverKey = 0; // The hash of the driver's vendor, renderer and version
+        static inline bool parallelCompile = false;
+        static Stats stats;
+
+        static std::string getBinaryPath(std::uint64_t key);
+    };
+
+}
@@ -1,15 +1,19 @@
 #include "shader.hpp"
+#include "shader-cache.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <utility>
 
 //Forward definition for error checking functions
 std::string checkForShaderCompilationErrors(GLuint shader);
 std::string checkForLinkingErrors(GLuint program);
 
-bool our::ShaderProgram::attach(const std::string &filename, GLenum type) const {
+bool our::ShaderProgram::attach(const std::string &filename, GLenum type) {
     // Here, we open the file and read a string from it containing the GLSL code of our shader
     std::ifstream file(filename);
     if(!file){
@@ -17,36 +21,177 @@ bool our::ShaderProgram::attach(const std::string &filename, GLenum type) const
         return false;
     }
     std::string sourceString = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
-    const char* sourceCStr = sourceString.c_str();
     file.close();
+    // The source is compiled along with the other stages when the program is linked
+    stages.push_back({type, filename, std::move(sourceString)});
+    return true;
+}
 
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &sourceCStr, nullptr);
-    glCompileShader(shader);
+const std::string& our::ShaderProgram::getStageFile(GLenum type) const {
+    static const std::string none;
+    for (const auto& stage : stages) {
+        if (stage.type == type) return stage.file;
+    }
+    return none;
+}
 
-    std::string error = checkForShaderCompilationErrors(shader);
-    if (!error.empty()) {
-        std::cerr << "ERROR: Shader Compilation Failed for shader: " << filename << "\n" << error << std::endl;
-        return false;
+// Adds the defines right after the "#version" line (which must stay first), then restores the line numbers so that the
+// compilation errors still point at the lines of the file
+std::string our::ShaderProgram::getStageSource(const Stage& stage) const {
+    if (defines.empty()) return stage.source;
+    size_t bodyStart = 0;
+    int firstLine = 1;
+    if (stage.source.compare(0, 8, "#version") == 0) {
+        size_t end = stage.source.find('\n');
+        bodyStart = end == std::string::npos ? stage.source.size() : end + 1;
+        firstLine = 2;
     }
+    std::string result = stage.source.substr(0, bodyStart);
+    if (!result.empty() && result.back() != '\n') result += '\n';
+    for (const auto& define : defines) result += "#define " + define + "\n";
+    result += "#line " + std::to_string(firstLine) + "\n";
+    result += stage.source.substr(bodyStart);
+    return result;
+}
 
-    glAttachShader(program, shader);
-    glDeleteShader(shader); // the shader is no longer needed after attaching it to the program
-    return true;
+void our::ShaderProgram::compileStages(const std::vector<std::string>& sources) {
+    // The compile status is only checked by "finishLink" since asking for it would wait for the driver
+    for (size_t i = 0; i < stages.size(); i++) {
+        const char* sourceCStr = sources[i].c_str();
+        GLuint shader = glCreateShader(stages[i].type);
+        glShaderSource(shader, 1, &sourceCStr, nullptr);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        compiledShaders.push_back(shader);
+    }
+    if (ShaderCache::isBinaryCacheEnabled()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+}
+
+bool our::ShaderProgram::link() {
+    beginLink();
+    return finishLink();
 }
 
+void our::ShaderProgram::beginLink() {
+    if (linking) return;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::pair<GLenum, std::string>> sources;
+    for (const auto& stage : stages) sources.emplace_back(stage.type, getStageSource(stage));
+    binaryKey = ShaderCache::getBinaryKey(sources);
+    fromBinary = ShaderCache::loadBinary(binaryKey, program);
+    if (!fromBinary) {
+        std::vector<std::string> stageSources;
+        for (auto& source : sources) stageSources.push_back(std::move(source.second));
+        compileStages(stageSources);
+    }
+    linking = true;
+    linkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
+bool our::ShaderProgram::isLinkReady() const {
+    if (!linking || !ShaderCache::hasParallelCompile()) return true;
+    GLint complete = GL_TRUE;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
 
-bool our::ShaderProgram::link() const {
-    glLinkProgram(program);
-    std::string error = checkForLinkingErrors(program);
-    if (!error.empty()) {
-        std::cerr << "ERROR: Shader Program Linking Failed\n" << error << std::endl;
-        return false;
+bool our::ShaderProgram::finishLink() {
+    if (!linking) return linked;
+    linking = false;
+    auto start = std::chrono::steady_clock::now();
+
+    linked = true;
+    for (size_t i = 0; i < compiledShaders.size(); i++) {
+        std::string error = checkForShaderCompilationErrors(compiledShaders[i]);
+        if (!error.empty()) {
+            std::cerr << "ERROR: Shader Compilation Failed for shader: " << stages[i].file << "\n" << error << std::endl;
+            linked = false;
+        }
+    }
+    if (linked) {
+        std::string error = checkForLinkingErrors(program);
+        if (!error.empty()) {
+            std::cerr << "ERROR: Shader Program Linking Failed\n" << error << std::endl;
+            linked = false;
+        }
+    }
+    // The shaders are no longer needed once the program is linked
+    for (GLuint shader : compiledShaders) {
+        glDetachShader(program, shader);
+        glDeleteShader(shader);
+    }
+    compiledShaders.clear();
+    if (linked && !fromBinary) ShaderCache::saveBinary(binaryKey, program);
+
+    linkSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ShaderCache::recordLink(fromBinary, linked, linkSeconds);
+    if (!linked) return false;
+
+    // Connect the shared uniform blocks to their binding points
+    GLuint frameBlock = glGetUniformBlockIndex(program, uniform_blocks::FRAME_NAME);
+    if (frameBlock != GL_INVALID_INDEX) glUniformBlockBinding(program, frameBlock, uniform_blocks::FRAME);
+
+    reflectUniforms();
+
+    // Samplers can't live in a uniform block, but since their texture unit never changes we only need to set them once
+    const std::pair<const char*, GLint> reservedSamplers[] = {
+        {"spotlight_cookie", reserved_texture_units::SPOTLIGHT_COOKIE},
+        {"instance_data", reserved_texture_units::INSTANCE_DATA},
+        {"light_data", reserved_texture_units::LIGHT_DATA},
+        {"light_clusters", reserved_texture_units::LIGHT_CLUSTERS},
+        {"light_indices", reserved_texture_units::LIGHT_INDICES},
+    };
+    for (const auto& [name, unit] : reservedSamplers) {
+        UniformHandle<GLint> sampler = getUniform<GLint>(name);
+        if (sampler.isValid()) {
+            use();
+            set(sampler, unit);
+        }
     }
     return true;
 }
 
+void our::ShaderProgram::reflectUniforms() {
+    uniforms.clear();
+    uniformSlots.clear();
+
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> nameBuffer(std::max(maxLength, 1));
+
+    auto add = [this](const std::string& name, GLint location) {
+        uniformSlots.emplace(name, (GLint)uniforms.size());
+        uniforms.emplace_back(location);
+    };
+
+    for (GLint index = 0; index < count; index++) {
+        GLint size = 0;
+        GLenum type = 0;
+        GLsizei length = 0;
+        glGetActiveUniform(program, (GLuint)index, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+        // Uniforms inside a uniform block have no location since they are fed from a buffer
+        GLint location = glGetUniformLocation(program, name.c_str());
+        if (location < 0) continue;
+
+        // Arrays are reported once as "name[0]", so we add an entry for every element (and the plain name for the first one)
+        const std::string arraySuffix = "[0]";
+        if (name.size() > arraySuffix.size() && name.compare(name.size() - arraySuffix.size(), arraySuffix.size(), arraySuffix) == 0) {
+            std::string base = name.substr(0, name.size() - arraySuffix.size());
+            uniformSlots.emplace(base, (GLint)uniforms.size());
+            for (GLint element = 0; element < size; element++) {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                GLint elementLocation = glGetUniformLocation(program, elementName.c_str());
+                if (elementLocation >= 0) add(elementName, elementLocation);
+            }
+        } else {
+            add(name, location);
+        }
+    }
+}
+
 ////////////////////////////////////////////////////////////////////
 // Function to check for compilation and linking error in shaders //
 ////////////////////////////////////////////////////////////////////
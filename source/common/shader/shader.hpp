@@ -1,89 +1,168 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <glad/gl.h>
+#include "../gl-state.hpp"
 
 namespace our {
 
+    // The binding points of the uniform blocks shared between shaders. After linking, every block with one of these names
+    // is bound to its binding point, so a buffer bound there once is seen by all the programs.
+    namespace uniform_blocks {
+        constexpr GLuint FRAME = 0; // "FrameData": the camera, fog and light data which are uploaded once per frame
+        constexpr const char* FRAME_NAME = "FrameData";
+    }
+
+    // Texture units reserved for textures that are bound once per frame (the materials use the units 0 to 5)
+    namespace reserved_texture_units {
+        constexpr GLint SPOTLIGHT_COOKIE = 6; // Sampled by "spotlight_cookie"
+        constexpr GLint INSTANCE_DATA = 7; // Sampled by "instance_data" (a buffer texture, rebound before every instanced draw)
+        // The lights and their clusters (buffer textures, see "LightClusters")
+        constexpr GLint LIGHT_DATA = 8; // Sampled by "light_data"
+        constexpr GLint LIGHT_CLUSTERS = 9; // Sampled by "light_clusters"
+        constexpr GLint LIGHT_INDICES = 10; // Sampled by "light_indices"
+    }
+
+    // A uniform of a shader program resolved once by "ShaderProgram::getUniform", so that it can be set
+    // without looking it up by name. "T" is the type of the values it will be set to.
+    // The handle is only valid for the program that created it and until that program is linked again.
+    // Setting an invalid handle (the uniform doesn't exist or was optimized out) does nothing.
+    template<typename T>
+    struct UniformHandle {
+        GLint slot = -1; // The index of the uniform in the uniform table of the program
+
+        bool isValid() const { return slot >= 0; }
+    };
+
     class ShaderProgram {
 
     private:
         //Shader Program Handle (OpenGL object name)
         GLuint program;
 
+        // The attached stages. Their sources are only compiled by "beginLink", so that the defines can be added to them
+        // and so that nothing is compiled if the program is found in the binary cache (see "ShaderCache").
+        struct Stage {
+            GLenum type;
+            std::string file;
+            std::string source;
+        };
+        std::vector<Stage> stages;
+        std::vector<std::string> defines; // Added as "#define"s to every stage (e.g. "HAS_NORMAL_MAP true")
+        // The state of the link started by "beginLink" and not finished yet
+        std::vector<GLuint> compiledShaders; // One per stage (empty if the program was loaded from the binary cache)
+        bool linking = false, fromBinary = false, linked = false;
+        std::uint64_t binaryKey = 0;
+        double linkSeconds = 0.0; // The time spent in the link calls so far
+
+        // An active uniform (outside of any uniform block) along with the last value it was set to.
+        // Since a program keeps its uniform values, a value equal to the last one doesn't need to be uploaded again.
+        struct Uniform {
+            GLint location = -1;
+            GLsizei cachedSize = 0; // The size of the cached value in bytes (0 if nothing was set yet)
+            alignas(16) unsigned char cachedValue[sizeof(glm::mat4)] = {};
+
+            explicit Uniform(GLint location) : location(location) {}
+        };
+        // The uniform table, filled after linking from the active uniforms of the program.
+        // Every element of a uniform array gets its own entry (e.g. "lights[2]").
+        std::vector<Uniform> uniforms;
+        std::unordered_map<std::string, GLint> uniformSlots; // Maps the uniform names to their index in the table
+
+        void reflectUniforms();
+        std::string getStageSource(const Stage& stage) const;
+        void compileStages(const std::vector<std::string>& sources);
+
+        static void upload(GLint location, GLfloat value) { glUniform1f(location, value); }
+        static void upload(GLint location, GLuint value) { glUniform1ui(location, value); }
+        static void upload(GLint location, GLint value) { glUniform1i(location, value); }
+        static void upload(GLint location, bool value) { glUniform1i(location, value); }
+        static void upload(GLint location, const glm::vec2& value) { glUniform2f(location, value.x, value.y); }
+        static void upload(GLint location, const glm::vec3& value) { glUniform3f(location, value.x, value.y, value.z); }
+        static void upload(GLint location, const glm::vec4& value) { glUniform4f(location, value.x, value.y, value.z, value.w); }
+        static void upload(GLint location, const glm::ivec4& value) { glUniform4i(location, value.x, value.y, value.z, value.w); }
+        static void upload(GLint location, const glm::mat4& matrix) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(matrix)); }
+
     public:
         ShaderProgram(){
             program = glCreateProgram();
         }
         ~ShaderProgram(){
+            for (GLuint shader : compiledShaders) glDeleteShader(shader);
+            gl_state::forgetProgram(program);
             glDeleteProgram(program);
         }
 
-        bool attach(const std::string &filename, GLenum type) const;
-
-        bool link() const;
+        // Reads the source of a stage from a file. It is compiled when the program is linked.
+        bool attach(const std::string &filename, GLenum type);
+
+        // Sets the defines added to the stages of the program. It must be called before linking.
+        void setDefines(std::vector<std::string> newDefines) { defines = std::move(newDefines); }
+        const std::vector<std::string>& getDefines() const { return defines; }
+        // Returns the file of the first attached stage of the given type (or an empty string)
+        const std::string& getStageFile(GLenum type) const;
+
+        // Links the program and waits for the result
+        bool link();
+        // Starts linking the program without waiting for the driver. The program is either loaded from the binary cache or
+        // compiled from its sources, which the driver may do in the background (see "ShaderCache::hasParallelCompile").
+        void beginLink();
+        // Whether the link started by "beginLink" can be finished without waiting for the driver
+        bool isLinkReady() const;
+        bool isLinking() const { return linking; }
+        // Waits for the link started by "beginLink", reports its errors and prepares the program to be used.
+        // Returns whether the program was linked successfully.
+        bool finishLink();
 
         void use() { 
-            glUseProgram(program);
-        }
-
-        GLuint getUniformLocation(const std::string &name) {
-            return glGetUniformLocation(program, name.c_str());
+            // A program that is still being linked has to be finished before it can be used
+            if (linking) finishLink();
+            gl_state::useProgram(program);
         }
 
-        void set(const std::string &uniform, GLfloat value) {
-            GLuint loc = getUniformLocation(uniform);
-            if (loc != GL_INVALID_INDEX) {
-                glUniform1f(loc, value);
-            }
+        GLint getUniformLocation(const std::string &name) const {
+            auto it = uniformSlots.find(name);
+            return it == uniformSlots.end() ? -1 : uniforms[it->second].location;
         }
 
-        void set(const std::string &uniform, GLuint value) {
-            GLuint loc = getUniformLocation(uniform);
-            if (loc != GL_INVALID_INDEX) {
-                glUniform1ui(loc, value);
-            }
+        // This function resolves a uniform by name. It should be called once (after linking) and the handle kept for later use.
+        template<typename T>
+        UniformHandle<T> getUniform(const std::string &name) const {
+            auto it = uniformSlots.find(name);
+            return {it == uniformSlots.end() ? -1 : it->second};
         }
 
-        void set(const std::string &uniform, GLint value) {
-            GLint loc = getUniformLocation(uniform);
-            if (loc != GL_INVALID_INDEX) {
-                glUniform1i(loc, value);
-            }
+        // This function sets a uniform of this program (which must be in use) through a pre-resolved handle.
+        // Nothing is uploaded if the value is the same as the last value set to this uniform.
+        template<typename T>
+        void set(UniformHandle<T> handle, const T& value) {
+            static_assert(sizeof(T) <= sizeof(Uniform::cachedValue), "The uniform type is too large to be cached");
+            if (!handle.isValid()) return;
+            Uniform& uniform = uniforms[handle.slot];
+            if (uniform.cachedSize == (GLsizei)sizeof(T) && std::memcmp(uniform.cachedValue, &value, sizeof(T)) == 0) return;
+            std::memcpy(uniform.cachedValue, &value, sizeof(T));
+            uniform.cachedSize = sizeof(T);
+            upload(uniform.location, value);
         }
 
-        void set(const std::string &uniform, glm::vec2 value) {
-            GLuint loc = getUniformLocation(uniform);
-            if (loc != GL_INVALID_INDEX) {
-                glUniform2f(loc, value.x, value.y);
-            }
-        }
-
-        void set(const std::string &uniform, glm::vec3 value) {
-            GLuint loc = getUniformLocation(uniform);
-            if (loc != GL_INVALID_INDEX) {
-                glUniform3f(loc, value.x, value.y, value.z);
-            }
-        }
-
-        void set(const std::string &uniform, glm::vec4 value) {
-            GLuint loc = getUniformLocation(uniform);
-            if (loc != GL_INVALID_INDEX) {
-                glUniform4f(loc, value.x, value.y, value.z, value.w);
-            }
-        }
-
-        void set(const std::string &uniform, glm::mat4 matrix) {
-            GLuint loc = getUniformLocation(uniform);
-            if (loc != GL_INVALID_INDEX) {
-                glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(matrix));
-            }
-        }
+        // These functions set a uniform by name. They are convenient for uniforms that are set rarely,
+        // but anything set per draw should use a handle from "getUniform" instead.
+        void set(const std::string &uniform, GLfloat value) { set(getUniform<GLfloat>(uniform), value); }
+        void set(const std::string &uniform, GLuint value) { set(getUniform<GLuint>(uniform), value); }
+        void set(const std::string &uniform, GLint value) { set(getUniform<GLint>(uniform), value); }
+        void set(const std::string &uniform, bool value) { set(getUniform<bool>(uniform), value); }
+        void set(const std::string &uniform, glm::vec2 value) { set(getUniform<glm::vec2>(uniform), value); }
+        void set(const std::string &uniform, glm::vec3 value) { set(getUniform<glm::vec3>(uniform), value); }
+        void set(const std::string &uniform, glm::vec4 value) { set(getUniform<glm::vec4>(uniform), value); }
+        void set(const std::string &uniform, glm::mat4 matrix) { set(getUniform<glm::mat4>(uniform), matrix); }
 
         // Disable copy constructor and assignment operator
         ShaderProgram(const ShaderProgram&) = delete; 
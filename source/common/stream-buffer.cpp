@@ -0,0 +1,174 @@
+#include "stream-buffer.hpp"
+
+#include "debug-utils.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace our::stream_buffer {
+
+    namespace {
+
+        // The size of a segment when the buffer is first created (it grows if a frame needs more)
+        constexpr std::size_t INITIAL_SEGMENT_SIZE = 256 * 1024;
+
+        GLuint buffer = 0;
+        std::uint8_t* mapped = nullptr; // The whole buffer when it is persistently mapped
+        bool persistent = false;
+        std::size_t segmentSize = 0;
+        int segment = 0; // The segment of the current frame
+        std::size_t head = 0; // The end of the data written in the current segment
+        GLsync fences[FRAMES_IN_FLIGHT] = {};
+        // The buffers replaced during the current frame. The frame's commands may still use them, so they are only
+        // deleted by "endFrame".
+        std::vector<GLuint> retired;
+
+        Stats stats;
+
+        void deleteFences() {
+            for (GLsync& fence : fences) {
+                if (fence) glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+
+        // Creates a buffer of "FRAMES_IN_FLIGHT" segments of the given size (the previous buffer is retired)
+        void create(std::size_t newSegmentSize) {
+            if (buffer) retired.push_back(buffer);
+            // A new buffer is not used by the GPU, so the fences of the old one don't matter anymore
+            deleteFences();
+            segmentSize = newSegmentSize;
+            segment = 0;
+            head = 0;
+
+            GLsizeiptr size = (GLsizeiptr)(segmentSize * FRAMES_IN_FLIGHT);
+            persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+            glGenBuffers(1, &buffer);
+            // The copy target is used so that the other bindings (e.g. the array buffer of a vertex array) are not touched
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            if (persistent) {
+                const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+                mapped = static_cast<std::uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+                if (!mapped) {
+                    std::cerr << "ERROR: Couldn't map the stream buffer" << std::endl;
+                    persistent = false;
+                }
+            }
+            if (!persistent) {
+                // Buffer storage is immutable, so a buffer whose mapping failed is replaced by a regular one
+                if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) {
+                    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                    glDeleteBuffers(1, &buffer);
+                    glGenBuffers(1, &buffer);
+                    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                }
+                glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            if (our::g_debugMode) {
+                std::cout << "Stream buffer: " << FRAMES_IN_FLIGHT << " x " << segmentSize / 1024 << " KB ("
+                          << (persistent ? "persistently mapped" : "mapped per upload") << ")" << std::endl;
+            }
+        }
+
+    }
+
+    void beginFrame() {
+        segment = (segment + 1) % FRAMES_IN_FLIGHT;
+        head = 0;
+        GLsync& fence = fences[segment];
+        if (!fence) return;
+        // Most of the time the GPU finished this segment long ago, so it is checked first without flushing or waiting
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            auto start = std::chrono::steady_clock::now();
+            GLenum result;
+            do {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (result == GL_TIMEOUT_EXPIRED);
+            stats.stalls++;
+            stats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    void endFrame() {
+        stats.frameBytes = head;
+        if (head > stats.peakFrameBytes) stats.peakFrameBytes = head;
+        if (buffer && head > 0) {
+            if (fences[segment]) glDeleteSync(fences[segment]);
+            fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        if (!retired.empty()) {
+            glDeleteBuffers((GLsizei)retired.size(), retired.data());
+            retired.clear();
+        }
+    }
+
+    void reserve(std::size_t size) {
+        if (buffer && head + size <= segmentSize) return;
+        // The uploads continue at the beginning of a larger buffer (the data already uploaded stays in the retired one)
+        std::size_t newSegmentSize = segmentSize ? segmentSize * 2 : INITIAL_SEGMENT_SIZE;
+        while (newSegmentSize < size) newSegmentSize *= 2;
+        if (buffer && our::g_debugMode) std::cout << "The stream buffer is full, it grows" << std::endl;
+        create(newSegmentSize);
+    }
+
+    GLintptr upload(const void* data, std::size_t size, std::size_t alignment) {
+        std::size_t offset = (head + alignment - 1) / alignment * alignment;
+        if (!buffer || offset + size > segmentSize) {
+            reserve(offset - head + size);
+            offset = 0; // The new buffer starts empty
+        }
+
+        std::size_t base = segment * segmentSize + offset;
+        if (persistent) {
+            std::memcpy(mapped + base, data, size);
+        } else {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            // The fences guarantee that the GPU isn't reading this range, so the driver doesn't have to synchronize
+            void* target = glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr)base, (GLsizeiptr)size,
+                                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (target) {
+                std::memcpy(target, data, size);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        head = offset + size;
+        return (GLintptr)base;
+    }
+
+    GLuint getBuffer() {
+        return buffer;
+    }
+
+    bool isPersistent() {
+        return persistent;
+    }
+
+    void destroy() {
+        deleteFences();
+        if (!retired.empty()) glDeleteBuffers((GLsizei)retired.size(), retired.data());
+        retired.clear();
+        // Deleting the buffer also unmaps it
+        if (buffer) glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        mapped = nullptr;
+        segmentSize = 0;
+        head = 0;
+    }
+
+    const Stats& getStats() {
+        return stats;
+    }
+
+    void resetStats() {
+        stats = Stats();
+    }
+
+}
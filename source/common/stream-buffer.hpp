@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <cstddef>
+#include <cstdint>
+
+// A ring buffer for the data that is sent to the GPU every frame (the per frame uniforms, the lights and their clusters,
+// the text quads). It is a single OpenGL buffer split into one segment per frame in flight. Every frame writes into
+// its own segment and puts a fence after its draws, so a segment is only written again once the GPU is done reading it
+// (three frames later), and the writes never wait for the GPU or make the driver copy the data.
+// If the driver has "ARB_buffer_storage", the buffer is mapped once and stays mapped for the whole run. Otherwise each
+// upload maps its range without synchronization (the fences already guarantee that the GPU doesn't read it).
+// All the functions must be called from the thread that owns the OpenGL context.
+namespace our::stream_buffer {
+
+    // The number of frames that the CPU may be ahead of the GPU (the number of segments of the buffer)
+    constexpr int FRAMES_IN_FLIGHT = 3;
+
+    struct Stats {
+        std::size_t frameBytes = 0; // The bytes of its segment that the last finished frame used
+        std::size_t peakFrameBytes = 0; // The most bytes uploaded in a frame
+        std::uint64_t stalls = 0; // The frames that had to wait for the GPU to release their segment
+        double stallSeconds = 0.0; // The time spent waiting for the GPU
+    };
+
+    // Starts a frame: it moves to the next segment and waits (if needed) until the GPU is done with it
+    void beginFrame();
+    // Puts the fence of the frame's segment after the commands that were sent since "beginFrame"
+    void endFrame();
+
+    // Copies the data to the current frame's segment and returns its offset in the buffer (a multiple of "alignment").
+    // If the segment is full, the buffer is replaced by a larger one, so "getBuffer" must be called after the uploads
+    // (the data uploaded earlier in the frame stays valid until "endFrame").
+    GLintptr upload(const void* data, std::size_t size, std::size_t alignment);
+    // Makes sure that the next uploads of up to "size" bytes (including the padding of their alignments) fit in the
+    // current buffer, so that they can all be used with a single "getBuffer"
+    void reserve(std::size_t size);
+    GLuint getBuffer();
+    // Whether the buffer is persistently mapped (see "ARB_buffer_storage")
+    bool isPersistent();
+
+    // Deletes the buffer and the fences (a new buffer is created by the next upload)
+    void destroy();
+
+    const Stats& getStats();
+    void resetStats();
+
+}
@@ -15,23 +15,21 @@ class AmbientTensionSystem {
     float crossfadeDuration = 2.0f;  // 2 second crossfade for ambient
 
     void initialize(World* world) {
-        for (auto entity : world->getEntities()) {
-            if (entity->getComponent<SlendermanComponent>()) {
-                slenderman = entity;
+        if (auto* entity = world->getSingleton<SlendermanComponent>()) {
+            slenderman = entity;
 
-                // Get all audio components and find the ambience one
-                auto audioComponents = entity->getComponents<AudioController>();
-                for (auto* audio : audioComponents) {
-                    if (audio->getAudioType() == AudioType::AMBIENCE) {
-                        ambienceAudio = audio;
-                        ambienceAudio->volume = 0.15f;
-                        if (our::g_debugMode) {
-                            std::cout
-                                << "Ambient tension audio controller found."
-                                << std::endl;
-                        }
-                        break;
+            // Get all audio components and find the ambience one
+            auto audioComponents = entity->getComponents<AudioController>();
+            for (auto* audio : audioComponents) {
+                if (audio->getAudioType() == AudioType::AMBIENCE) {
+                    ambienceAudio = audio;
+                    ambienceAudio->volume = 0.15f;
+                    if (our::g_debugMode) {
+                        std::cout
+                            << "Ambient tension audio controller found."
+                            << std::endl;
                     }
+                    break;
                 }
             }
         }
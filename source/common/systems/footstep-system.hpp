@@ -38,26 +38,24 @@ class FootstepSystem {
     float runStepInterval = 0.4f;   // seconds between footsteps when running
 
     void initialize(World* world, PhysicsSystem* physicsSys) {
-        for (auto entity : world->getEntities()) {
-            if (entity->getComponent<PlayerComponent>()) {
-                player = entity;
+        if (auto* entity = world->getSingleton<PlayerComponent>()) {
+            player = entity;
 
-                // Get all audio components and find the walking and stamina
-                // ones
-                auto audioComponents = entity->getComponents<AudioController>();
-                for (auto* audio : audioComponents) {
-                    if (audio->getAudioType() == AudioType::WALKING) {
-                        walkingAudio = audio;
-                        if (our::g_debugMode) {
-                            std::cout << "Footstep audio controller found."
-                                      << std::endl;
-                        }
-                    } else if (audio->getAudioType() == AudioType::STAMINA) {
-                        staminaAudio = audio;
-                        if (our::g_debugMode) {
-                            std::cout << "Stamina audio controller found."
-                                      << std::endl;
-                        }
+            // Get all audio components and find the walking and stamina
+            // ones
+            auto audioComponents = entity->getComponents<AudioController>();
+            for (auto* audio : audioComponents) {
+                if (audio->getAudioType() == AudioType::WALKING) {
+                    walkingAudio = audio;
+                    if (our::g_debugMode) {
+                        std::cout << "Footstep audio controller found."
+                                  << std::endl;
+                    }
+                } else if (audio->getAudioType() == AudioType::STAMINA) {
+                    staminaAudio = audio;
+                    if (our::g_debugMode) {
+                        std::cout << "Stamina audio controller found."
+                                  << std::endl;
                     }
                 }
             }
@@ -6,6 +6,12 @@
 #include "../components/player.hpp"
 #include "../mesh/mesh-utils.hpp"
 #include "../texture/texture-utils.hpp"
+#include "../debug-utils.hpp"
+#include "../shader/shader-cache.hpp"
+#include "../stream-buffer.hpp"
+
+#include <fstream>
+#include <iostream>
 namespace our {
 
 void ForwardRenderer::initialize(glm::ivec2 windowSize,
@@ -26,9 +32,57 @@ void ForwardRenderer::initialize(glm::ivec2 windowSize,
         this->fogStart = config.value("fog_start", 30.0f);
         this->fogEnd = config.value("fog_end", 100.0f);
         this->horizonThreshold = config.value("horizon_threshold", 0.3f);
+        this->staticBatchCellSize = config.value("static_batch_cell_size", 64.0f);
+        this->cullDistance = config.value("cull_distance", this->fogEnabled ? this->fogEnd : 0.0f);
+        this->occlusionCulling = config.value("occlusion_culling", true);
+        this->occluderRatio = config.value("occluder_ratio", 0.25f);
+        this->occlusionCuller.depthBias = config.value("occlusion_depth_bias", 1.0f);
+        this->depthPrepass = config.value("depth_prepass", false);
+        if (config.contains("light_cluster_grid")) {
+            auto& grid = config["light_cluster_grid"];
+            this->lightClusters.setGridSize(glm::ivec3(grid[0].get<int>(), grid[1].get<int>(), grid[2].get<int>()));
+        }
+        this->lightClusters.cutoff = config.value("light_cutoff", 1.0f / 256.0f);
+        this->objectLights = config.value<std::string>("light_assignment", "clustered") == "per_object";
+        this->objectLightCount = glm::clamp(config.value("object_light_count", LightClusters::MAX_OBJECT_LIGHTS), 0,
+                                            LightClusters::MAX_OBJECT_LIGHTS);
 
         // Load spotlight cookie texture
-        this->spotlightCookie = texture_utils::loadImage("assets/textures/flashlight_cookie.png");
+        this->spotlightCookie = texture_utils::loadImage(SPOTLIGHT_COOKIE_FILE);
+
+    // The per frame uniforms are streamed (see "stream_buffer"), and their offsets must respect the driver's alignment
+    GLint uniformAlignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    this->frameUniformAlignment = std::max<size_t>(uniformAlignment, 16);
+
+    // The shaders are shared through the shader cache and only requested here, so they compile while the loading continues
+    std::vector<std::string> features = getShaderFeatures(config);
+
+    // Create the objects used to bake and draw the impostors of the instanced renderers
+    impostorShader = ShaderCache::request("assets/shaders/impostor.vert", "assets/shaders/impostor.frag", features);
+    impostorBakeShader = ShaderCache::request("assets/shaders/impostor-bake.vert", "assets/shaders/impostor-bake.frag");
+    impostorSampler = new Sampler();
+    impostorSampler->set(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    impostorSampler->set(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    impostorSampler->set(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    impostorSampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // The quads are seen from both sides and cut out by their alpha, so they are neither culled nor blended
+    impostorPipelineState.depthTesting.enabled = true;
+    impostorPipelineState.depthTesting.function = GL_LEQUAL;
+    glGenVertexArrays(1, &impostorVertexArray);
+
+    // Create the materials of the depth pre-pass (the alpha tested ones discard the same fragments as the lit shaders)
+    for (int instanced = 0; instanced < 2; instanced++) {
+        for (int alphaTested = 0; alphaTested < 2; alphaTested++) {
+            LitMaterial* depthMaterial = new LitMaterial();
+            depthMaterial->shader = ShaderCache::request(instanced ? "assets/shaders/depth-instanced.vert" : "assets/shaders/depth.vert",
+                                                         alphaTested ? "assets/shaders/depth-alpha.frag" : "assets/shaders/depth.frag");
+            depthMaterial->texture = nullptr;
+            depthMaterial->sampler = nullptr;
+            depthMaterial->transparent = false;
+            depthMaterials[instanced][alphaTested] = depthMaterial;
+        }
+    }
 
     // Then we check if there is a sky texture in the configuration
     if (config.contains("sky")) {
@@ -37,10 +91,7 @@ void ForwardRenderer::initialize(glm::ivec2 windowSize,
 
         // We can draw the sky using dedicated sky shaders
         // which have Y-level fog for proper tree occlusion
-        ShaderProgram* skyShader = new ShaderProgram();
-        skyShader->attach("assets/shaders/sky.vert", GL_VERTEX_SHADER);
-        skyShader->attach("assets/shaders/sky.frag", GL_FRAGMENT_SHADER);
-        skyShader->link();
+        ShaderProgram* skyShader = ShaderCache::request("assets/shaders/sky.vert", "assets/shaders/sky.frag", features);
 
         // Then, we setup the pipeline state for rendering the sky
         PipelineState skyPipelineState{};
@@ -107,12 +158,8 @@ void ForwardRenderer::initialize(glm::ivec2 windowSize,
         postprocessSampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
         // Create the post processing shader
-        ShaderProgram* postprocessShader = new ShaderProgram();
-        postprocessShader->attach("assets/shaders/fullscreen.vert",
-                                  GL_VERTEX_SHADER);
-        postprocessShader->attach(config.value<std::string>("postprocess", ""),
-                                  GL_FRAGMENT_SHADER);
-        postprocessShader->link();
+        ShaderProgram* postprocessShader = ShaderCache::request("assets/shaders/fullscreen.vert",
+                                                                config.value<std::string>("postprocess", ""));
 
         // Create a post processing material
         postprocessMaterial = new TexturedMaterial();
@@ -125,11 +172,18 @@ void ForwardRenderer::initialize(glm::ivec2 windowSize,
     }
 }
 
+std::vector<std::string> ForwardRenderer::getShaderFeatures(const nlohmann::json& config) {
+    // These must agree with what "initialize" does with the same config
+    bool fog = config.value("fog_enabled", true);
+    bool cookie = (bool)std::ifstream(SPOTLIGHT_COOKIE_FILE);
+    return {std::string("FOG_ENABLED ") + (fog ? "true" : "false"),
+            std::string("SPOTLIGHT_COOKIE ") + (cookie ? "true" : "false")};
+}
+
 void ForwardRenderer::destroy() {
     // Delete all objects related to the sky
     if (skyMaterial) {
         delete skySphere;
-        delete skyMaterial->shader;
         delete skyMaterial->texture;
         delete skyMaterial->sampler;
         delete skyMaterial;
@@ -138,97 +192,95 @@ void ForwardRenderer::destroy() {
     if (spotlightCookie) {
         delete spotlightCookie;
     }
+    lightClusters.destroy();
+    // Forget the retained commands since their materials may be deleted with the scene
+    renderCommands.clear();
+    commandRanges.clear();
+    commandsWorld = nullptr;
+    staticBatcher.clear();
+    staticSignature.clear();
+    staticEntities.clear();
+    staticBatchesDirty = true;
+    staticHierarchy.clear();
+    dynamicCommands.clear();
+    occlusionCuller.clear();
+
+    // Delete all objects related to the impostors (the shaders belong to the shader cache)
+    delete impostorSampler;
+    impostorShader = impostorBakeShader = nullptr;
+    impostorUniformsShader = nullptr;
+    impostorSampler = nullptr;
+    if (impostorVertexArray) {
+        gl_state::forgetVertexArray(impostorVertexArray);
+        glDeleteVertexArrays(1, &impostorVertexArray);
+        impostorVertexArray = 0;
+    }
+
+    // Delete the materials of the depth pre-pass (their textures and samplers belong to the drawn materials)
+    for (auto& row : depthMaterials) {
+        for (LitMaterial*& depthMaterial : row) {
+            if (!depthMaterial) continue;
+            delete depthMaterial;
+            depthMaterial = nullptr;
+        }
+    }
 
     // Delete all objects related to post processing
     if (postprocessMaterial) {
         glDeleteFramebuffers(1, &postprocessFrameBuffer);
+        gl_state::forgetVertexArray(postProcessVertexArray);
         glDeleteVertexArrays(1, &postProcessVertexArray);
         delete colorTarget;
         delete depthTarget;
         delete postprocessMaterial->sampler;
-        delete postprocessMaterial->shader;
         delete postprocessMaterial;
     }
 }
 
 void ForwardRenderer::render(World* world, float deltaTime) {
     // First of all, we search for a camera and for all the mesh renderers
-    opaqueCommands.clear();
-    transparentCommands.clear();
+    renderQueue.clear();
     lightCommands.clear();
     std::vector<InstancedRendererComponent*> instancedRenderers;
 
     // Wer need to find the player component first before processing lights
     if (!playerComp || !camera) {
-        for (auto entity : world->getEntities()) {
-            playerComp = entity->getComponent<PlayerComponent>();
-            camera = entity->getComponent<CameraComponent>();
-            if (playerComp && camera) break;
+        if (auto* playerEntity = world->getSingleton<PlayerComponent>()) {
+            playerComp = playerEntity->getComponent<PlayerComponent>();
+            camera = playerEntity->getComponent<CameraComponent>();
+        }
+    }
+    // If we hadn't found a camera yet, we look for any entity with a camera
+    if (!camera) {
+        if (auto* cameraEntity = world->getSingleton<CameraComponent>()) {
+            camera = cameraEntity->getComponent<CameraComponent>();
         }
     }
 
-    for (auto entity : world->getEntities()) {
-        // If we hadn't found a camera yet, we look for a camera in this entity
-        if (!camera) camera = entity->getComponent<CameraComponent>();
-        if (auto instancedRenderer =
-                entity->getComponent<InstancedRendererComponent>();
-            instancedRenderer) {
+    world->forEach<InstancedRendererComponent>(
+        [&](Entity*, InstancedRendererComponent* instancedRenderer) {
             instancedRenderers.push_back(instancedRenderer);
-        }
-        // Collect light components and update their flicker
-        if (auto light = entity->getComponent<LightComponent>(); light) {
-            // Skip flashlight if player has it turned off
-            if (light->isFlashlight && playerComp &&
-                !playerComp->flashlightOn) {
-                continue;
-            }
-            light->updateFlicker(deltaTime);
-            lightCommands.push_back(light);
-        }
-        // If this entity has a mesh renderer component
-        if (auto meshRenderer = entity->getComponent<MeshRendererComponent>();
-            meshRenderer) {
-            glm::mat4 localToWorld =
-                meshRenderer->getOwner()->getLocalToWorldMatrix();
-            glm::vec3 center = glm::vec3(localToWorld * glm::vec4(0, 0, 0, 1));
-
-            // If mesh has submeshes, create a command for each submesh with its
-            // material
-            if (meshRenderer->mesh &&
-                meshRenderer->mesh->getSubmeshCount() > 0) {
-                for (size_t i = 0; i < meshRenderer->mesh->getSubmeshCount();
-                     i++) {
-                    const auto& submesh = meshRenderer->mesh->getSubmeshes()[i];
-                    RenderCommand command;
-                    command.localToWorld = localToWorld;
-                    command.center = center;
-                    command.mesh = meshRenderer->mesh;
-                    command.submeshIndex = i;
-                    command.material = meshRenderer->getMaterialForSubmesh(
-                        submesh.materialName);
-
-                    if (command.material->transparent) {
-                        transparentCommands.push_back(command);
-                    } else {
-                        opaqueCommands.push_back(command);
-                    }
-                }
-            } else {
-                // No submeshes, use default material
-                RenderCommand command;
-                command.localToWorld = localToWorld;
-                command.center = center;
-                command.mesh = meshRenderer->mesh;
-                command.submeshIndex = -1;
-                command.material = meshRenderer->material;
-
-                if (command.material->transparent) {
-                    transparentCommands.push_back(command);
-                } else {
-                    opaqueCommands.push_back(command);
-                }
+            // The impostor pictures are baked the first time they are needed (before the frame's framebuffer is bound)
+            if (instancedRenderer->impostorDistance > 0.0f && !instancedRenderer->impostorTexture) {
+                bakeImpostor(instancedRenderer);
             }
+        });
+    // Collect light components and update their flicker
+    world->forEach<LightComponent>([&](Entity*, LightComponent* light) {
+        // Skip flashlight if player has it turned off
+        if (light->isFlashlight && playerComp && !playerComp->flashlightOn) {
+            return;
         }
+        light->updateFlicker(deltaTime);
+        lightCommands.push_back(light);
+    });
+    // The mesh renderer commands are kept between frames: they are only rebuilt when entities or components were
+    // added or removed, otherwise only the commands of the entities that moved are updated
+    if (world != commandsWorld || world->getStructureVersion() != commandsVersion ||
+        renderQueue.getIdGeneration() != commandsIdGeneration) {
+        rebuildCommands(world);
+    } else {
+        patchCommands(world);
     }
     // If there is no camera, we return (we cannot render without a camera)
     if (camera == nullptr) return;
@@ -238,20 +290,53 @@ void ForwardRenderer::render(World* world, float deltaTime) {
     glm::vec3 center = M * glm::vec4(0, 0, -1, 1);
     glm::vec3 cameraForward = glm::normalize(center - eye);
 
-    std::sort(transparentCommands.begin(), transparentCommands.end(),
-              [cameraForward](const RenderCommand& first,
-                              const RenderCommand& second) {
-                  return glm::dot(first.center, cameraForward) >
-                         glm::dot(second.center, cameraForward);
-              });
-
     // Get the camera ViewProjection matrix and store it in VP
-    glm::mat4 VP =
-        camera->getProjectionMatrix(windowSize) * camera->getViewMatrix();
+    glm::mat4 view = camera->getViewMatrix();
+    glm::mat4 projection = camera->getProjectionMatrix(windowSize);
+    glm::mat4 VP = projection * view;
 
     // Extract frustum for culling
     frustum.extractFromVP(VP);
 
+    // Draw the occluders into the CPU depth buffer, so the commands and instance cells behind them can be dropped
+    bool occlusion = occlusionCulling && occlusionCuller.hasOccluders();
+    if (occlusion) occlusionCuller.render(VP);
+
+    // Cull the commands whose bounds are outside the frustum or beyond the cull distance.
+    // The static ones are culled by branches of the hierarchy, the rest are tested one by one.
+    visibleCommands.clear();
+    staticHierarchy.query(frustum, eye, cullDistance, visibleCommands);
+    for (std::uint32_t index : dynamicCommands) {
+        const RenderCommand& command = renderCommands[index];
+        if (!frustum.isBoxInside(command.minBound, command.maxBound)) continue;
+        if (cullDistance > 0.0f) {
+            glm::vec3 nearest = glm::clamp(eye, command.minBound, command.maxBound) - eye;
+            if (glm::dot(nearest, nearest) > cullDistance * cullDistance) continue;
+        }
+        visibleCommands.push_back(index);
+    }
+    if (occlusion) {
+        visibleCommands.erase(std::remove_if(visibleCommands.begin(), visibleCommands.end(), [&](std::uint32_t index) {
+            return !occlusionCuller.isBoxVisible(renderCommands[index].minBound, renderCommands[index].maxBound);
+        }), visibleCommands.end());
+    }
+    // Cull the cells of instances (large sets are split over the thread pool) and split them between the levels of
+    // detail. The renderers without any visible instance are dropped.
+    instancedRenderers.erase(std::remove_if(instancedRenderers.begin(), instancedRenderers.end(),
+        [&](InstancedRendererComponent* instancedRenderer) {
+            if (!instancedRenderer->mesh || !instancedRenderer->material || instancedRenderer->instances.empty()) return true;
+            return !instancedRenderer->updateVisibleInstances(eye, frustum, threadPool, occlusion ? &occlusionCuller : nullptr);
+        }), instancedRenderers.end());
+
+    // Sort the commands by state (opaque) or from back to front (transparent)
+    for (std::uint32_t i : visibleCommands) {
+        const RenderCommand& command = renderCommands[i];
+        RenderPass pass = command.material->transparent ? RenderPass::TRANSPARENT_PASS : RenderPass::OPAQUE_PASS;
+        float depth = glm::dot(command.center - eye, cameraForward);
+        renderQueue.push(pass, command.state, depth, camera->far, i);
+    }
+    renderQueue.sort();
+
     // Set the OpenGL viewport using viewportStart and viewportSize
     glViewport(0, 0, windowSize.x, windowSize.y);
 
@@ -261,8 +346,8 @@ void ForwardRenderer::render(World* world, float deltaTime) {
 
     // Set the color mask to true and the depth mask to true (to ensure the
     // glClear will affect the framebuffer)
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    glDepthMask(GL_TRUE);
+    gl_state::colorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    gl_state::depthMask(GL_TRUE);
 
     // If there is a postprocess material, bind the framebuffer
     if (postprocessMaterial) {
@@ -274,218 +359,28 @@ void ForwardRenderer::render(World* world, float deltaTime) {
     // Clear the color and depth buffers
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Don't forget to set the "transform" uniform to be equal the
-    // model-view-projection matrix for each render command
+    // The camera, fog and lights are the same for every draw, so they are uploaded once here
+    uploadFrameUniforms(eye, cameraForward, view, projection);
 
-    for (const auto& command : opaqueCommands) {
-        // Setup the material
-        command.material->setup();
-        // Compute the model-view-projection matrix
-        glm::mat4 M = command.localToWorld;
-        glm::mat4 MVP = VP * M;
-        // Set the "transform" uniform
-        command.material->shader->set("transform", MVP);
-
-            // If this is a lit material, set lighting uniforms
-            if (dynamic_cast<LitMaterial *>(command.material))
-            {
-                command.material->shader->set("camera_position", eye);
-                command.material->shader->set("light_count", (int)lightCommands.size());
-                command.material->shader->set("fog_enabled", fogEnabled);
-                command.material->shader->set("fog_color", fogColor);
-                command.material->shader->set("fog_start", fogStart);
-                command.material->shader->set("fog_end", fogEnd);
-                
-                // Bind spotlight cookie texture
-                if (spotlightCookie) {
-                    glActiveTexture(GL_TEXTURE5);
-                    spotlightCookie->bind();
-                    command.material->shader->set("spotlight_cookie", 5);
-                    command.material->shader->set("has_spotlight_cookie", true);
-                } else {
-                    command.material->shader->set("has_spotlight_cookie", false);
-                }
-                
-                command.material->shader->set("M", M);
-                command.material->shader->set("M_IT", glm::transpose(glm::inverse(M)));
-
-            // Set uniforms for each light
-            for (size_t i = 0; i < lightCommands.size(); i++) {
-                LightComponent* light = lightCommands[i];
-                std::string prefix = "lights[" + std::to_string(i) + "].";
-
-                // Get light world position and direction from its entity
-                // transform
-                glm::mat4 lightMatrix =
-                    light->getOwner()->getLocalToWorldMatrix();
-                glm::vec3 lightPos =
-                    glm::vec3(lightMatrix * glm::vec4(0, 0, 0, 1));
-                glm::vec3 worldDirection = glm::normalize(
-                    glm::vec3(lightMatrix * glm::vec4(light->direction, 0.0f)));
-
-                command.material->shader->set(prefix + "type",
-                                              (int)light->lightType);
-                command.material->shader->set(prefix + "position", lightPos);
-                command.material->shader->set(prefix + "direction",
-                                              worldDirection);
-                command.material->shader->set(prefix + "color",
-                                              light->getEffectiveColor());
-                command.material->shader->set(prefix + "attenuation",
-                                              light->attenuation);
-                command.material->shader->set(prefix + "inner_cone_angle",
-                                              light->inner_cone_angle);
-                command.material->shader->set(prefix + "outer_cone_angle",
-                                              light->outer_cone_angle);
-                command.material->shader->set(prefix + "isFlashlight",
-                                              light->isFlashlight);
-            }
-        }
-
-        // Draw the mesh
-        if (command.submeshIndex >= 0) {
-            command.mesh->drawSubmesh(command.submeshIndex);
-        } else {
-            command.mesh->draw();
+    // Draw the depth of the opaque commands and instances first, so the opaque pass only shades the visible fragments
+    if (depthPrepass) {
+        drawPass(RenderPass::OPAQUE_PASS, VP, true);
+        for (auto& instancedRenderer : instancedRenderers) {
+            drawInstances(instancedRenderer, VP, true);
         }
     }
 
-    for (auto& instancedRenderer : instancedRenderers) {
-        if (instancedRenderer->mesh && instancedRenderer->material &&
-            !instancedRenderer->InstanceMats.empty()) {
-            // Perform culling if enabled and positions are available
-            const std::vector<glm::mat4>* instanceMatrices =
-                &instancedRenderer->InstanceMats;
-            size_t instanceCount = instancedRenderer->InstanceMats.size();
-
-            if (!instancedRenderer->instancePositions.empty() &&
-                (instancedRenderer->enableDistanceCulling ||
-                 instancedRenderer->enableFrustumCulling)) {
-                instancedRenderer->updateVisibleInstances(eye, frustum);
-
-                if (instancedRenderer->visibleInstanceMats.empty()) {
-                    continue;  // Skip if no visible instances
-                }
-
-                instanceMatrices = &instancedRenderer->visibleInstanceMats;
-                instanceCount = instancedRenderer->visibleInstanceMats.size();
+    // Draw all the opaque commands
+    drawPass(RenderPass::OPAQUE_PASS, VP);
 
-                // Update the instance buffer with culled instances
-                instancedRenderer->mesh->updateInstanceBuffer(
-                    *instanceMatrices);
-            } else {
-                // No culling, use static buffer
-                instancedRenderer->mesh->setupInstancing(*instanceMatrices);
-            }
-
-            // Check if mesh has submeshes
-            if (instancedRenderer->mesh->getSubmeshCount() > 0) {
-                // Render each submesh with its specific material
-                for (size_t i = 0;
-                     i < instancedRenderer->mesh->getSubmeshCount(); i++) {
-                    const auto& submesh =
-                        instancedRenderer->mesh->getSubmesh(i);
-                    Material* submeshMaterial =
-                        instancedRenderer->getMaterialForSubmesh(
-                            submesh.materialName);
-
-                    submeshMaterial->setup();
-                    submeshMaterial->shader->set("VP", VP);
-
-                        // Set lighting uniforms for instanced lit materials
-                        submeshMaterial->shader->set("camera_position", eye);
-                        submeshMaterial->shader->set("light_count", (int)lightCommands.size());
-                        submeshMaterial->shader->set("fog_enabled", fogEnabled);
-                        submeshMaterial->shader->set("fog_color", fogColor);
-                        submeshMaterial->shader->set("fog_start", fogStart);
-                        submeshMaterial->shader->set("fog_end", fogEnd);
-                        
-                        // Bind spotlight cookie texture
-                        if (spotlightCookie) {
-                            glActiveTexture(GL_TEXTURE5);
-                            spotlightCookie->bind();
-                            submeshMaterial->shader->set("spotlight_cookie", 5);
-                            submeshMaterial->shader->set("has_spotlight_cookie", true);
-                        } else {
-                            submeshMaterial->shader->set("has_spotlight_cookie", false);
-                        }
-                        for (size_t li = 0; li < lightCommands.size(); li++)
-                        {
-                            LightComponent *light = lightCommands[li];
-                            std::string prefix = "lights[" + std::to_string(li) + "].";
-                            glm::mat4 lightMatrix = light->getOwner()->getLocalToWorldMatrix();
-                            glm::vec3 lightPos = glm::vec3(lightMatrix * glm::vec4(0, 0, 0, 1));
-                            glm::vec3 worldDirection = glm::normalize(glm::vec3(lightMatrix * glm::vec4(light->direction, 0.0f)));
-                            submeshMaterial->shader->set(prefix + "type", (int)light->lightType);
-                            submeshMaterial->shader->set(prefix + "position", lightPos);
-                            submeshMaterial->shader->set(prefix + "direction", worldDirection);
-                            submeshMaterial->shader->set(prefix + "color", light->getEffectiveColor());
-                            submeshMaterial->shader->set(prefix + "attenuation", light->attenuation);
-                            submeshMaterial->shader->set(prefix + "inner_cone_angle", light->inner_cone_angle);
-                            submeshMaterial->shader->set(prefix + "outer_cone_angle", light->outer_cone_angle);
-                            submeshMaterial->shader->set(prefix + "isFlashlight", light->isFlashlight);
-                        }
-
-                    glBindVertexArray(instancedRenderer->mesh->getVAO());
-                    glDrawElementsInstanced(
-                        GL_TRIANGLES, submesh.elementCount, GL_UNSIGNED_INT,
-                        (void*)(submesh.elementOffset * sizeof(GLuint)),
-                        instanceCount);
-                }
-            } else {
-                // No submeshes, use default material
-                instancedRenderer->material->setup();
-                instancedRenderer->material->shader->set("VP", VP);
-
-                    // Set lighting uniforms for instanced lit materials
-                    instancedRenderer->material->shader->set("camera_position", eye);
-                    instancedRenderer->material->shader->set("light_count", (int)lightCommands.size());
-                    instancedRenderer->material->shader->set("fog_enabled", fogEnabled);
-                    instancedRenderer->material->shader->set("fog_color", fogColor);
-                    instancedRenderer->material->shader->set("fog_start", fogStart);
-                    instancedRenderer->material->shader->set("fog_end", fogEnd);
-                    
-                    // Bind spotlight cookie texture
-                    if (spotlightCookie) {
-                        glActiveTexture(GL_TEXTURE5);
-                        spotlightCookie->bind();
-                        instancedRenderer->material->shader->set("spotlight_cookie", 5);
-                        instancedRenderer->material->shader->set("has_spotlight_cookie", true);
-                    } else {
-                        instancedRenderer->material->shader->set("has_spotlight_cookie", false);
-                    }
-                    
-                    for (size_t li = 0; li < lightCommands.size(); li++)
-                    {
-                        LightComponent *light = lightCommands[li];
-                        std::string prefix = "lights[" + std::to_string(li) + "].";
-                        glm::mat4 lightMatrix = light->getOwner()->getLocalToWorldMatrix();
-                        glm::vec3 lightPos = glm::vec3(lightMatrix * glm::vec4(0, 0, 0, 1));
-                        glm::vec3 worldDirection = glm::normalize(glm::vec3(lightMatrix * glm::vec4(light->direction, 0.0f)));
-                        instancedRenderer->material->shader->set(prefix + "type", (int)light->lightType);
-                        instancedRenderer->material->shader->set(prefix + "position", lightPos);
-                        instancedRenderer->material->shader->set(prefix + "direction", worldDirection);
-                        instancedRenderer->material->shader->set(prefix + "color", light->getEffectiveColor());
-                        instancedRenderer->material->shader->set(prefix + "attenuation", light->attenuation);
-                        instancedRenderer->material->shader->set(prefix + "inner_cone_angle", light->inner_cone_angle);
-                        instancedRenderer->material->shader->set(prefix + "outer_cone_angle", light->outer_cone_angle);
-                        instancedRenderer->material->shader->set(prefix + "isFlashlight", light->isFlashlight);
-                    }
-
-                instancedRenderer->mesh->drawInstanced(instanceCount);
-            }
-        }
+    for (auto& instancedRenderer : instancedRenderers) {
+        drawInstances(instancedRenderer, VP);
     }
     // If there is a sky material, draw the sky
     if (this->skyMaterial) {
         // Set up the sky material
         this->skyMaterial->setup();
 
-        // Set fog uniforms for sky
-        skyMaterial->shader->set("fog_color", fogColor);
-        skyMaterial->shader->set("fog_enabled", fogEnabled);
-        skyMaterial->shader->set("horizon_threshold", horizonThreshold);
-        skyMaterial->shader->set("apply_fog", true);
-
         // Get the camera position
         glm::vec3 cameraPos = M * glm::vec4(0, 0, 0, 1);
 
@@ -499,84 +394,14 @@ void ForwardRenderer::render(World* world, float deltaTime) {
                       0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f);
 
         // Set the "transform" uniform
-        skyMaterial->shader->set("transform",
+        skyMaterial->shader->set(skyMaterial->transformUniform,
                                  alwaysBehindTransform * VP * modelMatrix);
 
         // Draw the sky sphere
         skySphere->draw();
     }
     // Draw all the transparent commands
-    for (const auto& command : transparentCommands) {
-        // Setup the material
-        command.material->setup();
-        // Compute the model-view-projection matrix
-        glm::mat4 M = command.localToWorld;
-        glm::mat4 MVP = VP * M;
-        // Set the "transform" uniform
-        command.material->shader->set("transform", MVP);
-
-            // If this is a lit material, set lighting uniforms
-            if (dynamic_cast<LitMaterial *>(command.material))
-            {
-                command.material->shader->set("camera_position", eye);
-                command.material->shader->set("light_count", (int)lightCommands.size());
-                command.material->shader->set("fog_enabled", fogEnabled);
-                command.material->shader->set("fog_color", fogColor);
-                command.material->shader->set("fog_start", fogStart);
-                command.material->shader->set("fog_end", fogEnd);
-                
-                // Bind spotlight cookie texture
-                if (spotlightCookie) {
-                    glActiveTexture(GL_TEXTURE5);
-                    spotlightCookie->bind();
-                    command.material->shader->set("spotlight_cookie", 5);
-                    command.material->shader->set("has_spotlight_cookie", true);
-                } else {
-                    command.material->shader->set("has_spotlight_cookie", false);
-                }
-                
-                command.material->shader->set("M", M);
-                command.material->shader->set("M_IT", glm::transpose(glm::inverse(M)));
-
-            // Set uniforms for each light
-            for (size_t i = 0; i < lightCommands.size(); i++) {
-                LightComponent* light = lightCommands[i];
-                std::string prefix = "lights[" + std::to_string(i) + "].";
-
-                // Get light world position and direction from its entity
-                // transform
-                glm::mat4 lightMatrix =
-                    light->getOwner()->getLocalToWorldMatrix();
-                glm::vec3 lightPos =
-                    glm::vec3(lightMatrix * glm::vec4(0, 0, 0, 1));
-                glm::vec3 worldDirection = glm::normalize(
-                    glm::vec3(lightMatrix * glm::vec4(light->direction, 0.0f)));
-
-                command.material->shader->set(prefix + "type",
-                                              (int)light->lightType);
-                command.material->shader->set(prefix + "position", lightPos);
-                command.material->shader->set(prefix + "direction",
-                                              worldDirection);
-                command.material->shader->set(prefix + "color",
-                                              light->getEffectiveColor());
-                command.material->shader->set(prefix + "attenuation",
-                                              light->attenuation);
-                command.material->shader->set(prefix + "inner_cone_angle",
-                                              light->inner_cone_angle);
-                command.material->shader->set(prefix + "outer_cone_angle",
-                                              light->outer_cone_angle);
-                command.material->shader->set(prefix + "isFlashlight",
-                                              light->isFlashlight);
-            }
-        }
-
-        // Draw the mesh
-        if (command.submeshIndex >= 0) {
-            command.mesh->drawSubmesh(command.submeshIndex);
-        } else {
-            command.mesh->draw();
-        }
-    }
+    drawPass(RenderPass::TRANSPARENT_PASS, VP);
 
     // If there is a postprocess material, apply postprocessing
     if (postprocessMaterial) {
@@ -596,12 +421,462 @@ void ForwardRenderer::render(World* world, float deltaTime) {
                                          postprocessUniforms.maxHealth);
         postprocessMaterial->shader->set("time", postprocessUniforms.time);
 
-        glBindVertexArray(postProcessVertexArray);
+        gl_state::bindVertexArray(postProcessVertexArray);
         glDrawArrays(GL_TRIANGLES, 0, 3);
-        glBindVertexArray(0);
     }
 }
 
+void ForwardRenderer::uploadFrameUniforms(const glm::vec3& cameraPosition, const glm::vec3& cameraForward,
+                                          const glm::mat4& view, const glm::mat4& projection) {
+    // The clusters aren't needed when each draw gets its own lights
+    lightClusters.setLights(lightCommands);
+    if (!objectLights) lightClusters.build(view, projection, camera->near, camera->far);
+    lightClusters.upload();
+
+    frameUniforms.cameraPosition = cameraPosition;
+    frameUniforms.fogColor = fogColor;
+    frameUniforms.fogEnabled = fogEnabled;
+    frameUniforms.fogStart = fogStart;
+    frameUniforms.fogEnd = fogEnd;
+    frameUniforms.horizonThreshold = horizonThreshold;
+    frameUniforms.hasSpotlightCookie = spotlightCookie != nullptr;
+    frameUniforms.directionalLightCount = lightClusters.getDirectionalLightCount();
+    frameUniforms.cameraForward = cameraForward;
+    frameUniforms.clusterNear = lightClusters.getNear();
+    frameUniforms.clusterGrid = lightClusters.getGridSize();
+    frameUniforms.clusterDepthScale = lightClusters.getDepthScale();
+    frameUniforms.viewportSize = glm::vec2(windowSize);
+    glm::ivec3 lightOffsets = lightClusters.getTexelOffsets();
+    frameUniforms.lightDataOffset = lightOffsets.x;
+    frameUniforms.lightClustersOffset = lightOffsets.y;
+    frameUniforms.lightIndicesOffset = lightOffsets.z;
+
+    GLintptr offset = stream_buffer::upload(&frameUniforms, sizeof(FrameUniforms), frameUniformAlignment);
+    glBindBufferRange(GL_UNIFORM_BUFFER, uniform_blocks::FRAME, stream_buffer::getBuffer(), offset, sizeof(FrameUniforms));
+
+    // The cookie has its own texture unit so that the materials never unbind it
+    if (spotlightCookie) {
+        spotlightCookie->bind(reserved_texture_units::SPOTLIGHT_COOKIE);
+    }
+}
+
+// Computes the world space bounds of a command from the local bounds of its mesh (or submesh) and its matrix
+static void updateBounds(RenderCommand& command) {
+    glm::vec3 localMin = command.submeshIndex >= 0 ? command.mesh->getSubmesh(command.submeshIndex).minBound : command.mesh->getMinBound();
+    glm::vec3 localMax = command.submeshIndex >= 0 ? command.mesh->getSubmesh(command.submeshIndex).maxBound : command.mesh->getMaxBound();
+    glm::vec3 localCenter = (localMin + localMax) * 0.5f;
+    glm::vec3 localExtent = (localMax - localMin) * 0.5f;
+    // The extent of the transformed box along each world axis is the sum of the projections of its local axes on it
+    glm::vec3 center = glm::vec3(command.localToWorld * glm::vec4(localCenter, 1.0f));
+    glm::vec3 extent = glm::abs(glm::vec3(command.localToWorld[0])) * localExtent.x +
+                       glm::abs(glm::vec3(command.localToWorld[1])) * localExtent.y +
+                       glm::abs(glm::vec3(command.localToWorld[2])) * localExtent.z;
+    command.center = center;
+    command.minBound = center - extent;
+    command.maxBound = center + extent;
+}
+
+void ForwardRenderer::rebuildCommands(World* world) {
+    // The states are all made again, so the ids are given from scratch (which only runs out if there are really too many objects)
+    renderQueue.resetIds();
+    renderCommands.clear();
+    commandRanges.clear();
+    staticEntities.clear();
+    dynamicCommands.clear();
+    // The pending transform changes are already part of the new commands
+    world->takeChangedTransforms(changedEntities);
+
+    std::vector<MeshRendererComponent*> staticRenderers, occluderRenderers;
+    std::vector<const void*> signature;
+    std::vector<BoundingVolumeHierarchy::Item> staticItems;
+
+    // For each entity that has a mesh renderer component
+    world->forEach<MeshRendererComponent>([&](Entity* entity,
+                                              MeshRendererComponent*
+                                                  meshRenderer) {
+        if (!meshRenderer->mesh) return;
+        glm::mat4 localToWorld = entity->getLocalToWorldMatrix();
+        std::uint32_t first = (std::uint32_t)renderCommands.size();
+        bool batched = false;
+
+        auto addCommand = [&](Material* material, int submeshIndex) {
+            // The static parts that can be batched are drawn by the static batches instead
+            if (meshRenderer->isStatic && StaticBatcher::canBatch(meshRenderer->mesh, material)) {
+                signature.push_back(material);
+                batched = true;
+                return;
+            }
+            RenderCommand command;
+            command.localToWorld = localToWorld;
+            command.mesh = meshRenderer->mesh;
+            command.submeshIndex = submeshIndex;
+            command.material = material;
+            command.state = renderQueue.makeState(command.material->shader, command.material, command.mesh);
+            updateBounds(command);
+
+            std::uint32_t index = (std::uint32_t)renderCommands.size();
+            if (meshRenderer->isStatic) {
+                staticItems.push_back({command.minBound, command.maxBound, index});
+            } else {
+                dynamicCommands.push_back(index);
+            }
+            renderCommands.push_back(command);
+        };
+
+        if (meshRenderer->isStatic) {
+            signature.push_back(meshRenderer);
+            signature.push_back(meshRenderer->mesh);
+            staticEntities.insert(entity);
+            if (meshRenderer->isOccluder) occluderRenderers.push_back(meshRenderer);
+        }
+        // If mesh has submeshes, create a command for each submesh with its
+        // material
+        if (meshRenderer->mesh &&
+            meshRenderer->mesh->getSubmeshCount() > 0) {
+            for (size_t i = 0; i < meshRenderer->mesh->getSubmeshCount();
+                 i++) {
+                const auto& submesh = meshRenderer->mesh->getSubmeshes()[i];
+                addCommand(meshRenderer->getMaterialForSubmesh(submesh.materialName), (int)i);
+            }
+        } else {
+            // No submeshes, use default material
+            addCommand(meshRenderer->material, -1);
+        }
+        if (batched) staticRenderers.push_back(meshRenderer);
+        // An entity may hold more than one mesh renderer, so its range may already exist
+        auto [it, inserted] = commandRanges.try_emplace(entity, first, 0);
+        it->second.second += (std::uint32_t)renderCommands.size() - first;
+    });
+
+    // Merging the static geometry (and simplifying the occluders) is slow, so the batches are kept unless the static renderers changed
+    if (staticBatchesDirty || signature != staticSignature) {
+        staticBatcher.build(staticRenderers, staticBatchCellSize);
+        buildOccluders(occluderRenderers);
+        staticSignature = std::move(signature);
+        staticBatchesDirty = false;
+    }
+    const auto& batches = staticBatcher.getBatches();
+    for (size_t i = 0; i < batches.size(); i++) {
+        RenderCommand command;
+        command.localToWorld = glm::mat4(1.0f); // The batched vertices are already in the world space
+        command.mesh = staticBatcher.getMesh();
+        command.submeshIndex = (int)i;
+        command.material = batches[i].material;
+        command.state = renderQueue.makeState(command.material->shader, command.material, command.mesh);
+        updateBounds(command);
+
+        staticItems.push_back({command.minBound, command.maxBound, (std::uint32_t)renderCommands.size()});
+        renderCommands.push_back(command);
+    }
+    staticHierarchy.build(std::move(staticItems));
+
+    commandsWorld = world;
+    commandsVersion = world->getStructureVersion();
+    commandsIdGeneration = renderQueue.getIdGeneration();
+}
+
+void ForwardRenderer::buildOccluders(const std::vector<MeshRendererComponent*>& occluders) {
+    std::vector<glm::vec3> vertices;
+    std::vector<std::uint32_t> indices;
+    for (MeshRendererComponent* renderer : occluders) {
+        // The occluders only need their shape, so they are simplified (the depth bias hides the difference)
+        Mesh* simplified = mesh_utils::simplify(renderer->mesh, occluderRatio, true);
+        const Mesh* occluder = simplified ? simplified : renderer->mesh;
+        if (!occluder->hasCPUCopy()) {
+            std::cerr << "An occluder's mesh must be loaded with keepCPUCopy" << std::endl;
+            continue;
+        }
+        glm::mat4 M = renderer->getOwner()->getLocalToWorldMatrix();
+        std::uint32_t base = (std::uint32_t)vertices.size();
+        for (const Vertex& vertex : occluder->getVertices()) vertices.push_back(glm::vec3(M * glm::vec4(vertex.position, 1.0f)));
+
+        // Only the opaque parts hide what is behind them (not the transparent or the alpha tested ones, e.g. fences)
+        const std::vector<unsigned int>& elements = occluder->getIndices();
+        auto addRange = [&](const Material* material, size_t first, size_t count, GLint baseVertex) {
+            auto* textured = dynamic_cast<const TexturedMaterial*>(material);
+            if (!material || material->transparent || (textured && textured->alphaThreshold > 0.0f)) return;
+            for (size_t e = first; e < first + count; e++) indices.push_back(base + baseVertex + elements[e]);
+        };
+        if (occluder->getSubmeshCount() > 0) {
+            for (const Submesh& submesh : occluder->getSubmeshes()) {
+                addRange(renderer->getMaterialForSubmesh(submesh.materialName), submesh.elementOffset, submesh.elementCount,
+                         submesh.baseVertex);
+            }
+        } else {
+            addRange(renderer->material, 0, elements.size(), 0);
+        }
+        delete simplified;
+    }
+    if (our::g_debugMode) std::cout << "Occlusion culling: " << indices.size() / 3 << " occluder triangles" << std::endl;
+    occlusionCuller.setOccluders(std::move(vertices), std::move(indices));
+}
+
+void ForwardRenderer::patchCommands(World* world) {
+    world->takeChangedTransforms(changedEntities);
+    for (Entity* entity : changedEntities) {
+        // A static entity that moves invalidates the batches it is merged into and the hierarchy
+        if (staticEntities.count(entity)) {
+            staticBatchesDirty = true;
+            rebuildCommands(world);
+            return;
+        }
+        auto it = commandRanges.find(entity);
+        if (it == commandRanges.end()) continue;
+        glm::mat4 localToWorld = entity->getLocalToWorldMatrix();
+        auto [first, count] = it->second;
+        for (std::uint32_t i = first; i < first + count; i++) {
+            renderCommands[i].localToWorld = localToWorld;
+            updateBounds(renderCommands[i]);
+        }
+    }
+}
+
+// Returns true if the opaque draws of a material write a depth that the depth pre-pass can draw first
+static bool writesOpaqueDepth(const Material* material) {
+    return material && material->shader && !material->transparent && material->pipelineState.depthTesting.enabled &&
+           material->pipelineState.depthMask;
+}
+
+Material* ForwardRenderer::getDepthMaterial(const Material* material, bool instanced) {
+    if (!depthPrepass || !writesOpaqueDepth(material)) return nullptr;
+    auto* tinted = dynamic_cast<const TintedMaterial*>(material);
+    auto* textured = dynamic_cast<const TexturedMaterial*>(material);
+    auto* lit = dynamic_cast<const LitMaterial*>(material);
+    bool alphaTested = textured && textured->alphaThreshold > 0.0f;
+    LitMaterial* depthMaterial = depthMaterials[instanced][alphaTested];
+    // The faces and the depth test follow the material, but no color is written
+    depthMaterial->pipelineState = material->pipelineState;
+    depthMaterial->pipelineState.blending.enabled = false;
+    depthMaterial->pipelineState.colorMask = glm::bvec4(false);
+    // The alpha tested materials need everything that decides which fragments are discarded
+    depthMaterial->tint = tinted ? tinted->tint : glm::vec4(1.0f);
+    depthMaterial->texture = textured ? textured->texture : nullptr;
+    depthMaterial->sampler = textured ? textured->sampler : nullptr;
+    depthMaterial->alphaThreshold = textured ? textured->alphaThreshold : 0.0f;
+    depthMaterial->diffuseTextureScale = lit ? lit->diffuseTextureScale : glm::vec3(1.0f);
+    return depthMaterial;
+}
+
+void ForwardRenderer::useDepthPrepass(const Material* material) {
+    if (!depthPrepass || !writesOpaqueDepth(material)) return;
+    // The pre-pass already wrote the nearest depth, so only the fragments at that exact depth are shaded
+    gl_state::depthFunc(GL_EQUAL);
+    gl_state::depthMask(GL_FALSE);
+}
+
+void ForwardRenderer::setObjectLights(ShaderProgram* shader, UniformHandle<GLint> countUniform,
+                                      const UniformHandle<glm::ivec4>* lightsUniform,
+                                      const std::pair<glm::vec3, glm::vec3>& bounds) {
+    if (!objectLights || !countUniform.isValid()) return;
+    GLint indices[LightClusters::MAX_OBJECT_LIGHTS] = {};
+    int count = lightClusters.selectLights(bounds.first, bounds.second, objectLightCount, indices);
+    shader->set(countUniform, (GLint)count);
+    shader->set(lightsUniform[0], glm::ivec4(indices[0], indices[1], indices[2], indices[3]));
+    shader->set(lightsUniform[1], glm::ivec4(indices[4], indices[5], indices[6], indices[7]));
+}
+
+void ForwardRenderer::drawPass(RenderPass pass, const glm::mat4& VP, bool depthOnly) {
+    // Don't forget to set the "transform" uniform to be equal the
+    // model-view-projection matrix for each render command
+    const Material* currentMaterial = nullptr;
+    Material* material = nullptr; // The material that is drawn with (the depth material in the depth only pass)
+    for (const auto& entry : renderQueue.getEntries()) {
+        if (RenderQueue::getPass(entry.key) != pass) continue;
+        const RenderCommand& command = renderCommands[entry.command];
+        // Setup the material (the commands that share it are next to each other, so this rarely happens)
+        if (command.material != currentMaterial) {
+            currentMaterial = command.material;
+            material = depthOnly ? getDepthMaterial(command.material, false) : command.material;
+            if (material) {
+                material->setup();
+                if (!depthOnly && pass == RenderPass::OPAQUE_PASS) useDepthPrepass(material);
+            }
+        }
+        // The materials that don't take part in the depth pre-pass are skipped by it
+        if (!material) continue;
+        // Compute the model-view-projection matrix
+        glm::mat4 M = command.localToWorld;
+        glm::mat4 MVP = VP * M;
+        // Set the "transform" uniform
+        material->shader->set(material->transformUniform, MVP);
+
+        // Lit materials also need the model matrices (the camera, fog and lights come from the frame uniform buffer)
+        if (material->modelUniform.isValid()) {
+            material->shader->set(material->modelUniform, M);
+            material->shader->set(material->modelInverseTransposeUniform, glm::transpose(glm::inverse(M)));
+        }
+        setObjectLights(material->shader, material->objectLightCountUniform, material->objectLightsUniform,
+                        {command.minBound, command.maxBound});
+
+        // Draw the mesh
+        if (command.submeshIndex >= 0) {
+            command.mesh->drawSubmesh(command.submeshIndex);
+        } else {
+            command.mesh->draw();
+        }
+    }
+}
+
+void ForwardRenderer::drawInstances(InstancedRendererComponent* instancedRenderer, const glm::mat4& VP, bool depthOnly) {
+    // The matrices are already on the GPU, so each range of visible instances is drawn by telling the shader where the range starts
+    instancedRenderer->bindInstanceData();
+    bool compact = instancedRenderer->instanceFormat == InstanceFormat::COMPACT;
+    // Sets up the material of a part of the mesh and returns the material to draw it with (null if it is skipped)
+    auto setupPart = [&](Material* partMaterial) -> Material* {
+        Material* material = depthOnly ? getDepthMaterial(partMaterial, true) : partMaterial;
+        if (!material) return nullptr;
+        material->setup();
+        if (!depthOnly) useDepthPrepass(material);
+        material->shader->set(material->viewProjectionUniform, VP);
+        material->shader->set(material->compactInstancesUniform, compact);
+        return material;
+    };
+
+    for (const auto& lod : instancedRenderer->lods) {
+        if (lod.visibleRanges.empty()) continue;
+        // Check if mesh has submeshes
+        if (lod.mesh->getSubmeshCount() > 0) {
+            // Render each submesh with its specific material
+            for (size_t i = 0; i < lod.mesh->getSubmeshCount(); i++) {
+                const auto& submesh = lod.mesh->getSubmesh(i);
+                if (submesh.elementCount == 0) continue;
+                Material* submeshMaterial = setupPart(instancedRenderer->getMaterialForSubmesh(submesh.materialName));
+                if (!submeshMaterial) continue;
+
+                gl_state::bindVertexArray(lod.mesh->getVAO());
+                for (size_t range = 0; range < lod.visibleRanges.size(); range++) {
+                    auto [first, count] = lod.visibleRanges[range];
+                    submeshMaterial->shader->set(submeshMaterial->instanceOffsetUniform, (GLint)first);
+                    setObjectLights(submeshMaterial->shader, submeshMaterial->objectLightCountUniform,
+                                    submeshMaterial->objectLightsUniform, lod.visibleBounds[range]);
+                    glDrawElementsInstancedBaseVertex(
+                        GL_TRIANGLES, submesh.elementCount, GL_UNSIGNED_INT,
+                        (void*)(submesh.elementOffset * sizeof(GLuint)),
+                        count, submesh.baseVertex);
+                }
+            }
+        } else {
+            // No submeshes, use default material
+            Material* material = setupPart(instancedRenderer->material);
+            if (!material) continue;
+            for (size_t range = 0; range < lod.visibleRanges.size(); range++) {
+                auto [first, count] = lod.visibleRanges[range];
+                material->shader->set(material->instanceOffsetUniform, (GLint)first);
+                setObjectLights(material->shader, material->objectLightCountUniform, material->objectLightsUniform,
+                                lod.visibleBounds[range]);
+                lod.mesh->drawInstanced(count);
+            }
+        }
+    }
+    if (depthOnly) return;
+
+    // The impostors are a quad per instance, drawn as a triangle strip of 4 vertices
+    if (!instancedRenderer->impostorRanges.empty() && instancedRenderer->impostorTexture) {
+        impostorPipelineState.setup();
+        impostorShader->use();
+        ImpostorUniforms& uniforms = impostorUniforms;
+        if (impostorUniformsShader != impostorShader) {
+            uniforms.VP = impostorShader->getUniform<glm::mat4>("VP");
+            uniforms.compactInstances = impostorShader->getUniform<bool>("compact_instances");
+            uniforms.minBound = impostorShader->getUniform<glm::vec3>("impostor_min");
+            uniforms.maxBound = impostorShader->getUniform<glm::vec3>("impostor_max");
+            uniforms.tex = impostorShader->getUniform<GLint>("tex");
+            uniforms.instanceOffset = impostorShader->getUniform<GLint>("instance_offset");
+            uniforms.objectLightCount = impostorShader->getUniform<GLint>("object_light_count");
+            uniforms.objectLights[0] = impostorShader->getUniform<glm::ivec4>("object_lights[0]");
+            uniforms.objectLights[1] = impostorShader->getUniform<glm::ivec4>("object_lights[1]");
+            impostorUniformsShader = impostorShader;
+        }
+        impostorShader->set(uniforms.VP, VP);
+        impostorShader->set(uniforms.compactInstances, compact);
+        impostorShader->set(uniforms.minBound, instancedRenderer->mesh->getMinBound());
+        impostorShader->set(uniforms.maxBound, instancedRenderer->mesh->getMaxBound());
+        impostorShader->set(uniforms.tex, 0);
+        instancedRenderer->impostorTexture->bind(0);
+        impostorSampler->bind(0);
+        gl_state::bindVertexArray(impostorVertexArray);
+        for (size_t range = 0; range < instancedRenderer->impostorRanges.size(); range++) {
+            auto [first, count] = instancedRenderer->impostorRanges[range];
+            impostorShader->set(uniforms.instanceOffset, (GLint)first);
+            setObjectLights(impostorShader, uniforms.objectLightCount, uniforms.objectLights, instancedRenderer->impostorBounds[range]);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+        }
+    }
+}
+
+void ForwardRenderer::bakeImpostor(InstancedRendererComponent* instancedRenderer) {
+    Mesh* mesh = instancedRenderer->mesh;
+    glm::vec3 minBound = mesh ? mesh->getMinBound() : glm::vec3(0.0f), maxBound = mesh ? mesh->getMaxBound() : glm::vec3(0.0f);
+    // The picture is as wide as the widest side of the mesh (like the quads in impostor.vert)
+    float halfWidth = std::max(maxBound.x - minBound.x, maxBound.z - minBound.z) * 0.5f;
+    float height = maxBound.y - minBound.y;
+    if (!impostorBakeShader || halfWidth <= 0.0f || height <= 0.0f) {
+        // There is nothing to take a picture of, so the impostors are turned off
+        instancedRenderer->impostorDistance = 0.0f;
+        return;
+    }
+    glm::ivec2 size(IMPOSTOR_RESOLUTION,
+                    glm::clamp((int)(IMPOSTOR_RESOLUTION * height / (2.0f * halfWidth)), 16, 4 * IMPOSTOR_RESOLUTION));
+
+    Texture2D* picture = new Texture2D();
+    picture->bind();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    GLuint depthBuffer, frameBuffer;
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.x, size.y);
+    glGenFramebuffers(1, &frameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, picture->getOpenGLName(), 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+    glViewport(0, 0, size.x, size.y);
+    impostorPipelineState.setup();
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Look at the mesh from the +z side with an orthographic projection of its bounds
+    glm::vec3 center = (minBound + maxBound) * 0.5f;
+    glm::mat4 VP = glm::ortho(center.x - halfWidth, center.x + halfWidth, minBound.y, maxBound.y,
+                              -maxBound.z - 1.0f, -minBound.z + 1.0f);
+    impostorBakeShader->use();
+    impostorBakeShader->set("VP", VP);
+    impostorBakeShader->set("tex", 0);
+    // Every part is painted with the unlit color of its material, since the impostors are lit when they are drawn
+    auto paint = [&](Material* material) {
+        auto* tinted = dynamic_cast<TintedMaterial*>(material);
+        auto* textured = dynamic_cast<TexturedMaterial*>(material);
+        auto* lit = dynamic_cast<LitMaterial*>(material);
+        glm::vec4 color = tinted ? tinted->tint : glm::vec4(1.0f);
+        if (lit) color *= glm::vec4(lit->diffuse, 1.0f);
+        impostorBakeShader->set("tint", color);
+        impostorBakeShader->set("textureScale", lit ? glm::vec2(lit->diffuseTextureScale) : glm::vec2(1.0f));
+        impostorBakeShader->set("alphaThreshold", textured ? textured->alphaThreshold : 0.0f);
+        impostorBakeShader->set("has_texture", textured && textured->texture);
+        if (textured && textured->texture) {
+            textured->texture->bind(0);
+            if (textured->sampler) textured->sampler->bind(0);
+            else gl_state::bindSampler(0, 0);
+        }
+    };
+    if (mesh->getSubmeshCount() > 0) {
+        for (size_t i = 0; i < mesh->getSubmeshCount(); i++) {
+            paint(instancedRenderer->getMaterialForSubmesh(mesh->getSubmesh(i).materialName));
+            mesh->drawSubmesh(i);
+        }
+    } else {
+        paint(instancedRenderer->material);
+        mesh->draw();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &frameBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    picture->bind();
+    glGenerateMipmap(GL_TEXTURE_2D);
+    instancedRenderer->impostorTexture = picture;
+}
+
 void ForwardRenderer::setStaticParams(const float maxHealth,
                                       const float health) {
     postprocessUniforms.maxHealth = maxHealth;
@@ -7,10 +7,16 @@
 #include "../asset-loader.hpp"
 #include "../common/components/instanced-renderer.hpp"
 #include "../components/player.hpp"
+#include "render-queue.hpp"
+#include "static-batcher.hpp"
+#include "light-clusters.hpp"
+#include "../bounding-volume-hierarchy.hpp"
+#include "../occlusion-culler.hpp"
 
 #include <glad/gl.h>
 #include <vector>
 #include <algorithm>
+#include <unordered_set>
 
 namespace our
 {
@@ -20,12 +26,28 @@ namespace our
     // The renderer will fill this struct using the mesh renderer components
     struct RenderCommand {
         glm::mat4 localToWorld;
-        glm::vec3 center;
+        glm::vec3 center; // The center of the bounds (used to sort the commands by depth)
+        glm::vec3 minBound, maxBound; // The bounds of the mesh (or submesh) in the world space (used for culling)
         Mesh* mesh;
         Material* material;
         int submeshIndex = -1; // -1 means draw entire mesh, >= 0 means draw specific submesh
+        std::uint64_t state = 0; // The shader, material and mesh part of the sort key (see "RenderQueue::makeState")
     };
 
+    // The "FrameData" uniform block (std140) which is shared by the lit, lit-instanced, impostor and sky shaders.
+    // It is uploaded once per frame, so the draws only set their own uniforms. It must match the block in the shaders.
+    // The lights themselves are in buffer textures (see "LightClusters"), which start at the "light...Offset" texels.
+    struct FrameUniforms {
+        glm::vec3 cameraPosition; GLint directionalLightCount;
+        glm::vec3 fogColor; GLint fogEnabled;
+        GLfloat fogStart, fogEnd, horizonThreshold; GLint hasSpotlightCookie;
+        glm::vec3 cameraForward; GLfloat clusterNear;
+        glm::ivec3 clusterGrid; GLfloat clusterDepthScale;
+        glm::vec2 viewportSize; GLint lightDataOffset, lightClustersOffset;
+        GLint lightIndicesOffset; GLint padding[3];
+    };
+    static_assert(sizeof(FrameUniforms) == 112, "FrameUniforms must follow the std140 layout");
+
     struct StaticPostprocessUniforms {
         float maxHealth;
         float health;
@@ -39,17 +61,75 @@ namespace our
     class ForwardRenderer {
         // These window size will be used on multiple occasions (setting the viewport, computing the aspect ratio, etc.)
         glm::ivec2 windowSize;
-        // These are two vectors in which we will store the opaque and the transparent commands.
-        // We define them here (instead of being local to the "render" function) as an optimization to prevent reallocating them every frame
-        std::vector<RenderCommand> opaqueCommands;
-        std::vector<RenderCommand> transparentCommands;
+        // This is the vector in which we will store the opaque and the transparent commands, and the queue which orders them.
+        // The commands are retained between frames: they are rebuilt when the structure of the world changes (see "World::getStructureVersion")
+        // and otherwise only the commands of the entities whose transforms changed are updated.
+        std::vector<RenderCommand> renderCommands;
+        std::unordered_map<const Entity*, std::pair<std::uint32_t, std::uint32_t>> commandRanges; // The first command and the command count of each entity
+        const World* commandsWorld = nullptr; // The world and the structure version from which the commands were built
+        std::uint64_t commandsVersion = 0;
+        std::uint64_t commandsIdGeneration = 0; // The render queue's id generation when the commands were built
+        std::vector<Entity*> changedEntities; // The entities whose transforms changed since the last frame
+        RenderQueue renderQueue;
+        // The batches of the static mesh renderers. They are only rebuilt when the static renderers (or their meshes and materials)
+        // change, or when a static entity moves after all.
+        StaticBatcher staticBatcher;
+        float staticBatchCellSize = 64.0f;
+        std::vector<const void*> staticSignature; // The renderers, meshes and materials from which the batches were built
+        std::unordered_set<const Entity*> staticEntities;
+        bool staticBatchesDirty = true;
+        // The commands of the static entities (and the static batches) are culled through a hierarchy which is built with
+        // the commands, while the other commands are culled one by one.
+        BoundingVolumeHierarchy staticHierarchy;
+        std::vector<std::uint32_t> dynamicCommands;
+        std::vector<std::uint32_t> visibleCommands;
+        // The commands farther than this distance are culled (0 means no limit). It defaults to "fog_end" since the fog
+        // hides everything beyond it.
+        float cullDistance = 0.0f;
+        // The software occlusion culling. The occluders are simplified copies of the static occluder renderers (see
+        // "MeshRendererComponent::isOccluder"), rebuilt with the static batches. Every frame, they are rasterized on the CPU
+        // and the commands and instance cells that are hidden behind them are dropped before drawing.
+        OcclusionCuller occlusionCuller;
+        bool occlusionCulling = true;
+        float occluderRatio = 0.25f; // The ratio of the triangles kept when simplifying the occluders
+        // The depth pre-pass draws the depth of the opaque commands and instances first (with position only shaders), so
+        // the opaque pass then only shades the visible fragments (with GL_EQUAL and without writing the depth).
+        // The depth materials are filled from the drawn material before each setup: [instanced][alpha tested].
+        bool depthPrepass = false;
+        LitMaterial* depthMaterials[2][2] = {};
         // Vector to store light components for lighting calculations
         std::vector<LightComponent *> lightCommands;
+        // The lights are binned into the clusters of the camera's frustum every frame, so each fragment only loops over
+        // the lights that can reach it
+        LightClusters lightClusters;
+        // Instead of the clusters, the lights can be assigned per draw: each command (or range of instances) gets the
+        // brightest lights that reach its bounds, up to "objectLightCount" ("light_assignment": "per_object" in the config)
+        bool objectLights = false;
+        int objectLightCount = LightClusters::MAX_OBJECT_LIGHTS;
         // Objects used for rendering a skybox
         Mesh* skySphere;
         TexturedMaterial* skyMaterial;
         // Frustum
         Frustum frustum;
+        // Objects used for drawing the impostors of the instanced renderers. The impostors have no vertex attributes
+        // (their corners come from gl_VertexID), but OpenGL still needs a vertex array to be bound.
+        ShaderProgram* impostorShader = nullptr;
+        ShaderProgram* impostorBakeShader = nullptr;
+        Sampler* impostorSampler = nullptr;
+        PipelineState impostorPipelineState;
+        GLuint impostorVertexArray = 0;
+        // The uniforms of the impostor shader. Like the materials' handles (see "Material::setup"), they are resolved when the
+        // shader is first used, since it may still be linking in "initialize".
+        struct ImpostorUniforms {
+            UniformHandle<glm::mat4> VP;
+            UniformHandle<bool> compactInstances;
+            UniformHandle<glm::vec3> minBound, maxBound;
+            UniformHandle<GLint> tex, instanceOffset, objectLightCount;
+            UniformHandle<glm::ivec4> objectLights[2];
+        } impostorUniforms;
+        const ShaderProgram* impostorUniformsShader = nullptr; // The shader from which "impostorUniforms" were resolved
+        // The width of the baked impostor pictures in pixels (the height follows the mesh's proportions)
+        static constexpr int IMPOSTOR_RESOLUTION = 256;
         // Objects used for Postprocessing
         GLuint postprocessFrameBuffer, postProcessVertexArray;
         Texture2D *colorTarget, *depthTarget;
@@ -63,7 +143,41 @@ namespace our
         float fogEnd = 100.0f;
         float horizonThreshold = 0.3f;
         // Spotlight cookie texture
+        static constexpr const char* SPOTLIGHT_COOKIE_FILE = "assets/textures/flashlight_cookie.png";
         Texture2D* spotlightCookie = nullptr;
+        // The per frame data, streamed every frame and bound to "uniform_blocks::FRAME"
+        size_t frameUniformAlignment = 256;
+        FrameUniforms frameUniforms;
+
+        // Bins the lights into the clusters of the camera, then fills the per frame uniform buffer and binds the per frame textures
+        void uploadFrameUniforms(const glm::vec3& cameraPosition, const glm::vec3& cameraForward, const glm::mat4& view,
+                                 const glm::mat4& projection);
+        // Builds the commands of every mesh renderer in the world (the batchable parts of the static ones are drawn by the static batches)
+        void rebuildCommands(World* world);
+        // Builds the occluders of the occlusion culling from the given static occluder renderers
+        void buildOccluders(const std::vector<MeshRendererComponent*>& occluders);
+        // Updates the matrices of the commands whose entities moved since the last frame
+        void patchCommands(World* world);
+        // Returns the depth only version of a material, or null if the material doesn't take part in the depth pre-pass
+        // (transparent or not writing the depth). "instanced" picks the shader of the instanced renderers.
+        Material* getDepthMaterial(const Material* material, bool instanced);
+        // Switches the depth test of a material that was just set up to GL_EQUAL (without depth writes) if its depth
+        // was drawn by the pre-pass
+        void useDepthPrepass(const Material* material);
+        // Picks the lights of a draw from its world bounds and sets them to its shader (only when the lights are assigned per object)
+        void setObjectLights(ShaderProgram* shader, UniformHandle<GLint> countUniform, const UniformHandle<glm::ivec4>* lightsUniform,
+                             const std::pair<glm::vec3, glm::vec3>& bounds);
+        // Draws the sorted commands of the given pass (only their depth if "depthOnly" is true).
+        // A material is only set up when it differs from the previous command's.
+        void drawPass(RenderPass pass, const glm::mat4& VP, bool depthOnly = false);
+        // Draws the visible instances of an instanced renderer (culled by "updateVisibleInstances"), one instanced draw
+        // per range of each level of detail, then the impostors (which are skipped when "depthOnly" is true)
+        void drawInstances(InstancedRendererComponent* instancedRenderer, const glm::mat4& VP, bool depthOnly = false);
+        // Paints a picture of an instanced renderer's mesh (seen from the side, with the unlit colors of its materials)
+        // into its impostor texture. It uses its own framebuffer, so it must be called before the frame starts drawing.
+        void bakeImpostor(InstancedRendererComponent* instancedRenderer);
+        // The pool used to cull the large instance sets in parallel (null means the culling runs on the calling thread)
+        ThreadPool* threadPool = nullptr;
         // Cached camera and player component pointers
         CameraComponent *camera = nullptr;
         PlayerComponent *playerComp = nullptr;
@@ -73,11 +187,17 @@ namespace our
         void initialize(glm::ivec2 windowSize, const nlohmann::json& config);
         // Clean up the renderer
         void destroy();
+        // Returns the defines of the features that the given renderer config fixes for the whole session (the fog and the
+        // spotlight cookie). The lit shaders and the sky are compiled with them so they don't need to branch on them.
+        static std::vector<std::string> getShaderFeatures(const nlohmann::json& config);
         // This function should be called every frame to draw the given world
         void render(World *world, float deltaTime = 0.016f);
 
         void setStaticParams(const float maxHealth, const float health);
 
+        // Sets the pool used for the culling (it must not be running the systems while "render" is called)
+        void setThreadPool(ThreadPool* pool) { threadPool = pool; }
+
         const Frustum& getFrustum() const;
 
     };
@@ -34,6 +34,7 @@ class FreeCameraControllerSystem {
     float bobbingSway = 0.09f;
     std::map<std::string, int> controlKeys;
     bool flashlightKeyWasPressed = false;  // For detecting key press edge
+    glm::vec2 pendingMouseDelta = glm::vec2(0.0f);  // Mouse movement collected since the last update
 
     void playFlashlightSound(AudioController* audio, const std::string& soundFile) {
         if (!audio) return;
@@ -90,6 +91,7 @@ class FreeCameraControllerSystem {
         this->physics = physicsSystem;
         loadControls();
         mouse_locked = true;
+        pendingMouseDelta = glm::vec2(0.0f);
         app->getMouse().lockMouse(app->getWindow());
 
         // Manually sync mouse position to where lockMouse centered it
@@ -104,8 +106,15 @@ class FreeCameraControllerSystem {
         playerComp = nullptr;
     }
 
-    // This should be called every frame to update all entities containing a
-    // FreeCameraControllerComponent
+    // This should be called once every rendered frame. Since the update may
+    // run zero or several times per frame (at the simulation tick rate), the
+    // mouse movement is accumulated here and consumed by the next update.
+    void collectInput() {
+        pendingMouseDelta += app->getMouse().getMouseDelta();
+    }
+
+    // This should be called every simulation tick to update all entities
+    // containing a FreeCameraControllerComponent
     void update(World* world, float deltaTime) {
         // First of all, we search for an entity containing both a
         // CameraComponent and a FreeCameraControllerComponent As soon as we
@@ -116,23 +125,19 @@ class FreeCameraControllerSystem {
 
         // Get player component for later use
         if (!playerComp) {
-            for (auto entity : world->getEntities()) {
-                auto pc = entity->getComponent<PlayerComponent>();
-                if (pc) {
-                    playerComp = pc;
-                    break;
-                }
+            if (auto* playerEntity = world->getSingleton<PlayerComponent>()) {
+                playerComp = playerEntity->getComponent<PlayerComponent>();
             }
         }
 
-        for (auto e : world->getEntities()) {
-            camera = e->getComponent<CameraComponent>();
-            controller = e->getComponent<FreeCameraControllerComponent>();
-            if (camera && controller) {
+        world->forEach<CameraComponent, FreeCameraControllerComponent>(
+            [&](Entity* e, CameraComponent* c,
+                FreeCameraControllerComponent* f) {
+                if (entity) return;
                 entity = e;
-                break;
-            }
-        }
+                camera = c;
+                controller = f;
+            });
 
         // If there is no entity with both a CameraComponent and a
         // FreeCameraControllerComponent, we can do nothing so we return
@@ -153,9 +158,11 @@ class FreeCameraControllerSystem {
 
         glm::vec3& position = entity->localTransform.position;
         glm::vec3& rotation = entity->localTransform.rotation;
+        entity->markTransformDirty();
 
         // Mouse look
-        glm::vec2 delta = app->getMouse().getMouseDelta();
+        glm::vec2 delta = pendingMouseDelta;
+        pendingMouseDelta = glm::vec2(0.0f);
         rotation.x -= delta.y * controller->rotationSensitivity;
         rotation.y -= delta.x * controller->rotationSensitivity;
 
@@ -215,10 +222,9 @@ class FreeCameraControllerSystem {
         }
 
         if (physics && physics->isPlayerInitialized()) {
-            // Physics-based movement - Bullet handles timing internally via
-            // stepSimulation
-            physics->movePlayer(moveDir * current_sensitivity.x *
-                                0.016f);  // Use fixed timestep (~60fps)
+            // Physics-based movement - the walk direction is applied once per
+            // bullet step, which is exactly one simulation tick
+            physics->movePlayer(moveDir * current_sensitivity.x * deltaTime);
 
             // Get physics position and offset for eye height
             glm::vec3 physPos = physics->getPlayerPosition();
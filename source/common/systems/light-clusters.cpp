@@ -0,0 +1,276 @@
+#include "light-clusters.hpp"
+
+#include "../ecs/entity.hpp"
+#include "../shader/shader.hpp"
+#include "../stream-buffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace our {
+
+    void LightClusters::setGridSize(const glm::ivec3& size) {
+        gridSize = glm::max(size, glm::ivec3(1));
+        clusterBounds.clear();
+    }
+
+    float LightClusters::getLightRange(const LightComponent* light, float cutoff) {
+        // The range is where "brightness / (c + l d + q d^2)" equals the cutoff, i.e. q d^2 + l d + (c - brightness / cutoff) = 0
+        float brightness = std::max({light->color.r, light->color.g, light->color.b});
+        float c = light->attenuation.x - brightness / cutoff;
+        float l = light->attenuation.y, q = light->attenuation.z;
+        if (brightness <= 0.0f || c >= 0.0f) return 0.0f;
+        if (q > 0.0f) return (-l + std::sqrt(l * l - 4.0f * q * c)) / (2.0f * q);
+        if (l > 0.0f) return -c / l;
+        return INFINITY;
+    }
+
+    void LightClusters::buildClusterBounds(const glm::mat4& projection, float far) {
+        clusterBounds.resize((size_t)gridSize.x * gridSize.y * gridSize.z);
+        boundsProjection = projection;
+        boundsFar = far;
+        // The view space point at a given depth that is projected to the given NDC (x, y). It works for both the
+        // perspective and the orthographic projections since x & y only depend on their own axis and the depth.
+        const glm::mat4& P = projection;
+        auto unproject = [&](float ndcX, float ndcY, float depth) {
+            float z = -depth;
+            float w = P[2][3] * z + P[3][3];
+            return glm::vec3((ndcX * w - P[2][0] * z - P[3][0]) / P[0][0], (ndcY * w - P[2][1] * z - P[3][1]) / P[1][1], z);
+        };
+        for (int z = 0; z < gridSize.z; z++) {
+            float nearDepth = near * std::exp(z / depthScale), farDepth = near * std::exp((z + 1) / depthScale);
+            for (int y = 0; y < gridSize.y; y++) {
+                float y0 = -1.0f + 2.0f * y / gridSize.y, y1 = -1.0f + 2.0f * (y + 1) / gridSize.y;
+                for (int x = 0; x < gridSize.x; x++) {
+                    float x0 = -1.0f + 2.0f * x / gridSize.x, x1 = -1.0f + 2.0f * (x + 1) / gridSize.x;
+                    ClusterBounds bounds{glm::vec3(INFINITY), glm::vec3(-INFINITY)};
+                    for (int i = 0; i < 8; i++) {
+                        glm::vec3 corner = unproject((i & 1) ? x1 : x0, (i & 2) ? y1 : y0, (i & 4) ? farDepth : nearDepth);
+                        bounds.minBound = glm::min(bounds.minBound, corner);
+                        bounds.maxBound = glm::max(bounds.maxBound, corner);
+                    }
+                    clusterBounds[x + gridSize.x * (y + gridSize.y * z)] = bounds;
+                }
+            }
+        }
+    }
+
+    void LightClusters::setLights(const std::vector<LightComponent*>& lights) {
+        // The directional lights come first since every fragment loops over them
+        lightData.clear();
+        lightRanges.clear();
+        for (int directional = 1; directional >= 0; directional--) {
+            for (LightComponent* light : lights) {
+                if ((light->lightType == LightType::DIRECTIONAL) != (directional == 1)) continue;
+                // The clusters refer to the lights with 16 bit indices
+                if (lightData.size() > UINT16_MAX) break;
+                float range = directional ? 0.0f : getLightRange(light, cutoff);
+                if (!directional && range <= 0.0f) continue;
+                glm::mat4 lightMatrix = light->getOwner()->getLocalToWorldMatrix();
+                LightData data;
+                data.type = (GLfloat)(int)light->lightType;
+                data.position = glm::vec3(lightMatrix * glm::vec4(0, 0, 0, 1));
+                data.direction = glm::normalize(glm::vec3(lightMatrix * glm::vec4(light->direction, 0.0f)));
+                data.color = light->getEffectiveColor();
+                data.attenuation = light->attenuation;
+                data.innerConeAngle = light->inner_cone_angle;
+                data.outerConeAngle = light->outer_cone_angle;
+                data.isFlashlight = light->isFlashlight ? 1.0f : 0.0f;
+                lightData.push_back(data);
+                lightRanges.push_back(range);
+            }
+            if (directional) directionalLightCount = (int)lightData.size();
+        }
+    }
+
+    void LightClusters::build(const glm::mat4& view, const glm::mat4& projection, float nearDepth, float farDepth) {
+        near = std::max(nearDepth, 0.01f);
+        float far = std::max(farDepth, near * 1.01f);
+        depthScale = gridSize.z / std::log(far / near);
+        if (clusterBounds.empty() || projection != boundsProjection || far != boundsFar) buildClusterBounds(projection, far);
+
+        // Find the (cluster, light) pairs. The light's sphere is first reduced to a box of clusters (the slices between its
+        // nearest and farthest depths and the tiles covered by its projection), then tested against each cluster's bounds.
+        pairs.clear();
+        auto sliceOf = [&](float depth) {
+            return glm::clamp((int)std::floor(std::log(depth / near) * depthScale), 0, gridSize.z - 1);
+        };
+        for (size_t index = directionalLightCount; index < lightData.size(); index++) {
+            const LightData& light = lightData[index];
+            float range = lightRanges[index];
+            glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            float depth = -center.z;
+            if (depth + range < near || depth - range > far) continue;
+
+            glm::ivec3 first(0), last = gridSize - 1;
+            if (depth - range > near) first.z = sliceOf(depth - range);
+            if (depth + range < far) last.z = sliceOf(depth + range);
+            // If the sphere is completely in front of the near plane, the projection of its box covers its tiles
+            if (depth - range > near) {
+                glm::vec2 minNDC(INFINITY), maxNDC(-INFINITY);
+                for (int i = 0; i < 8; i++) {
+                    glm::vec3 corner = center + glm::vec3((i & 1) ? range : -range, (i & 2) ? range : -range,
+                                                          (i & 4) ? range : -range);
+                    glm::vec4 clip = projection * glm::vec4(corner, 1.0f);
+                    glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                    minNDC = glm::min(minNDC, ndc);
+                    maxNDC = glm::max(maxNDC, ndc);
+                }
+                if (maxNDC.x < -1.0f || maxNDC.y < -1.0f || minNDC.x > 1.0f || minNDC.y > 1.0f) continue;
+                glm::vec2 size(gridSize.x, gridSize.y);
+                minNDC = glm::max(minNDC, glm::vec2(-1.0f));
+                maxNDC = glm::min(maxNDC, glm::vec2(1.0f));
+                glm::ivec2 minTile(glm::floor((minNDC * 0.5f + 0.5f) * size)), maxTile(glm::floor((maxNDC * 0.5f + 0.5f) * size));
+                first.x = std::max(first.x, minTile.x);
+                first.y = std::max(first.y, minTile.y);
+                last.x = std::min(last.x, maxTile.x);
+                last.y = std::min(last.y, maxTile.y);
+            }
+
+            // The spot lights also skip the clusters outside their cone (tested with the cluster's bounding sphere).
+            // The cones wider than a half space are treated like point lights.
+            bool cone = light.type == (GLfloat)(int)LightType::SPOT && light.outerConeAngle > 0.0f;
+            glm::vec3 coneDirection = glm::normalize(glm::mat3(view) * light.direction);
+            float coneCos = light.outerConeAngle, coneSin = std::sqrt(std::max(0.0f, 1.0f - coneCos * coneCos));
+
+            for (int z = first.z; z <= last.z; z++) {
+                for (int y = first.y; y <= last.y; y++) {
+                    for (int x = first.x; x <= last.x; x++) {
+                        std::uint32_t cluster = x + gridSize.x * (y + gridSize.y * z);
+                        const ClusterBounds& bounds = clusterBounds[cluster];
+                        glm::vec3 nearest = glm::clamp(center, bounds.minBound, bounds.maxBound) - center;
+                        if (glm::dot(nearest, nearest) > range * range) continue;
+                        if (cone) {
+                            glm::vec3 clusterCenter = (bounds.minBound + bounds.maxBound) * 0.5f;
+                            float clusterRadius = glm::length(bounds.maxBound - bounds.minBound) * 0.5f;
+                            glm::vec3 toCluster = clusterCenter - center;
+                            float along = glm::dot(toCluster, coneDirection);
+                            float across = std::sqrt(std::max(0.0f, glm::dot(toCluster, toCluster) - along * along));
+                            // The distance from the cluster's center to the cone's side, then to its base and its apex
+                            if (coneCos * across - coneSin * along > clusterRadius) continue;
+                            if (along > clusterRadius + range || along < -clusterRadius) continue;
+                        }
+                        pairs.emplace_back(cluster, (std::uint16_t)index);
+                    }
+                }
+            }
+        }
+
+        // Group the pairs by cluster (a counting sort, which keeps the lights of each cluster in order)
+        clusterRanges.assign(clusterBounds.size(), glm::uvec2(0));
+        for (const auto& pair : pairs) clusterRanges[pair.first].y++;
+        std::uint32_t offset = 0;
+        for (glm::uvec2& range : clusterRanges) {
+            range.x = offset;
+            offset += range.y;
+            range.y = 0;
+        }
+        lightIndices.resize(pairs.size());
+        for (const auto& [cluster, light] : pairs) {
+            glm::uvec2& range = clusterRanges[cluster];
+            lightIndices[range.x + range.y++] = light;
+        }
+    }
+
+    int LightClusters::selectLights(const glm::vec3& minBound, const glm::vec3& maxBound, int maxCount, GLint* indices) const {
+        maxCount = std::min(maxCount, MAX_OBJECT_LIGHTS);
+        float scores[MAX_OBJECT_LIGHTS];
+        int count = 0;
+        glm::vec3 boxCenter = (minBound + maxBound) * 0.5f;
+        float boxRadius = glm::length(maxBound - minBound) * 0.5f;
+        for (size_t index = directionalLightCount; index < lightData.size(); index++) {
+            const LightData& light = lightData[index];
+            float range = lightRanges[index];
+            glm::vec3 nearest = glm::clamp(light.position, minBound, maxBound) - light.position;
+            float distanceSquared = glm::dot(nearest, nearest);
+            if (distanceSquared > range * range) continue;
+            // The spot lights must also reach the box with their cone (tested with the box's bounding sphere)
+            if (light.type == (GLfloat)(int)LightType::SPOT && light.outerConeAngle > 0.0f) {
+                glm::vec3 toBox = boxCenter - light.position;
+                float along = glm::dot(toBox, light.direction);
+                float across = std::sqrt(std::max(0.0f, glm::dot(toBox, toBox) - along * along));
+                float coneSin = std::sqrt(std::max(0.0f, 1.0f - light.outerConeAngle * light.outerConeAngle));
+                if (light.outerConeAngle * across - coneSin * along > boxRadius || along < -boxRadius) continue;
+            }
+            // The intensity at the nearest point of the box (an insertion into the sorted list of the brightest lights)
+            float distance = std::sqrt(distanceSquared);
+            float score = std::max({light.color.r, light.color.g, light.color.b}) /
+                          (light.attenuation.x + light.attenuation.y * distance + light.attenuation.z * distanceSquared);
+            if (count == maxCount && (count == 0 || score <= scores[count - 1])) continue;
+            int position = count < maxCount ? count++ : count - 1;
+            while (position > 0 && scores[position - 1] < score) {
+                scores[position] = scores[position - 1];
+                indices[position] = indices[position - 1];
+                position--;
+            }
+            scores[position] = score;
+            indices[position] = (GLint)index;
+        }
+        return count;
+    }
+
+    void LightClusters::upload() {
+        // The data is streamed (see "stream_buffer") and the buffer textures view the stream buffer from the data's
+        // offsets. "ARB_texture_buffer_range" lets a texture start at the offset, otherwise the texture covers the whole
+        // stream buffer and the shaders add the offset (in texels) to their reads.
+        // An empty buffer texture is not allowed, so at least one texel is uploaded.
+        static const bool hasRange = GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_texture_buffer_range;
+        static const size_t alignment = [] {
+            GLint rangeAlignment = 0;
+            if (hasRange) glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &rangeAlignment);
+            return std::max<size_t>(rangeAlignment, sizeof(LightData));
+        }();
+        const std::uint8_t zeros[sizeof(LightData)] = {};
+        struct Upload {
+            const void* data;
+            size_t size, texelSize;
+            GLuint& texture;
+            GLenum format;
+            GLint unit;
+            int& texelOffset;
+            GLintptr offset = 0;
+        } uploads[] = {
+            {lightData.data(), lightData.size() * sizeof(LightData), sizeof(glm::vec4), lightTexture, GL_RGBA32F,
+             reserved_texture_units::LIGHT_DATA, texelOffsets.x},
+            {clusterRanges.data(), clusterRanges.size() * sizeof(glm::uvec2), sizeof(glm::uvec2), clusterTexture, GL_RG32UI,
+             reserved_texture_units::LIGHT_CLUSTERS, texelOffsets.y},
+            {lightIndices.data(), lightIndices.size() * sizeof(std::uint16_t), sizeof(std::uint16_t), indexTexture, GL_R16UI,
+             reserved_texture_units::LIGHT_INDICES, texelOffsets.z},
+        };
+
+        // The three uploads must end up in the same buffer
+        size_t total = 0;
+        for (auto& upload : uploads) {
+            if (upload.size == 0) {
+                upload.data = zeros;
+                upload.size = upload.texelSize;
+            }
+            total += upload.size + alignment;
+        }
+        stream_buffer::reserve(total);
+        for (auto& upload : uploads) upload.offset = stream_buffer::upload(upload.data, upload.size, alignment);
+
+        GLuint buffer = stream_buffer::getBuffer();
+        for (auto& upload : uploads) {
+            if (!upload.texture) glGenTextures(1, &upload.texture);
+            gl_state::bindBufferTexture(upload.unit, upload.texture);
+            if (hasRange) {
+                glTexBufferRange(GL_TEXTURE_BUFFER, upload.format, buffer, upload.offset, (GLsizeiptr)upload.size);
+                upload.texelOffset = 0;
+            } else {
+                glTexBuffer(GL_TEXTURE_BUFFER, upload.format, buffer);
+                upload.texelOffset = (int)(upload.offset / upload.texelSize);
+            }
+        }
+    }
+
+    void LightClusters::destroy() {
+        for (GLuint* texture : {&lightTexture, &clusterTexture, &indexTexture}) {
+            if (!*texture) continue;
+            gl_state::forgetTexture(*texture);
+            glDeleteTextures(1, texture);
+            *texture = 0;
+        }
+    }
+
+}
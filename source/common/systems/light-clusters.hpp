@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../components/light.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace our {
+
+    // The data of a single light as read by the lit shaders from the "light_data" buffer texture (4 RGBA32F texels).
+    // It must match "read_light" in the shaders.
+    struct LightData {
+        glm::vec3 position; GLfloat type;
+        glm::vec3 direction; GLfloat innerConeAngle;
+        glm::vec3 color; GLfloat outerConeAngle;
+        glm::vec3 attenuation; GLfloat isFlashlight;
+    };
+    static_assert(sizeof(LightData) == 64, "LightData must be 4 tightly packed vec4");
+
+    // Clustered light culling for the forward renderer. The view frustum is split into a grid of clusters (tiles of the
+    // screen times slices of the depth, the slices growing exponentially with the distance) and every point and spot light
+    // is added to the clusters that its range (and its cone) touches. A fragment then only loops over the lights of its
+    // cluster (plus the directional lights, which reach everywhere), so the cost per pixel doesn't grow with the number
+    // of lights in the scene.
+    // "build" only runs on the CPU (so it can be checked without a GPU), then "upload" streams the result to the buffer
+    // textures bound to the reserved units "LIGHT_DATA", "LIGHT_CLUSTERS" and "LIGHT_INDICES".
+    // As a lighter alternative to the clusters, "selectLights" picks the few brightest lights that reach an object's bounds,
+    // which the renderer then gives to the object's draw (see "object_lights" in the lit shaders).
+    class LightClusters {
+    public:
+        // The most lights that "selectLights" picks for an object (the size of "object_lights" in the shaders)
+        static constexpr int MAX_OBJECT_LIGHTS = 8;
+
+        // The lights are cut off where their attenuated intensity falls below this (where the light can't be seen anymore)
+        float cutoff = 1.0f / 256.0f;
+
+        LightClusters() = default;
+        ~LightClusters() { destroy(); }
+
+        // Sets the number of clusters along the screen's x & y and along the depth (it takes effect on the next "build")
+        void setGridSize(const glm::ivec3& size);
+        const glm::ivec3& getGridSize() const { return gridSize; }
+
+        // Replaces the lights (the point and spot lights that are never bright enough to be seen are dropped)
+        void setLights(const std::vector<LightComponent*>& lights);
+        // Bins the lights into the clusters of the given camera. The clusters span the depths from "near" to "far".
+        void build(const glm::mat4& view, const glm::mat4& projection, float near, float far);
+        // Writes the indices (into the light data) of the point and spot lights that reach the given world space box,
+        // the brightest first (by their intensity at the nearest point of the box), and returns how many were written.
+        // At most "maxCount" lights are picked. The directional lights are never picked since they reach everything.
+        int selectLights(const glm::vec3& minBound, const glm::vec3& maxBound, int maxCount, GLint* indices) const;
+        // Streams the lights and the last "build" to the buffer textures and binds them to their reserved units
+        void upload();
+        // Deletes the buffer textures (they are created again by the next "upload")
+        void destroy();
+        // The first texel of the light data, the clusters and the light indices in their buffer textures (since the last
+        // "upload"). The shaders add them to their reads.
+        const glm::ivec3& getTexelOffsets() const { return texelOffsets; }
+
+        // The directional lights are the first lights of the light data, and they are not part of any cluster
+        int getDirectionalLightCount() const { return directionalLightCount; }
+        int getLightCount() const { return (int)lightData.size(); }
+        // The parameters which turn a depth into a slice: slice = log(depth / near) * depthScale
+        float getNear() const { return near; }
+        float getDepthScale() const { return depthScale; }
+        // The lights of a cluster (as indices into the light data). The cluster of the tile (x, y) and the slice z is
+        // x + gridSize.x * (y + gridSize.y * z), the tile (0, 0) being the bottom left one.
+        std::pair<const std::uint16_t*, std::uint32_t> getClusterLights(int cluster) const {
+            return {lightIndices.data() + clusterRanges[cluster].x, clusterRanges[cluster].y};
+        }
+
+        // The range (in world units) at which the attenuated intensity of a point or spot light falls below the cutoff.
+        // It is infinite if the light doesn't attenuate and 0 if it is never bright enough to be seen.
+        static float getLightRange(const LightComponent* light, float cutoff);
+
+        LightClusters(LightClusters const&) = delete;
+        LightClusters& operator=(LightClusters const&) = delete;
+
+    private:
+        // The bounds of a cluster in the view space
+        struct ClusterBounds {
+            glm::vec3 minBound, maxBound;
+        };
+
+        glm::ivec3 gridSize = glm::ivec3(16, 9, 24);
+        float near = 0.1f, depthScale = 1.0f;
+        int directionalLightCount = 0;
+
+        // The view space bounds of the clusters, rebuilt when the projection or the depth range changes
+        std::vector<ClusterBounds> clusterBounds;
+        glm::mat4 boundsProjection = glm::mat4(0.0f);
+        float boundsFar = 0.0f;
+
+        std::vector<LightData> lightData;
+        std::vector<float> lightRanges; // The range of each light (0 for the directional ones)
+        std::vector<glm::uvec2> clusterRanges; // (first index, count) of each cluster in "lightIndices"
+        std::vector<std::uint16_t> lightIndices;
+        std::vector<std::pair<std::uint32_t, std::uint16_t>> pairs; // (cluster, light) pairs (kept to avoid reallocating them)
+
+        GLuint lightTexture = 0, clusterTexture = 0, indexTexture = 0;
+        glm::ivec3 texelOffsets = glm::ivec3(0);
+
+        void buildClusterBounds(const glm::mat4& projection, float far);
+    };
+
+}
@@ -11,20 +11,23 @@
 #include "../common/components/page.hpp"
 #include "../common/components/player.hpp"
 #include "../common/components/slenderman.hpp"
-#include "../common/ecs/entity.hpp"
+#include "../common/ecs/world.hpp"
 #include "../common/systems/text-renderer.hpp"
 #include "physics-system.hpp"
 #include "../debug-utils.hpp"
+#include "../shader/shader-cache.hpp"
 
 namespace our {
 
 class PageSystem {
    public:
-    Entity* player = nullptr;
-    Entity* slenderman = nullptr;
-    Entity* pageSpawner = nullptr;
+    // The entities are referred to by handles so that using a deleted entity is detected
+    World* world = nullptr;
+    EntityHandle player;
+    EntityHandle slenderman;
+    EntityHandle pageSpawner;
     int totalPages = 0;
-    std::vector<Entity*> spawnedPages;
+    std::vector<EntityHandle> spawnedPages;
     our::ShaderProgram* pageShader = nullptr;
     float pageSphereSize = 0.5f;
     // Physics reference
@@ -33,7 +36,7 @@ class PageSystem {
     TextRenderer* textRenderer = nullptr;
     glm::vec2 screenSize = glm::vec2(1280, 720);
     // Map Entity to its collision body for cleanup
-    std::unordered_map<Entity*, btRigidBody*> pageColliders;
+    std::unordered_map<EntityHandle, btRigidBody*> pageColliders;
 
     // Raycast parameters
     float interactionDistance = 1.7f;  // Max distance player can interact
@@ -45,6 +48,7 @@ class PageSystem {
     void initialize(World* world, PhysicsSystem* physicsSystem,
                     TextRenderer* textRenderer,
                     const glm::ivec2& screenSizeParam) {
+        this->world = world;
         this->physics = physicsSystem;
         this->textRenderer = textRenderer;
         this->screenSize = screenSizeParam;
@@ -53,31 +57,21 @@ class PageSystem {
         // Clear any existing data
         spawnedPages.clear();
         pageColliders.clear();
-        if (pageShader) {
-            delete pageShader;
-            pageShader = nullptr;
-        }
 
-        for (auto entity : world->getEntities()) {
-            if (entity->getComponent<PlayerComponent>()) {
-                player = entity;
-            }
-            if (entity->getComponent<SlendermanComponent>()) {
-                slenderman = entity;
-            }
-            if (entity->getComponent<PageSpawnerComponent>()) {
-                pageSpawner = entity;
-            }
-        }
+        Entity* spawnerEntity = world->getSingleton<PageSpawnerComponent>();
+        player = world->getHandle(world->getSingleton<PlayerComponent>());
+        slenderman =
+            world->getHandle(world->getSingleton<SlendermanComponent>());
+        pageSpawner = world->getHandle(spawnerEntity);
 
-        if (!player || !slenderman || !pageSpawner) {
+        if (player.isNull() || slenderman.isNull() || pageSpawner.isNull()) {
             std::cerr << "PageSystem: Player, Slenderman, or PageSpawner "
                          "entity not found!"
                       << std::endl;
         }
 
         // Get total pages and page textures from spawner component
-        auto* spawnerComp = pageSpawner->getComponent<PageSpawnerComponent>();
+        auto* spawnerComp = spawnerEntity->getComponent<PageSpawnerComponent>();
         totalPages = spawnerComp->totalPages;
         std::vector<std::string> pageTextures = spawnerComp->pageTextures;
 
@@ -100,10 +94,11 @@ class PageSystem {
         if (our::g_debugMode) {
             std::cout << "Spawning " << totalPages << " pages." << std::endl;
         }
-        pageShader = new our::ShaderProgram();
-        pageShader->attach("assets/shaders/lit.vert", GL_VERTEX_SHADER);
-        pageShader->attach("assets/shaders/lit.frag", GL_FRAGMENT_SHADER);
-        pageShader->link();
+        // The shader is kept between sessions (see "removePages")
+        if (!pageShader) {
+            pageShader = our::ShaderCache::get("assets/shaders/lit.vert",
+                                               "assets/shaders/lit.frag");
+        }
 
         // Select spawn locations ensuring minimum distance between pages
         std::vector<std::pair<glm::vec3, glm::vec3>> selectedSpawns;
@@ -147,6 +142,7 @@ class PageSystem {
             pageEntity->name = "Page_" + std::to_string(i);
             pageEntity->localTransform.position = selectedSpawns[i].first;
             pageEntity->localTransform.rotation = selectedSpawns[i].second;
+            pageEntity->markTransformDirty();
 
             if (our::g_debugMode)
                 std::cout << "PageSystem: Spawning page " << i << " at ("
@@ -184,7 +180,7 @@ class PageSystem {
             auto* pageComp = pageEntity->addComponent<PageComponent>();
             pageComp->isCollected = false;
 
-            spawnedPages.push_back(pageEntity);
+            spawnedPages.push_back(world->getHandle(pageEntity));
 
             // Register collider in physics system
             registerPageCollider(pageEntity);
@@ -195,9 +191,13 @@ class PageSystem {
                       << " pages" << std::endl;
     }
 
-    void destroy() {
+    // Removes the pages of the current session (their materials, textures
+    // and colliders) but keeps the page shader for the next session
+    void removePages() {
         // Destroy all uncollected pages
-        for (Entity* page : spawnedPages) {
+        for (EntityHandle handle : spawnedPages) {
+            Entity* page = world ? world->get(handle) : nullptr;
+            if (!page) continue;
             auto* pageComp = page->getComponent<PageComponent>();
             if (pageComp && !pageComp->isCollected) {
                 // Delete the material and texture
@@ -225,12 +225,12 @@ class PageSystem {
             physics->removeBody(pair.second);
         }
         pageColliders.clear();
+    }
 
-        // Cleanup shader
-        if (pageShader) {
-            delete pageShader;
-            pageShader = nullptr;
-        }
+    void destroy() {
+        removePages();
+        // The shader belongs to the shader cache
+        pageShader = nullptr;
     }
 
     void registerPageCollider(Entity* entity) {
@@ -245,12 +245,13 @@ class PageSystem {
             entity  // Store entity pointer for identification
         );
 
-        pageColliders[entity] = body;
+        pageColliders[world->getHandle(entity)] = body;
     }
 
     // Call this when player looks at center of screen and clicks interact
     void update(World* world, float deltaTime, const glm::vec3& cameraPos,
                 const glm::vec3& cameraForward, bool interactPressed) {
+        Entity* player = world ? world->get(this->player) : nullptr;
         if (!player || !physics) return;
         // Store camera info for debug rendering
         lastCameraPos = cameraPos;
@@ -281,7 +282,7 @@ class PageSystem {
         playerComp->collectedPages++;
 
         // Remove collider from physics world
-        auto it = pageColliders.find(entity);
+        auto it = pageColliders.find(world->getHandle(entity));
         if (it != pageColliders.end()) {
             physics->removeBody(it->second);
             pageColliders.erase(it);
@@ -308,6 +309,8 @@ class PageSystem {
     }
 
     bool allPagesCollected() const {
+        Entity* player = world ? world->get(this->player) : nullptr;
+        if (!player) return false;
         return player->getComponent<PlayerComponent>()->collectedPages >=
                totalPages;
     }
@@ -315,7 +318,7 @@ class PageSystem {
    private:
     void onPageCollected(PlayerComponent* playerComp) {
         // Increase Slenderman aggression
-        if (slenderman) {
+        if (Entity* slenderman = world->get(this->slenderman)) {
             auto* slenderComp = slenderman->getComponent<SlendermanComponent>();
             if (slenderComp) {
                 slenderComp->teleportCooldown *= 0.9f;  // Teleports more often
@@ -323,7 +326,10 @@ class PageSystem {
         }
 
         // Play collection sound
-        auto* audioComp = pageSpawner->getComponent<AudioController>();
+        Entity* spawnerEntity = world->get(pageSpawner);
+        auto* audioComp =
+            spawnerEntity ? spawnerEntity->getComponent<AudioController>()
+                          : nullptr;
         if (audioComp) {
             // Must uninitialize before reinitializing to avoid miniaudio crash
             audioComp->uninitializeMusic();
@@ -84,9 +84,9 @@ class PhysicsSystem {
             auto instancedRenderer = entity->getComponent<InstancedRendererComponent>();
             if (collisionMesh && instancedRenderer && instancedRenderer->mesh)
             {
-                for (const auto& instanceMat : instancedRenderer->InstanceMats)
+                for (const auto& instance : instancedRenderer->instances)
                 {
-                    addMeshCollision(instancedRenderer->mesh, instanceMat, entity);
+                    addMeshCollision(instancedRenderer->mesh, instance.toMatrix(), entity);
                 }
             }
 
@@ -178,9 +178,12 @@ class PhysicsSystem {
         {
             return characterController ? characterController->onGround() : false;
         }
-    void update(float deltaTime) {
+    // Advances the simulation by "deltaTime". Bullet splits it into steps of "fixedTimeStep" (up to "maxSubSteps" of them).
+    // When the caller already runs at a fixed rate, it should pass its tick length as both "deltaTime" and "fixedTimeStep"
+    // with a single sub step, so that every call is exactly one bullet step.
+    void update(float deltaTime, int maxSubSteps = 10, float fixedTimeStep = 1.0f / 60.0f) {
         if (dynamicsWorld) {
-            dynamicsWorld->stepSimulation(deltaTime, 10);
+            dynamicsWorld->stepSimulation(deltaTime, maxSubSteps, fixedTimeStep);
         }
     }
 
@@ -390,8 +393,9 @@ class PhysicsSystem {
 
     btDiscreteDynamicsWorld* getWorld() { return dynamicsWorld; }
 
-  void destroy() {
-    // Clean up player controller first
+  // Removes the player's character controller while keeping the static world,
+  // so that the next "initializePlayerCollider" starts the player from scratch
+  void removePlayerCollider() {
     if (characterController) {
         if (dynamicsWorld) {
             dynamicsWorld->removeAction(characterController);
@@ -415,6 +419,11 @@ class PhysicsSystem {
 
     // Reset player initialized flag
     playerInitialized = false;
+  }
+
+  void destroy() {
+    // Clean up player controller first
+    removePlayerCollider();
 
     if (dynamicsWorld) {
         // Remove all rigid bodies
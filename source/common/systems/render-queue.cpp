@@ -0,0 +1,70 @@
+#include "render-queue.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace our {
+
+    std::uint32_t RenderQueue::IdMap::get(const void* object, std::uint64_t& generation) {
+        auto it = ids.find(object);
+        if (it != ids.end()) return it->second;
+        if (ids.size() >= capacity) {
+            ids.clear();
+            generation++;
+        }
+        std::uint32_t id = (std::uint32_t)ids.size();
+        ids.emplace(object, id);
+        return id;
+    }
+
+    std::uint64_t RenderQueue::makeState(const void* shader, const void* material, const void* mesh) {
+        return ((std::uint64_t)shaderIds.get(shader, idGeneration) << (MATERIAL_BITS + MESH_BITS)) |
+               ((std::uint64_t)materialIds.get(material, idGeneration) << MESH_BITS) |
+               (std::uint64_t)meshIds.get(mesh, idGeneration);
+    }
+
+    void RenderQueue::resetIds() {
+        shaderIds.clear();
+        materialIds.clear();
+        meshIds.clear();
+    }
+
+    void RenderQueue::push(RenderPass pass, std::uint64_t state, float depth, float maxDepth, std::uint32_t command) {
+        // Quantize the depth into DEPTH_BITS (anything behind the camera counts as 0 and anything beyond maxDepth as the maximum)
+        const std::uint64_t maxQuantizedDepth = (1ull << DEPTH_BITS) - 1;
+        float normalized = maxDepth > 0.0f ? std::clamp(depth / maxDepth, 0.0f, 1.0f) : 0.0f;
+        std::uint64_t quantizedDepth = (std::uint64_t)(normalized * (float)maxQuantizedDepth);
+
+        std::uint64_t key = (std::uint64_t)pass << (64 - PASS_BITS);
+        if (pass == RenderPass::TRANSPARENT_PASS) {
+            key |= ((maxQuantizedDepth - quantizedDepth) << (SHADER_BITS + MATERIAL_BITS + MESH_BITS)) | state;
+        } else {
+            key |= (state << DEPTH_BITS) | quantizedDepth;
+        }
+        entries.push_back({key, command});
+    }
+
+    void RenderQueue::sort() {
+        // A least significant digit radix sort with 8 bit digits. It is stable, so the commands with equal keys keep their order.
+        // The digits in which all the keys are equal are skipped (e.g. the pass bits or the ids when there are only a few objects).
+        if (entries.size() < 2) return;
+        std::uint64_t differing = 0;
+        for (const Entry& entry : entries) differing |= entry.key ^ entries[0].key;
+
+        scratch.resize(entries.size());
+        for (int shift = 0; shift < 64; shift += 8) {
+            if (((differing >> shift) & 0xFF) == 0) continue;
+            size_t offsets[256] = {};
+            for (const Entry& entry : entries) offsets[(entry.key >> shift) & 0xFF]++;
+            size_t total = 0;
+            for (size_t& offset : offsets) {
+                size_t count = offset;
+                offset = total;
+                total += count;
+            }
+            for (const Entry& entry : entries) scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+            entries.swap(scratch);
+        }
+    }
+
+}
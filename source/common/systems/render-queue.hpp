@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace our {
+
+    // The passes of the render queue, in the order in which they are drawn
+    enum class RenderPass : std::uint64_t {
+        OPAQUE_PASS = 0, // Not "OPAQUE" since windows.h defines it as a macro
+        TRANSPARENT_PASS = 1
+    };
+
+    // The render queue sorts the render commands of a frame by a packed 64 bit key, so that the commands which share a shader,
+    // a material and a mesh end up next to each other and the renderer only changes the state when it actually differs.
+    // The key is laid out as follows (most significant bits first):
+    // - Opaque:      pass (2) | shader (12) | material (14) | mesh (14) | depth (22), so the state changes as rarely as possible
+    //                and the objects that share the same state are drawn front to back.
+    // - Transparent: pass (2) | inverted depth (22) | shader (12) | material (14) | mesh (14), so they are drawn back to front
+    //                (which is required for blending) and the state only breaks ties.
+    // The shaders, materials and meshes are given small ids (stable across frames) that fit in their part of the key.
+    class RenderQueue {
+    public:
+        struct Entry {
+            std::uint64_t key;
+            std::uint32_t command; // The index of the command in the renderer's command list
+        };
+
+        static constexpr int PASS_BITS = 2, SHADER_BITS = 12, MATERIAL_BITS = 14, MESH_BITS = 14, DEPTH_BITS = 22;
+
+        // Removes the entries of the previous frame (the object ids are kept)
+        void clear() { entries.clear(); }
+        // Packs the ids of the shader, the material and the mesh into the state part of a key.
+        // Since it doesn't change from frame to frame, it can be computed once per command and kept.
+        std::uint64_t makeState(const void* shader, const void* material, const void* mesh);
+        // Adds a command to the queue. "state" comes from "makeState", "depth" is the distance of the command along the
+        // camera's forward direction and "maxDepth" is the distance beyond which all depths are considered equal (e.g. the camera's far plane).
+        void push(RenderPass pass, std::uint64_t state, float depth, float maxDepth, std::uint32_t command);
+        // Sorts the entries by their keys (using a radix sort since the keys are plain integers)
+        void sort();
+
+        const std::vector<Entry>& getEntries() const { return entries; }
+        // Forgets the ids of all the objects (the states made before must not be used anymore)
+        void resetIds();
+        // Changes whenever the ids run out and are given again, which makes the states made before collide with the new
+        // ones, so they must be made again (see "ForwardRenderer::rebuildCommands")
+        std::uint64_t getIdGeneration() const { return idGeneration; }
+        // Returns the pass that the given key belongs to
+        static RenderPass getPass(std::uint64_t key) { return (RenderPass)(key >> (64 - PASS_BITS)); }
+
+    private:
+        // Gives every object a small id which stays the same as long as the object is used.
+        // If the ids run out, they are all given again and "generation" is incremented.
+        class IdMap {
+            std::unordered_map<const void*, std::uint32_t> ids;
+            std::uint32_t capacity;
+        public:
+            explicit IdMap(int bits) : capacity(1u << bits) {}
+            std::uint32_t get(const void* object, std::uint64_t& generation);
+            void clear() { ids.clear(); }
+        };
+
+        std::vector<Entry> entries;
+        std::vector<Entry> scratch; // Used by the radix sort (kept to avoid reallocating it every frame)
+        IdMap shaderIds{SHADER_BITS}, materialIds{MATERIAL_BITS}, meshIds{MESH_BITS};
+        std::uint64_t idGeneration = 0;
+    };
+
+}
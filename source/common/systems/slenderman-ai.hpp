@@ -16,8 +16,10 @@
 namespace our {
 class SlendermanAISystem {
    public:
-    Entity* player = nullptr;
-    Entity* slenderman = nullptr;
+    // Handles to the player and slenderman entities (resolved through the world so that a deleted entity is detected)
+    World* world = nullptr;
+    EntityHandle player;
+    EntityHandle slenderman;
     float gameTime = 0.0f;  // Track total game time for AI difficulty scaling
 
     // Random number generator
@@ -107,12 +109,11 @@ class SlendermanAISystem {
     void initialize(World* world) {
         gameTime = 0.0f;  // Reset game time on initialization
         // Initialization logic if needed
-        for (auto entity : world->getEntities()) {
-            if (entity->getComponent<PlayerComponent>()) player = entity;
-            if (entity->getComponent<SlendermanComponent>())
-                slenderman = entity;
-        }
-        if (!player || !slenderman) {
+        this->world = world;
+        player = world->getHandle(world->getSingleton<PlayerComponent>());
+        slenderman =
+            world->getHandle(world->getSingleton<SlendermanComponent>());
+        if (player.isNull() || slenderman.isNull()) {
             throw std::runtime_error(
                 "SlendermanAISystem initialization failed: Player or "
                 "Slenderman entity not found.");
@@ -121,6 +122,8 @@ class SlendermanAISystem {
 
     void update(World* world, float deltaTime, ForwardRenderer* renderer,
                 PhysicsSystem* physics) {
+        Entity* player = world->get(this->player);
+        Entity* slenderman = world->get(this->slenderman);
         if (!player || !slenderman) return;  // Safety check
 
         gameTime += deltaTime;  // Track total game time
@@ -144,6 +147,7 @@ class SlendermanAISystem {
         glm::vec3 direction = glm::normalize(playerPos - slenderPos);
         float yaw = atan2(direction.x, direction.z) + glm::half_pi<float>();
         slenderman->localTransform.rotation = glm::vec3(0.0f, yaw, 0.0f);
+        slenderman->markTransformDirty();
 
         if (slenderComp->debugMode) {
             return;
@@ -303,6 +307,7 @@ class SlendermanAISystem {
                 // If found a valid spawn, teleport
                 if (foundValidSpawn) {
                     slenderman->localTransform.position = newSpawnPos;
+                    slenderman->markTransformDirty();
                 }
             }
         }
@@ -328,6 +333,7 @@ class SlendermanAISystem {
     }
 
     bool playerIsDead() const {
+        Entity* player = world ? world->get(this->player) : nullptr;
         if (!player) return false;
         auto* playerComp = player->getComponent<PlayerComponent>();
         return playerComp && playerComp->health <= 0.0f;
@@ -0,0 +1,183 @@
+#include "static-batcher.hpp"
+
+#include "../ecs/entity.hpp"
+#include "../debug-utils.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+namespace our {
+
+    namespace {
+        // Normalizes a vector unless it is zero (e.g. a missing tangent), in which case it is kept as it is
+        glm::vec3 normalizeOrKeep(const glm::vec3& v) {
+            float length = glm::length(v);
+            return length > 0.0f ? v / length : v;
+        }
+    }
+
+    void StaticBatcher::build(const std::vector<MeshRendererComponent*>& renderers, float cellSize) {
+        clear();
+
+        // A triangle waiting to be batched: the renderer it comes from and the index of its first element in the renderer's mesh
+        struct Triangle {
+            std::uint32_t source;
+            std::uint32_t first;
+        };
+        // The triangles are grouped by (material, cell x, cell z). The materials are given indices in the order in which
+        // they are found, so the batches don't depend on where the materials happen to be allocated.
+        std::vector<Material*> materials;
+        std::unordered_map<Material*, int> materialIndices;
+        std::map<std::tuple<int, int, int>, std::vector<Triangle>> groups;
+        std::vector<glm::mat4> transforms(renderers.size());
+        std::vector<glm::mat3> normalMatrices(renderers.size());
+        size_t sourceRanges = 0;
+
+        for (std::uint32_t source = 0; source < renderers.size(); source++) {
+            MeshRendererComponent* renderer = renderers[source];
+            Mesh* sourceMesh = renderer->mesh;
+            if (!sourceMesh) continue;
+            transforms[source] = renderer->getOwner()->getLocalToWorldMatrix();
+            const glm::mat4& M = transforms[source];
+            normalMatrices[source] = glm::transpose(glm::inverse(glm::mat3(M)));
+            const std::vector<Vertex>& vertices = sourceMesh->getVertices();
+            const std::vector<unsigned int>& elements = sourceMesh->getIndices();
+
+            auto addRange = [&](Material* material, size_t first, size_t count) {
+                if (!canBatch(sourceMesh, material)) return;
+                auto [it, inserted] = materialIndices.try_emplace(material, (int)materials.size());
+                if (inserted) materials.push_back(material);
+                sourceRanges++;
+                for (size_t e = first; e + 3 <= first + count; e += 3) {
+                    glm::vec3 centroid = (vertices[elements[e]].position + vertices[elements[e + 1]].position +
+                                          vertices[elements[e + 2]].position) / 3.0f;
+                    centroid = glm::vec3(M * glm::vec4(centroid, 1.0f));
+                    int cellX = 0, cellZ = 0;
+                    if (cellSize > 0.0f) {
+                        cellX = (int)std::floor(centroid.x / cellSize);
+                        cellZ = (int)std::floor(centroid.z / cellSize);
+                    }
+                    groups[{it->second, cellX, cellZ}].push_back({source, (std::uint32_t)e});
+                }
+            };
+
+            if (sourceMesh->getSubmeshCount() > 0) {
+                for (const Submesh& submesh : sourceMesh->getSubmeshes()) {
+                    addRange(renderer->getMaterialForSubmesh(submesh.materialName), submesh.elementOffset, submesh.elementCount);
+                }
+            } else {
+                addRange(renderer->material, 0, elements.size());
+            }
+        }
+        if (groups.empty()) return;
+
+        // Each batch gets its own copy of the vertices it uses, so its vertices are contiguous and its elements start from 0
+        std::vector<Vertex> batchedVertices;
+        std::vector<unsigned int> batchedElements;
+        std::vector<Submesh> submeshes;
+        std::unordered_map<std::uint64_t, unsigned int> remap; // (source << 32 | source vertex) -> index in the batch
+        size_t triangleCount = 0;
+
+        for (const auto& [key, triangles] : groups) {
+            Submesh submesh;
+            submesh.elementOffset = (GLsizei)batchedElements.size();
+            submesh.baseVertex = (GLint)batchedVertices.size();
+            remap.clear();
+
+            for (const Triangle& triangle : triangles) {
+                const Mesh* sourceMesh = renderers[triangle.source]->mesh;
+                const std::vector<Vertex>& vertices = sourceMesh->getVertices();
+                const std::vector<unsigned int>& elements = sourceMesh->getIndices();
+                for (std::uint32_t k = 0; k < 3; k++) {
+                    unsigned int sourceVertex = elements[triangle.first + k];
+                    std::uint64_t remapKey = ((std::uint64_t)triangle.source << 32) | sourceVertex;
+                    auto [it, inserted] = remap.try_emplace(remapKey, (unsigned int)(batchedVertices.size() - submesh.baseVertex));
+                    if (inserted) {
+                        const glm::mat4& M = transforms[triangle.source];
+                        Vertex vertex = vertices[sourceVertex];
+                        vertex.position = glm::vec3(M * glm::vec4(vertex.position, 1.0f));
+                        vertex.normal = normalizeOrKeep(normalMatrices[triangle.source] * vertex.normal);
+                        vertex.tangent = normalizeOrKeep(glm::mat3(M) * vertex.tangent);
+                        submesh.minBound = glm::min(submesh.minBound, vertex.position);
+                        submesh.maxBound = glm::max(submesh.maxBound, vertex.position);
+                        batchedVertices.push_back(vertex);
+                    }
+                    batchedElements.push_back(it->second);
+                }
+            }
+            triangleCount += triangles.size();
+            submesh.elementCount = (GLsizei)batchedElements.size() - submesh.elementOffset;
+            submeshes.push_back(submesh);
+            batches.push_back({materials[std::get<0>(key)]});
+        }
+
+        // In debug mode, check that the batches draw each batchable triangle of the renderers exactly once: the triangles
+        // are enumerated again from the renderers' ranges and compared with the ones found in the batches, every batch
+        // must have 3 elements per triangle of its group, and its elements must stay within its own vertices
+        if (our::g_debugMode) {
+            std::unordered_map<std::uint64_t, int> occurrences; // (source << 32 | first element) -> times it was batched
+            size_t sourceTriangles = 0;
+            for (std::uint32_t source = 0; source < renderers.size(); source++) {
+                const Mesh* sourceMesh = renderers[source]->mesh;
+                if (!sourceMesh) continue;
+                auto countRange = [&](Material* material, size_t first, size_t count) {
+                    if (!canBatch(sourceMesh, material)) return;
+                    for (size_t e = first; e + 3 <= first + count; e += 3) {
+                        occurrences[((std::uint64_t)source << 32) | e] = 0;
+                        sourceTriangles++;
+                    }
+                };
+                if (sourceMesh->getSubmeshCount() > 0) {
+                    for (const Submesh& submesh : sourceMesh->getSubmeshes()) {
+                        countRange(renderers[source]->getMaterialForSubmesh(submesh.materialName), submesh.elementOffset, submesh.elementCount);
+                    }
+                } else {
+                    countRange(renderers[source]->material, 0, sourceMesh->getIndices().size());
+                }
+            }
+
+            size_t batchedTriangles = 0, unknown = 0, badBatches = 0, batchIndex = 0;
+            for (const auto& [key, triangles] : groups) {
+                for (const Triangle& triangle : triangles) {
+                    auto it = occurrences.find(((std::uint64_t)triangle.source << 32) | triangle.first);
+                    if (it == occurrences.end()) unknown++;
+                    else it->second++;
+                }
+                const Submesh& submesh = submeshes[batchIndex];
+                GLint vertexEnd = batchIndex + 1 < submeshes.size() ? submeshes[batchIndex + 1].baseVertex : (GLint)batchedVertices.size();
+                bool valid = (size_t)submesh.elementCount == 3 * triangles.size();
+                for (GLsizei e = 0; e < submesh.elementCount && valid; e++) {
+                    valid = submesh.baseVertex + (GLint)batchedElements[submesh.elementOffset + e] < vertexEnd;
+                }
+                if (!valid) badBatches++;
+                batchedTriangles += submesh.elementCount / 3;
+                batchIndex++;
+            }
+            size_t missing = 0, duplicated = 0;
+            for (const auto& [triangle, count] : occurrences) {
+                if (count == 0) missing++;
+                else if (count > 1) duplicated++;
+            }
+            if (batchedTriangles != sourceTriangles || unknown || missing || duplicated || badBatches) {
+                std::cerr << "ERROR: Static batching drew " << batchedTriangles << " triangles instead of " << sourceTriangles
+                          << " (" << missing << " missing, " << duplicated << " duplicated, " << unknown << " unknown, "
+                          << badBatches << " malformed batches)" << std::endl;
+            }
+        }
+
+        mesh = new Mesh(batchedVertices, batchedElements);
+        mesh->setSubmeshes(submeshes);
+        if (our::g_debugMode) std::cout << "Static batching: merged " << triangleCount << " triangles from " << sourceRanges
+                  << " submeshes into " << batches.size() << " batches (" << materials.size() << " materials)" << std::endl;
+    }
+
+    void StaticBatcher::clear() {
+        delete mesh;
+        mesh = nullptr;
+        batches.clear();
+    }
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../components/mesh-renderer.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace our {
+
+    // The static batcher merges the opaque geometry of the static mesh renderers (see "MeshRendererComponent::isStatic")
+    // into a single mesh whose submeshes are the batches. The triangles are grouped by their material and by the cell of
+    // a grid (on the world's x & z axes) in which they lie, so a batch can be drawn with one call and a material setup
+    // while still being small enough to be culled on its own (its bounds are the bounds of its submesh).
+    // The vertices are transformed to the world space while batching, so the batches are drawn with an identity model matrix.
+    // Each batch owns a contiguous range of the vertex buffer and its elements are relative to that range (see "Submesh::baseVertex").
+    class StaticBatcher {
+    public:
+        struct Batch {
+            Material* material;
+        };
+
+        // Returns true if the given part of a static mesh renderer can be merged into a batch
+        // (transparent materials can't since they must be sorted with the other transparent objects)
+        static bool canBatch(const Mesh* mesh, const Material* material) {
+            return mesh && material && !material->transparent && mesh->hasCPUCopy();
+        }
+
+        StaticBatcher() = default;
+        ~StaticBatcher() { clear(); }
+
+        // Merges the batchable geometry of the given renderers (replacing the previous batches).
+        // "cellSize" is the size of the grid cells used to split the batches (0 means that a material is never split).
+        void build(const std::vector<MeshRendererComponent*>& renderers, float cellSize);
+        // Deletes the batches and their mesh
+        void clear();
+
+        // The mesh holding the batches (the index of a batch is the index of its submesh) or null if there are no batches
+        Mesh* getMesh() const { return mesh; }
+        const std::vector<Batch>& getBatches() const { return batches; }
+
+        StaticBatcher(StaticBatcher const&) = delete;
+        StaticBatcher& operator=(StaticBatcher const&) = delete;
+
+    private:
+        Mesh* mesh = nullptr;
+        std::vector<Batch> batches;
+    };
+
+}
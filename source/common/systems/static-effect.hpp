@@ -11,11 +11,8 @@ class StaticEffectSystem {
 
    public:
     void initialize(World* world) {
-        for (auto entity : world->getEntities()) {
-            if (auto* p = entity->getComponent<PlayerComponent>()) {
-                player = p;
-                break;
-            }
+        if (auto* entity = world->getSingleton<PlayerComponent>()) {
+            player = entity->getComponent<PlayerComponent>();
         }
     }
     void update(World* world, ForwardRenderer* renderer) {
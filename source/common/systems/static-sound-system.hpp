@@ -15,22 +15,20 @@ class StaticSoundSystem {
     float crossfadeDuration = 1.0f;  // 1 second crossfade for static (faster)
 
     void initialize(World* world) {
-        for (auto entity : world->getEntities()) {
-            if (entity->getComponent<PlayerComponent>()) {
-                player = entity;
+        if (auto* entity = world->getSingleton<PlayerComponent>()) {
+            player = entity;
 
-                // Get all audio components and find the static sound one
-                auto audioComponents = entity->getComponents<AudioController>();
-                for (auto* audio : audioComponents) {
-                    if (audio->getAudioType() == AudioType::STATIC) {
-                        staticSound = audio;
-                        staticSound->volume = 0.5f;
-                        if (our::g_debugMode) {
-                            std::cout << "Static sound audio controller found."
-                                      << std::endl;
-                        }
-                        break;
+            // Get all audio components and find the static sound one
+            auto audioComponents = entity->getComponents<AudioController>();
+            for (auto* audio : audioComponents) {
+                if (audio->getAudioType() == AudioType::STATIC) {
+                    staticSound = audio;
+                    staticSound->volume = 0.5f;
+                    if (our::g_debugMode) {
+                        std::cout << "Static sound audio controller found."
+                                  << std::endl;
                     }
+                    break;
                 }
             }
         }
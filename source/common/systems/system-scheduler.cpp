@@ -0,0 +1,85 @@
+#include "system-scheduler.hpp"
+
+namespace our {
+
+    SystemScheduler::SystemScheduler(size_t workerCount) : pool(std::make_unique<ThreadPool>(workerCount)) {}
+
+    void SystemScheduler::add(const std::string& name, const SystemAccess& access, std::function<void(float)> update){
+        SystemNode node;
+        node.name = name;
+        node.access = access;
+        node.update = std::move(update);
+        systems.push_back(std::move(node));
+        built = false;
+    }
+
+    void SystemScheduler::clear(){
+        systems.clear();
+        remainingDependencies.reset();
+        built = false;
+    }
+
+    void SystemScheduler::build(){
+        for(auto& system : systems){
+            system.dependents.clear();
+            system.dependencyCount = 0;
+        }
+        // A system depends on every system added before it that it conflicts with.
+        // This keeps the original order between conflicting systems and lets the rest run in parallel.
+        for(size_t later = 0; later < systems.size(); later++){
+            for(size_t earlier = 0; earlier < later; earlier++){
+                if(systems[later].access.conflictsWith(systems[earlier].access)){
+                    systems[earlier].dependents.push_back(later);
+                    systems[later].dependencyCount++;
+                }
+            }
+        }
+        remainingDependencies = std::make_unique<std::atomic<int>[]>(systems.size());
+        built = true;
+    }
+
+    void SystemScheduler::schedule(size_t index){
+        if(systems[index].access.mainThread){
+            std::lock_guard<std::mutex> lock(mainThreadMutex);
+            mainThreadReady.push_back(index);
+        } else {
+            pool->submit([this, index](){ execute(index); });
+        }
+    }
+
+    void SystemScheduler::execute(size_t index){
+        SystemNode& system = systems[index];
+        system.update(frameDeltaTime);
+        for(size_t dependent : system.dependents){
+            if(--remainingDependencies[dependent] == 0) schedule(dependent);
+        }
+        finishedCount++;
+    }
+
+    void SystemScheduler::run(float deltaTime){
+        if(!built) build();
+        frameDeltaTime = deltaTime;
+        finishedCount = 0;
+        for(size_t index = 0; index < systems.size(); index++)
+            remainingDependencies[index] = systems[index].dependencyCount;
+        for(size_t index = 0; index < systems.size(); index++)
+            if(systems[index].dependencyCount == 0) schedule(index);
+
+        while(finishedCount < systems.size()){
+            // Run the ready main thread systems first since no other thread can run them
+            size_t index = 0;
+            bool hasMainThreadSystem = false;
+            {
+                std::lock_guard<std::mutex> lock(mainThreadMutex);
+                if(!mainThreadReady.empty()){
+                    index = mainThreadReady.front();
+                    mainThreadReady.erase(mainThreadReady.begin());
+                    hasMainThreadSystem = true;
+                }
+            }
+            if(hasMainThreadSystem) execute(index);
+            else if(!pool->runPendingTask()) std::this_thread::yield();
+        }
+    }
+
+}
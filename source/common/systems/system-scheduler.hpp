@@ -0,0 +1,92 @@
+#pragma once
+
+#include "../ecs/component-type.hpp"
+#include "../thread-pool.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace our {
+
+    // Shared state that is not stored in components but is still touched by the systems
+    namespace SystemResource {
+        constexpr std::uint32_t TRANSFORMS = 1 << 0; // The local transforms and the cached matrices of the entities
+        constexpr std::uint32_t PHYSICS    = 1 << 1; // The bullet world (stepping it writes, raycasts read)
+        constexpr std::uint32_t RENDERER   = 1 << 2; // The forward renderer state (e.g. frustum, postprocess uniforms)
+        constexpr std::uint32_t INPUT      = 1 << 3; // The keyboard, the mouse and the window
+    }
+
+    // Describes what a system reads and writes. Two systems conflict (and must not run at the same time) if one
+    // of them writes something that the other reads or writes.
+    // Example: SystemAccess().read<PlayerComponent>().write<SlendermanComponent>().writeResource(SystemResource::TRANSFORMS)
+    struct SystemAccess {
+        ComponentMask componentReads = 0, componentWrites = 0;
+        std::uint32_t resourceReads = 0, resourceWrites = 0;
+        bool mainThread = false; // If true, the system will always run on the main thread (e.g. if it uses OpenGL or GLFW)
+
+        template<typename... T> SystemAccess& read() { componentReads |= getComponentMask<T...>(); return *this; }
+        template<typename... T> SystemAccess& write() { componentWrites |= getComponentMask<T...>(); return *this; }
+        SystemAccess& readResource(std::uint32_t resources) { resourceReads |= resources; return *this; }
+        SystemAccess& writeResource(std::uint32_t resources) { resourceWrites |= resources; return *this; }
+        SystemAccess& onMainThread() { mainThread = true; return *this; }
+
+        // Returns true if the two systems can't run at the same time
+        bool conflictsWith(const SystemAccess& other) const {
+            return (componentWrites & (other.componentReads | other.componentWrites)) ||
+                   (other.componentWrites & componentReads) ||
+                   (resourceWrites & (other.resourceReads | other.resourceWrites)) ||
+                   (other.resourceWrites & resourceReads);
+        }
+    };
+
+    // The system scheduler runs the per-frame updates of the systems.
+    // Each system is added with its access description. The order in which the systems are added defines the order
+    // between conflicting systems, so every system depends on the previously added systems that it conflicts with.
+    // Every frame, the systems whose dependencies are done are started: the ones that must run on the main thread are
+    // executed by the thread calling "run", the rest are handed to a work stealing thread pool.
+    // While waiting, the main thread also helps with the pool's tasks.
+    class SystemScheduler {
+        struct SystemNode {
+            std::string name;
+            SystemAccess access;
+            std::function<void(float)> update;
+            std::vector<size_t> dependents; // The systems that must wait for this one
+            int dependencyCount = 0; // The number of systems that this one waits for
+        };
+        std::vector<SystemNode> systems;
+        std::unique_ptr<std::atomic<int>[]> remainingDependencies; // Per system, the number of dependencies still running this frame
+        std::unique_ptr<ThreadPool> pool;
+        bool built = false;
+
+        // The main thread systems that are ready to run in the current frame
+        std::mutex mainThreadMutex;
+        std::vector<size_t> mainThreadReady;
+        std::atomic<size_t> finishedCount{0};
+        float frameDeltaTime = 0.0f;
+
+        // Builds the dependency graph
+        void build();
+        // Starts the given system (either queues it for the main thread or submits it to the pool)
+        void schedule(size_t index);
+        // Runs the given system then starts its dependents that became ready
+        void execute(size_t index);
+    public:
+        // Creates the scheduler. If the worker count is 0, it is chosen based on the number of hardware threads.
+        explicit SystemScheduler(size_t workerCount = 0);
+
+        // Adds a system update to the scheduler
+        void add(const std::string& name, const SystemAccess& access, std::function<void(float)> update);
+        // Removes all the systems
+        void clear();
+        // Runs the updates of all the systems once and returns when they are all done
+        void run(float deltaTime);
+        // The pool running the systems. Other work (e.g. the renderer's culling) may use it while the systems are not running.
+        ThreadPool& getThreadPool() { return *pool; }
+    };
+
+}
@@ -1,9 +1,11 @@
 #include "text-renderer.hpp"
+#include "../shader/shader-cache.hpp"
+#include "../stream-buffer.hpp"
 #include <iostream>
  
 namespace our {
 
-TextRenderer::TextRenderer() : textShader(nullptr), VAO(0), VBO(0), face(nullptr) {
+TextRenderer::TextRenderer() : textShader(nullptr), VAO(0), face(nullptr) {
     // Initialize FreeType
     if (FT_Init_FreeType(&ft)) {
         std::cerr << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
@@ -11,21 +13,13 @@ TextRenderer::TextRenderer() : textShader(nullptr), VAO(0), VBO(0), face(nullptr
     }
     
     // Create shader for text rendering
-    textShader = new ShaderProgram();
-    textShader->attach("assets/shaders/text.vert", GL_VERTEX_SHADER);
-    textShader->attach("assets/shaders/text.frag", GL_FRAGMENT_SHADER);
-    textShader->link();
+    textShader = ShaderCache::get("assets/shaders/text.vert", "assets/shaders/text.frag");
     
-    // Configure VAO/VBO for texture quads
+    // Configure the VAO for texture quads (the quads are streamed, so the attribute is pointed at them when drawing)
     glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+    gl_state::bindVertexArray(VAO);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    gl_state::bindVertexArray(0);
     
     // Load default font
     loadFont("assets/fonts/arial.ttf", 48);
@@ -34,6 +28,7 @@ TextRenderer::TextRenderer() : textShader(nullptr), VAO(0), VBO(0), face(nullptr
 TextRenderer::~TextRenderer() {
     // Clean up character textures
     for (auto& pair : characters) {
+        gl_state::forgetTexture(pair.second.textureID);
         glDeleteTextures(1, &pair.second.textureID);
     }
     
@@ -44,15 +39,14 @@ TextRenderer::~TextRenderer() {
     FT_Done_FreeType(ft);
     
     // Clean up OpenGL resources
+    gl_state::forgetVertexArray(VAO);
     glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    
-    delete textShader;
 }
 
 bool TextRenderer::loadFont(const std::string& fontPath, unsigned int fontSize) {
     // Clear existing characters
     for (auto& pair : characters) {
+        gl_state::forgetTexture(pair.second.textureID);
         glDeleteTextures(1, &pair.second.textureID);
     }
     characters.clear();
@@ -80,7 +74,7 @@ bool TextRenderer::loadFont(const std::string& fontPath, unsigned int fontSize)
         // Generate texture
         unsigned int texture;
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        gl_state::bindTexture(texture);
         glTexImage2D(
             GL_TEXTURE_2D,
             0,
@@ -109,29 +103,31 @@ bool TextRenderer::loadFont(const std::string& fontPath, unsigned int fontSize)
         characters.insert(std::pair<char, Character>(c, character));
     }
     
-    glBindTexture(GL_TEXTURE_2D, 0);
+    gl_state::bindTexture(0);
     
     return true;
 }
 
 void TextRenderer::renderText(const std::string& text, glm::vec2 position, float scale, glm::vec4 color, const glm::mat4& projection) {
     if (!textShader) return;
-    glBindSampler(0, 0);
+    gl_state::bindSampler(0, 0);
     // Activate corresponding render state
     textShader->use();
     textShader->set("projection", projection);
     textShader->set("textColor", color);
     
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(VAO);
+    gl_state::activeTexture(0);
+    gl_state::bindVertexArray(VAO);
     
     // Enable blending
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_state::setEnabled(GL_BLEND, true);
+    gl_state::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
-    // Iterate through all characters
+    // Build the quads of all the characters, so they are uploaded at once
     float x = position.x;
     float y = position.y;
+    glyphVertices.clear();
+    glyphTextures.clear();
     
     for (char c : text) {
         if (characters.find(c) == characters.end()) continue;
@@ -144,8 +140,7 @@ void TextRenderer::renderText(const std::string& text, glm::vec2 position, float
         float w = ch.size.x * scale;
         float h = ch.size.y * scale;
         
-        // Update VBO for each character
-        float vertices[6][4] = {
+        glyphVertices.insert(glyphVertices.end(), {
             { xpos,     ypos + h,   0.0f, 1.0f },
             { xpos,     ypos,       0.0f, 0.0f },
             { xpos + w, ypos,       1.0f, 0.0f },
@@ -153,26 +148,29 @@ void TextRenderer::renderText(const std::string& text, glm::vec2 position, float
             { xpos,     ypos + h,   0.0f, 1.0f },
             { xpos + w, ypos,       1.0f, 0.0f },
             { xpos + w, ypos + h,   1.0f, 1.0f }
-        };
-        
-        // Render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.textureID);
-        
-        // Update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        
-        // Render quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        });
+        glyphTextures.push_back(ch.textureID);
         
         // Advance cursor for next glyph (note that advance is number of 1/64 pixels)
         x += (ch.advance >> 6) * scale; // Bitshift by 6 to get value in pixels (2^6 = 64)
     }
     
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glDisable(GL_BLEND);
+    if (!glyphTextures.empty()) {
+        // Stream the quads (see "stream_buffer") and point the VAO at them
+        GLintptr offset = stream_buffer::upload(glyphVertices.data(), glyphVertices.size() * sizeof(glm::vec4), sizeof(glm::vec4));
+        glBindBuffer(GL_ARRAY_BUFFER, stream_buffer::getBuffer());
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)offset);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        
+        // Render each glyph texture over its quad
+        for (size_t i = 0; i < glyphTextures.size(); i++) {
+            gl_state::bindTexture(glyphTextures[i]);
+            glDrawArrays(GL_TRIANGLES, (GLint)(6 * i), 6);
+        }
+    }
+    
+    gl_state::bindTexture(0);
+    gl_state::setEnabled(GL_BLEND, false);
 }
 
 glm::vec2 TextRenderer::measureText(const std::string& text, float scale) {
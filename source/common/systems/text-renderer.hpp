@@ -33,7 +33,10 @@ private:
     FT_Library ft;
     FT_Face face;
     ShaderProgram* textShader;
-    unsigned int VAO, VBO;
+    unsigned int VAO;
+    // The quads and the glyph textures of the text being drawn (kept to avoid reallocating them)
+    std::vector<glm::vec4> glyphVertices;
+    std::vector<GLuint> glyphTextures;
     std::map<char, Character> characters;
     std::vector<TimedText> timedTexts;
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/gl.h>
+#include "../gl-state.hpp"
 #include <json/json.hpp>
 #include <glm/vec4.hpp>
 
@@ -18,17 +19,18 @@ namespace our {
 
         // This deconstructor deletes the underlying OpenGL sampler
         ~Sampler() { 
+            gl_state::forgetSampler(name);
             glDeleteSamplers(1, &name);
          }
 
         // This method binds this sampler to the given texture unit
         void bind(GLuint textureUnit) const {
-            glBindSampler(textureUnit, name);
+            gl_state::bindSampler(textureUnit, name);
         }
 
         // This static method ensures that no sampler is bound to the given texture unit
         static void unbind(GLuint textureUnit){
-            glBindSampler(textureUnit, 0);
+            gl_state::bindSampler(textureUnit, 0);
         }
 
         // This function sets a sampler paramter where the value is of type "GLint"
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/gl.h>
+#include "../gl-state.hpp"
 
 namespace our {
 
@@ -16,6 +17,7 @@ namespace our {
 
         // This deconstructor deletes the underlying OpenGL texture
         ~Texture2D() { 
+            gl_state::forgetTexture(name);
             glDeleteTextures(1, &name);
         }
 
@@ -24,14 +26,19 @@ namespace our {
             return name;
         }
 
-        // This method binds this texture to GL_TEXTURE_2D
+        // This method binds this texture to GL_TEXTURE_2D (of the active texture unit)
         void bind() const {
-            glBindTexture(GL_TEXTURE_2D, name);
+            gl_state::bindTexture(name);
+        }
+
+        // This method binds this texture to GL_TEXTURE_2D of the given texture unit
+        void bind(GLuint textureUnit) const {
+            gl_state::bindTexture(textureUnit, name);
         }
 
         // This static method ensures that no texture is bound to GL_TEXTURE_2D
         static void unbind(){
-            glBindTexture(GL_TEXTURE_2D, 0);
+            gl_state::bindTexture(0);
         }
 
         Texture2D(const Texture2D&) = delete;
@@ -0,0 +1,114 @@
+#include "thread-pool.hpp"
+
+#include <algorithm>
+
+namespace our {
+
+    // The index of the worker running on the current thread (-1 if the current thread is not a worker)
+    static thread_local long currentWorker = -1;
+
+    ThreadPool::ThreadPool(size_t workerCount){
+        if(workerCount == 0){
+            unsigned int hardwareThreads = std::thread::hardware_concurrency();
+            workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+        for(size_t index = 0; index < workerCount; index++)
+            queues.push_back(std::make_unique<TaskQueue>());
+        for(size_t index = 0; index < workerCount; index++)
+            workers.emplace_back(&ThreadPool::workerLoop, this, index);
+    }
+
+    ThreadPool::~ThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for(auto& worker : workers) worker.join();
+    }
+
+    void ThreadPool::submit(std::function<void()> task){
+        size_t index = currentWorker >= 0 ? (size_t)currentWorker : nextQueue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        {
+            // The counter is changed under the sleep mutex so that a worker can't miss the wake up
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            pendingTasks++;
+        }
+        wakeUp.notify_one();
+    }
+
+    bool ThreadPool::takeTask(size_t preferredQueue, std::function<void()>& task){
+        {
+            TaskQueue& own = *queues[preferredQueue];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if(!own.tasks.empty()){
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                pendingTasks--;
+                return true;
+            }
+        }
+        for(size_t offset = 1; offset < queues.size(); offset++){
+            TaskQueue& victim = *queues[(preferredQueue + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if(!victim.tasks.empty()){
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                pendingTasks--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ThreadPool::runPendingTask(){
+        if(pendingTasks <= 0) return false;
+        std::function<void()> task;
+        size_t start = currentWorker >= 0 ? (size_t)currentWorker : nextQueue++ % queues.size();
+        if(!takeTask(start, task)) return false;
+        task();
+        return true;
+    }
+
+    void ThreadPool::parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& body){
+        if(count == 0) return;
+        if(chunkSize == 0) chunkSize = count;
+        size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+        if(chunkCount == 1 || workers.empty()){
+            body(0, count);
+            return;
+        }
+        // The first chunk is kept for the calling thread, which then helps with the rest until they are all done
+        std::atomic<size_t> remaining{chunkCount - 1};
+        for(size_t chunk = 1; chunk < chunkCount; chunk++){
+            size_t begin = chunk * chunkSize, end = std::min(count, begin + chunkSize);
+            submit([&body, &remaining, begin, end](){
+                body(begin, end);
+                remaining.fetch_sub(1, std::memory_order_release);
+            });
+        }
+        body(0, chunkSize);
+        while(remaining.load(std::memory_order_acquire) > 0){
+            if(!runPendingTask()) std::this_thread::yield();
+        }
+    }
+
+    void ThreadPool::workerLoop(size_t index){
+        currentWorker = (long)index;
+        while(true){
+            std::function<void()> task;
+            if(takeTask(index, task)){
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [this](){ return stopping || pendingTasks > 0; });
+            if(stopping && pendingTasks <= 0) return;
+        }
+    }
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace our {
+
+    // A work stealing thread pool.
+    // Every worker has its own task queue. A worker takes tasks from the back of its own queue (the most recently
+    // submitted ones) and when it runs out, it steals from the front of the other workers' queues, so the load
+    // stays balanced without all the workers fighting over a single queue.
+    // Threads that are not part of the pool (e.g. the main thread) can help by calling "runPendingTask".
+    class ThreadPool {
+        struct TaskQueue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+        std::vector<std::unique_ptr<TaskQueue>> queues; // One queue per worker
+        std::vector<std::thread> workers;
+        std::mutex sleepMutex; // Used with "wakeUp" to put the idle workers to sleep
+        std::condition_variable wakeUp;
+        std::atomic<long> pendingTasks{0}; // The number of submitted tasks that were not picked yet
+        std::atomic<size_t> nextQueue{0}; // Used to spread the tasks submitted from outside the pool over the queues
+        bool stopping = false;
+
+        // Takes a task from the given queue (from its back) or steals one from another queue (from its front)
+        bool takeTask(size_t preferredQueue, std::function<void()>& task);
+        // The loop executed by each worker
+        void workerLoop(size_t index);
+    public:
+        // Creates the pool with the given number of workers.
+        // If the count is 0, it uses one worker per hardware thread except the one used by the main thread.
+        explicit ThreadPool(size_t workerCount = 0);
+        ~ThreadPool();
+
+        // Returns the number of worker threads
+        size_t getWorkerCount() const { return workers.size(); }
+
+        // Adds a task to the pool. If called from a worker, the task goes to that worker's queue.
+        void submit(std::function<void()> task);
+        // Runs one pending task on the calling thread. Returns false if there was no task to run.
+        bool runPendingTask();
+        // Calls "body(begin, end)" on consecutive chunks of [0, count) of at most "chunkSize" items. The chunks run on the
+        // workers and on the calling thread, and the function returns once all of them are done.
+        void parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& body);
+
+        // The pool owns its threads so it should not be copyable
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool &operator=(ThreadPool const &) = delete;
+    };
+
+}
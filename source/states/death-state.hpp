@@ -9,7 +9,7 @@
 #include <mesh/mesh-utils.hpp>
 #include <mesh/mesh.hpp>
 #include <random>
-#include <shader/shader.hpp>
+#include <shader/shader-cache.hpp>
 #include <texture/texture-utils.hpp>
 #include <texture/texture2d.hpp>
 
@@ -75,12 +75,8 @@ class DeathState : public our::State {
         postprocessSampler->set(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         postprocessSampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-        postprocessShader = new our::ShaderProgram();
-        postprocessShader->attach("assets/shaders/fullscreen.vert",
-                                  GL_VERTEX_SHADER);
-        postprocessShader->attach("assets/shaders/postprocess/static.frag",
-                                  GL_FRAGMENT_SHADER);
-        postprocessShader->link();
+        postprocessShader = our::ShaderCache::get("assets/shaders/fullscreen.vert",
+                                                  "assets/shaders/postprocess/static.frag");
 
         // Get Slenderman material from AssetLoader
         slendermanMaterial = dynamic_cast<our::TexturedMaterial*>(
@@ -186,12 +182,11 @@ class DeathState : public our::State {
         glViewport(0, 0, size.x, size.y);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glDisable(GL_DEPTH_TEST);
+        our::gl_state::setEnabled(GL_DEPTH_TEST, false);
         postprocessShader->use();
 
         // Bind the color target texture
-        glActiveTexture(GL_TEXTURE0);
-        colorTarget->bind();
+        colorTarget->bind(0);
         postprocessSampler->bind(0);
         postprocessShader->set("tex", 0);
 
@@ -202,13 +197,12 @@ class DeathState : public our::State {
         postprocessShader->set("time", (float)glfwGetTime());
 
         // Draw fullscreen triangle (renders static)
-        glBindVertexArray(postProcessVertexArray);
+        our::gl_state::bindVertexArray(postProcessVertexArray);
         glDrawArrays(GL_TRIANGLES, 0, 3);
-        glBindVertexArray(0);
 
         // === DRAW SLENDERMAN ON TOP OF STATIC ===
         if (showSlenderman && slendermanMesh && slendermanMaterial) {
-            glEnable(GL_DEPTH_TEST);
+            our::gl_state::setEnabled(GL_DEPTH_TEST, true);
             glClear(GL_DEPTH_BUFFER_BIT);  // Clear depth only so Slenderman
                                            // draws on top
 
@@ -240,7 +234,7 @@ class DeathState : public our::State {
 
         // Render "GAME OVER" text after fade
         if (canExit && textRenderer) {
-            glDisable(GL_DEPTH_TEST);
+            our::gl_state::setEnabled(GL_DEPTH_TEST, false);
 
             std::string gameOverText = "GAME OVER";
             float textScale = 1.5f;
@@ -291,6 +285,7 @@ class DeathState : public our::State {
             postprocessFrameBuffer = 0;
         }
         if (postProcessVertexArray) {
+            our::gl_state::forgetVertexArray(postProcessVertexArray);
             glDeleteVertexArrays(1, &postProcessVertexArray);
             postProcessVertexArray = 0;
         }
@@ -302,10 +297,8 @@ class DeathState : public our::State {
             delete depthTarget;
             depthTarget = nullptr;
         }
-        if (postprocessShader) {
-            delete postprocessShader;
-            postprocessShader = nullptr;
-        }
+        // The shader belongs to the shader cache
+        postprocessShader = nullptr;
         if (postprocessSampler) {
             delete postprocessSampler;
             postprocessSampler = nullptr;
@@ -6,7 +6,7 @@
 #include <material/material.hpp>
 #include <mesh/mesh.hpp>
 #include <random>
-#include <shader/shader.hpp>
+#include <shader/shader-cache.hpp>
 #include <texture/texture-utils.hpp>
 #include <texture/texture2d.hpp>
 #include <vector>
@@ -105,12 +105,8 @@ class Menustate : public our::State {
         // First, we create a material for the menu's background
         menuMaterial = new our::TexturedMaterial();
         // Here, we load the shader that will be used to draw the background
-        menuMaterial->shader = new our::ShaderProgram();
-        menuMaterial->shader->attach("assets/shaders/textured.vert",
-                                     GL_VERTEX_SHADER);
-        menuMaterial->shader->attach("assets/shaders/textured.frag",
-                                     GL_FRAGMENT_SHADER);
-        menuMaterial->shader->link();
+        menuMaterial->shader = our::ShaderCache::get("assets/shaders/textured.vert",
+                                                     "assets/shaders/textured.frag");
         // Then we load the menu texture
         menuMaterial->texture =
             our::texture_utils::loadImage("assets/textures/menu.png");
@@ -121,12 +117,8 @@ class Menustate : public our::State {
         highlightMaterial = new our::TintedMaterial();
         // Since the highlight is not textured, we used the tinted material
         // shaders
-        highlightMaterial->shader = new our::ShaderProgram();
-        highlightMaterial->shader->attach("assets/shaders/tinted.vert",
-                                          GL_VERTEX_SHADER);
-        highlightMaterial->shader->attach("assets/shaders/tinted.frag",
-                                          GL_FRAGMENT_SHADER);
-        highlightMaterial->shader->link();
+        highlightMaterial->shader = our::ShaderCache::get("assets/shaders/tinted.vert",
+                                                          "assets/shaders/tinted.frag");
         // The tint is white since we will subtract the background color from it
         // to create a negative effect.
         highlightMaterial->tint = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
@@ -229,12 +221,8 @@ class Menustate : public our::State {
 
         // Create material for animated images
         imageMaterial = new our::TexturedMaterial();
-        imageMaterial->shader = new our::ShaderProgram();
-        imageMaterial->shader->attach("assets/shaders/textured.vert",
-                                      GL_VERTEX_SHADER);
-        imageMaterial->shader->attach("assets/shaders/textured.frag",
-                                      GL_FRAGMENT_SHADER);
-        imageMaterial->shader->link();
+        imageMaterial->shader = our::ShaderCache::get("assets/shaders/textured.vert",
+                                                      "assets/shaders/textured.frag");
         imageMaterial->pipelineState.blending.enabled = true;
         imageMaterial->pipelineState.blending.equation = GL_FUNC_ADD;
         imageMaterial->pipelineState.blending.sourceFactor = GL_SRC_ALPHA;
@@ -490,9 +478,7 @@ class Menustate : public our::State {
         // Delete all the allocated resources
         delete rectangle;
         delete menuMaterial->texture;
-        delete menuMaterial->shader;
         delete menuMaterial;
-        delete highlightMaterial->shader;
         delete highlightMaterial;
 
         // Clean up audio resources
@@ -507,7 +493,6 @@ class Menustate : public our::State {
             delete img.texture;
             img.texture = nullptr;
         }
-        delete imageMaterial->shader;
         delete imageMaterial;
     }
 };
\ No newline at end of file
@@ -3,7 +3,12 @@
 #include <application.hpp>
 #include <asset-loader.hpp>
 #include <components/camera.hpp>
+#include <ecs/cooked-scene.hpp>
 #include <ecs/world.hpp>
+#include <ecs/world-snapshot.hpp>
+#include <gl-state.hpp>
+#include <shader/shader-cache.hpp>
+#include <stream-buffer.hpp>
 #include <systems/ambient-tension-system.hpp>
 #include <systems/footstep-system.hpp>
 #include <systems/forward-renderer.hpp>
@@ -14,6 +19,8 @@
 #include <systems/slenderman-ai.hpp>
 #include <systems/static-effect.hpp>
 #include <systems/static-sound-system.hpp>
+#include <systems/system-scheduler.hpp>
+#include <cmath>
 #include <fstream>
 #include <json/json.hpp>
 
@@ -34,6 +41,33 @@ class Playstate : public our::State {
     our::FootstepSystem footstepSystem;
     our::AmbientTensionSystem ambientTensionSystem;
     our::StaticSoundSystem staticSoundSystem;
+    // Runs the per-frame system updates (in parallel when they don't touch the same data)
+    our::SystemScheduler scheduler;
+    // The cooked version of the scene (if the config names one and it is up to date), used instead of the json while loading
+    our::CookedScene cookedScene;
+    // When "scene.keep_resident" is enabled in the config, leaving the play state keeps the assets, the world, the GPU objects
+    // and the static physics world alive. Playing again then only restores the dynamic state from the snapshot taken after
+    // the first load instead of loading everything again.
+    bool keepResident = false;
+    bool resident = false; // True if the previous session was kept alive
+    // The assets of the kept session. They are taken out of the asset loaders while the other states run, so that a state
+    // that loads assets with the same names or clears all the assets (e.g. the death state) can't touch them.
+    our::ReleasedAssets residentAssets;
+    our::WorldSnapshot initialSnapshot;
+    // The sound that each audio controller had right after the first load (the systems switch the tracks during the game)
+    struct AudioState {
+        our::AudioController* audio;
+        std::string file;
+        bool loop;
+        float volume;
+    };
+    std::vector<AudioState> initialAudio;
+    // The simulation runs at a fixed rate independent from the frame rate (see "scene.simulation" in the config)
+    float simulationStep = 1.0f / 60.0f; // The length of a simulation tick in seconds
+    int maxTicksPerFrame = 5; // Prevents a slow frame from queuing more ticks than we can catch up with
+    bool interpolateTransforms = true; // Whether to render between the last two ticks
+    float snapDistance = 2.0f; // Entities that moved further than this in one tick are not interpolated
+    double simulationAccumulator = 0.0; // The frame time that has not been simulated yet
     our::TextRenderer* textRenderer = nullptr;
     our::TexturedMaterial* loadingMaterial = nullptr;
     our::TintedMaterial* loadingBarMaterial = nullptr;
@@ -54,6 +88,7 @@ class Playstate : public our::State {
         LOADING_ASSETS,
         LOADING_WORLD,
         INITIALIZING_RENDERER,
+        COMPILING_SHADERS,    // Wait for the shaders that the driver compiles in the background
         INITIALIZING_SYSTEMS,
         COMPLETE_SPACE,
         COMPLETE
@@ -61,6 +96,8 @@ class Playstate : public our::State {
     
     LoadingStage loadingStage = LoadingStage::NOT_STARTED;
     float loadingProgress = 0.0f;
+    double loadingStartTime = 0.0; // Used to report how long the loading took
+    size_t shadersToCompile = 0; // The shaders that were still compiling when the renderer was initialized
     bool paused = false;
    
     // Helper function to load player config
@@ -77,6 +114,13 @@ class Playstate : public our::State {
     void onInitialize() override {
         // Reset pause state
         paused = false;
+        // If the previous session was kept alive, we only need to reset its dynamic state
+        if (resident) {
+            resident = false;
+            if (restoreSession()) return;
+            // The world can't be restored, so we throw away everything that was kept and load from scratch
+            destroySession();
+        }
         loadingStage = LoadingStage::NOT_STARTED;
         loadingProgress = 0.0f;
         textRenderer = nullptr;
@@ -90,10 +134,8 @@ class Playstate : public our::State {
     void initializeLoadingResources() {
         // Create material for loading screen
         loadingMaterial = new our::TexturedMaterial();
-        loadingMaterial->shader = new our::ShaderProgram();
-        loadingMaterial->shader->attach("assets/shaders/textured.vert", GL_VERTEX_SHADER);
-        loadingMaterial->shader->attach("assets/shaders/textured.frag", GL_FRAGMENT_SHADER);
-        loadingMaterial->shader->link();
+        loadingMaterial->shader = our::ShaderCache::get("assets/shaders/textured.vert",
+                                                        "assets/shaders/textured.frag");
         loadingMaterial->pipelineState.blending.enabled = true;
         loadingMaterial->pipelineState.blending.equation = GL_FUNC_ADD;
         loadingMaterial->pipelineState.blending.sourceFactor = GL_SRC_ALPHA;
@@ -101,10 +143,8 @@ class Playstate : public our::State {
 
         // Create material for loading bar
         loadingBarMaterial = new our::TintedMaterial();
-        loadingBarMaterial->shader = new our::ShaderProgram();
-        loadingBarMaterial->shader->attach("assets/shaders/tinted.vert", GL_VERTEX_SHADER);
-        loadingBarMaterial->shader->attach("assets/shaders/tinted.frag", GL_FRAGMENT_SHADER);
-        loadingBarMaterial->shader->link();
+        loadingBarMaterial->shader = our::ShaderCache::get("assets/shaders/tinted.vert",
+                                                           "assets/shaders/tinted.frag");
         loadingBarMaterial->pipelineState.blending.enabled = true;
         loadingBarMaterial->pipelineState.blending.equation = GL_FUNC_ADD;
         loadingBarMaterial->pipelineState.blending.sourceFactor = GL_SRC_ALPHA;
@@ -175,7 +215,18 @@ class Playstate : public our::State {
 
         switch (loadingStage) {
             case LoadingStage::LOADING_ASSETS:
-                if (config.contains("assets")) {
+                loadingStartTime = glfwGetTime();
+                our::ShaderCache::resetStats();
+                // The lit materials pick their shader permutations while they are loaded, so they need the renderer's features
+                our::ShaderCache::setFeatureDefines(
+                    our::ForwardRenderer::getShaderFeatures(config.value("renderer", nlohmann::json::object())));
+                // Prefer the cooked scene and fall back to the json config if it is missing or stale
+                if (!config.value("cooked", "").empty()) {
+                    cookedScene.open(config["cooked"].get<std::string>());
+                }
+                if (cookedScene.isOpen()) {
+                    our::deserializeAllAssets(cookedScene.getAssets());
+                } else if (config.contains("assets")) {
                     our::deserializeAllAssets(config["assets"]);
                 }
                 loadingProgress = 0.25f;
@@ -183,7 +234,10 @@ class Playstate : public our::State {
                 break;
                 
             case LoadingStage::LOADING_WORLD:
-                if (config.contains("world")) {
+                if (cookedScene.isOpen()) {
+                    world.deserialize(cookedScene);
+                    cookedScene.close();
+                } else if (config.contains("world")) {
                     world.deserialize(config["world"]);
                 }
                 loadingProgress = 0.50f;
@@ -192,26 +246,32 @@ class Playstate : public our::State {
                 
             case LoadingStage::INITIALIZING_RENDERER:
                 renderer.initialize(size, config["renderer"]);
+                renderer.setThreadPool(&scheduler.getThreadPool());
                 physicsSystem.initialize(&world);
+                shadersToCompile = our::ShaderCache::getPendingCount();
                 loadingProgress = 0.75f;
-                loadingStage = LoadingStage::INITIALIZING_SYSTEMS;
+                loadingStage = LoadingStage::COMPILING_SHADERS;
                 break;
-                
-            case LoadingStage::INITIALIZING_SYSTEMS:
-                cameraController.enter(getApp(), &physicsSystem);
-                slendermanAISystem.initialize(&world);
-                staticEffectSystem.initialize(&world);
-                pageSystem.initialize(&world, &physicsSystem, textRenderer, glm::vec2(size.x, size.y));
-                footstepSystem.initialize(&world, &physicsSystem);
-                ambientTensionSystem.initialize(&world);
-                staticSoundSystem.initialize(&world);
-                
-                {
-                    glm::vec2 centerPos = glm::vec2(size.x / 2.0f - 75, size.y / 2.0f);
-                    textRenderer->startTimedText("Collect " + std::to_string(pageSystem.totalPages) + " Pages", 
-                                               15.0f, centerPos, 0.5f, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+
+            case LoadingStage::COMPILING_SHADERS: {
+                // Only finish the shaders that are ready (for about a frame) so the loading screen keeps drawing
+                size_t remaining = our::ShaderCache::finishReady(1.0 / 60.0);
+                if (shadersToCompile > 0) {
+                    loadingProgress = 0.75f + 0.2f * (1.0f - (float)remaining / (float)shadersToCompile);
+                }
+                if (remaining == 0) {
+                    loadingProgress = 0.95f;
+                    loadingStage = LoadingStage::INITIALIZING_SYSTEMS;
                 }
+                break;
+            }
                 
+            case LoadingStage::INITIALIZING_SYSTEMS:
+                // Remember the state of the freshly loaded world before the systems start changing it
+                keepResident = config.value("keep_resident", false);
+                if (keepResident) captureSession();
+                initializeSystems();
+                reportLoadingTime();
                 loadingProgress = 1.0f;
                 loadingStage = LoadingStage::COMPLETE_SPACE;
                 break;
@@ -221,6 +281,138 @@ class Playstate : public our::State {
         }
     }
 
+    // Prints how long the loading took and where its shaders came from. A cold start compiles them while a warm start
+    // loads them from the binary cache (or finds them already compiled by a previous session).
+    void reportLoadingTime() {
+        const auto& stats = our::ShaderCache::getStats();
+        const char* start = !our::ShaderCache::isBinaryCacheEnabled() ? "no shader cache"
+                            : stats.compiled == 0                      ? "warm start"
+                            : stats.loaded == 0                        ? "cold start"
+                                                                       : "partially warm start";
+        std::cout << "Loading took " << (int)((glfwGetTime() - loadingStartTime) * 1000.0) << " ms (" << start << "): "
+                  << stats.compiled << " shader programs compiled, " << stats.loaded << " loaded from the cache, "
+                  << (int)(stats.seconds * 1000.0) << " ms spent linking them" << std::endl;
+    }
+
+    // Starts the systems of a new session (the world must be in its initial state)
+    void initializeSystems() {
+        auto& config = getApp()->getConfig()["scene"];
+        auto size = getApp()->getFrameBufferSize();
+        cameraController.enter(getApp(), &physicsSystem);
+        slendermanAISystem.initialize(&world);
+        staticEffectSystem.initialize(&world);
+        pageSystem.initialize(&world, &physicsSystem, textRenderer, glm::vec2(size.x, size.y));
+        footstepSystem.initialize(&world, &physicsSystem);
+        ambientTensionSystem.initialize(&world);
+        staticSoundSystem.initialize(&world);
+        scheduleSystems();
+        if (config.contains("simulation")) {
+            auto& simulation = config["simulation"];
+            simulationStep = 1.0f / glm::max(simulation.value("tick_rate", 60.0f), 1.0f);
+            maxTicksPerFrame = glm::max(simulation.value("max_ticks_per_frame", 5), 1);
+            interpolateTransforms = simulation.value("interpolate", true);
+            snapDistance = simulation.value("snap_distance", 2.0f);
+        }
+        simulationAccumulator = 0.0;
+        // There is no previous tick to interpolate from yet
+        world.beginTick();
+
+        glm::vec2 centerPos = glm::vec2(size.x / 2.0f - 75, size.y / 2.0f);
+        textRenderer->startTimedText("Collect " + std::to_string(pageSystem.totalPages) + " Pages", 
+                                   15.0f, centerPos, 0.5f, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+    }
+
+    // Saves the dynamic state of the freshly loaded world (the components that change during the game and the sounds)
+    void captureSession() {
+        initialSnapshot.capture<our::PlayerComponent, our::SlendermanComponent, our::CameraComponent,
+                                our::FreeCameraControllerComponent, our::LightComponent, our::MovementComponent,
+                                our::PageSpawnerComponent>(&world);
+        initialAudio.clear();
+        for (auto entity : world.getEntities()) {
+            for (auto audio : entity->getComponents<our::AudioController>()) {
+                initialAudio.push_back({audio, audio->getAudioFile(), audio->isLooping, audio->volume});
+            }
+        }
+    }
+
+    // Keeps the session alive when leaving the state, only the parts that belong to a single game are released
+    void suspendSession() {
+        pageSystem.removePages();
+        physicsSystem.removePlayerCollider();
+        cameraController.exit();
+        for (auto& state : initialAudio) state.audio->stopMusic();
+        textRenderer->clearTimedTexts();
+        residentAssets = our::releaseAllAssets();
+        resident = true;
+    }
+
+    // Puts the kept session back in its initial state and starts a new game without loading anything.
+    // Returns false if the world couldn't be restored.
+    bool restoreSession() {
+        our::restoreAllAssets(std::exchange(residentAssets, {}));
+        if (!initialSnapshot.restore(&world)) return false;
+        for (auto& state : initialAudio) {
+            state.audio->uninitializeMusic();
+            if (!state.file.empty() && state.audio->initializeMusic(state.file.c_str(), state.loop)) {
+                state.audio->setVolume(state.volume);
+            }
+        }
+        // Reset the systems that keep track of the previous game
+        ambientTensionSystem = our::AmbientTensionSystem();
+        staticSoundSystem = our::StaticSoundSystem();
+        footstepSystem = our::FootstepSystem();
+        cameraController = our::FreeCameraControllerSystem();
+        initializeSystems();
+        loadingStage = LoadingStage::COMPLETE;
+        loadingProgress = 1.0f;
+        return true;
+    }
+
+    // Registers the per-frame system updates in the scheduler along with what each of them reads and writes.
+    // Conflicting systems keep the order in which they are added here.
+    void scheduleSystems() {
+        using our::SystemAccess;
+        namespace Resource = our::SystemResource;
+        scheduler.clear();
+        scheduler.add("movement",
+            SystemAccess().read<our::MovementComponent>().writeResource(Resource::TRANSFORMS),
+            [this](float dt) { movementSystem.update(&world, dt); });
+        // The camera controller reads the input and may lock the mouse through GLFW, so it stays on the main thread
+        scheduler.add("camera controller",
+            SystemAccess().onMainThread()
+                .read<our::CameraComponent, our::FreeCameraControllerComponent>()
+                .write<our::PlayerComponent, our::AudioController>()
+                .readResource(Resource::INPUT)
+                .writeResource(Resource::TRANSFORMS | Resource::PHYSICS),
+            [this](float dt) { cameraController.update(&world, dt); });
+        // Rebuild the matrices of the entities that moved so that the following systems read cached matrices
+        scheduler.add("transforms",
+            SystemAccess().writeResource(Resource::TRANSFORMS),
+            [this](float) { world.updateTransforms(); });
+        // Raycasts are declared as physics writes since bullet's broadphase uses a shared stack for them
+        scheduler.add("slenderman ai",
+            SystemAccess().write<our::PlayerComponent, our::SlendermanComponent>()
+                .readResource(Resource::RENDERER)
+                .writeResource(Resource::TRANSFORMS | Resource::PHYSICS),
+            [this](float dt) { slendermanAISystem.update(&world, dt, &renderer, &physicsSystem); });
+        scheduler.add("static effect",
+            SystemAccess().read<our::PlayerComponent>().writeResource(Resource::RENDERER),
+            [this](float) { staticEffectSystem.update(&world, &renderer); });
+        scheduler.add("footstep",
+            SystemAccess().read<our::PlayerComponent>().write<our::AudioController>()
+                .writeResource(Resource::PHYSICS),
+            [this](float dt) { footstepSystem.update(&world, dt); });
+        scheduler.add("ambient tension",
+            SystemAccess().read<our::SlendermanComponent>().write<our::AudioController>(),
+            [this](float dt) { ambientTensionSystem.update(&world, dt); });
+        scheduler.add("static sound",
+            SystemAccess().read<our::PlayerComponent>().write<our::AudioController>(),
+            [this](float dt) { staticSoundSystem.update(&world, dt); });
+        scheduler.add("physics",
+            SystemAccess().writeResource(Resource::PHYSICS),
+            [this](float dt) { physicsSystem.update(dt, 1, dt); });
+    }
+
     void cleanupLoadingResources() {
         if (scratchyTexture) {
             delete scratchyTexture;
@@ -309,7 +501,7 @@ class Playstate : public our::State {
 
                 // Draw key icon
                 if (controlIcons[i].texture) {
-                    glBindSampler(0, 0);  // Unbind sampler before rendering
+                    our::gl_state::bindSampler(0, 0);  // Unbind sampler before rendering
                     loadingMaterial->texture = controlIcons[i].texture;
                     loadingMaterial->tint = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
                     loadingMaterial->setup();
@@ -425,6 +617,7 @@ class Playstate : public our::State {
                 case LoadingStage::LOADING_ASSETS: stageText = "Loading assets..."; break;
                 case LoadingStage::LOADING_WORLD: stageText = "Building world..."; break;
                 case LoadingStage::INITIALIZING_RENDERER: stageText = "Initializing renderer..."; break;
+                case LoadingStage::COMPILING_SHADERS: stageText = "Compiling shaders..."; break;
                 case LoadingStage::INITIALIZING_SYSTEMS: stageText = "Starting systems..."; break;
                 case LoadingStage::COMPLETE_SPACE: stageText = "Press Space To Continue"; break;
                 default: break;
@@ -543,30 +736,27 @@ class Playstate : public our::State {
             return; 
         }
 
-        // Here, we just run a bunch of systems to control the world logic
-        movementSystem.update(&world, (float)deltaTime);
-        cameraController.update(&world, (float)deltaTime);
-        slendermanAISystem.update(&world, (float)deltaTime, &renderer,
-                                  &physicsSystem);
-        staticEffectSystem.update(&world, &renderer);
-        footstepSystem.update(&world, (float)deltaTime);
-        ambientTensionSystem.update(&world, (float)deltaTime);
-        staticSoundSystem.update(&world, (float)deltaTime);
-
-        // Update physics
-        physicsSystem.update((float)deltaTime);
+        // Here, we run the systems that control the world logic (see "scheduleSystems") at a fixed rate.
+        // The frame time is accumulated and consumed in whole ticks. If a frame took so long that catching up would
+        // need more than "maxTicksPerFrame" ticks, the rest is dropped (the game slows down instead of freezing).
+        cameraController.collectInput();
+        simulationAccumulator += deltaTime;
+        int ticks = 0;
+        while (simulationAccumulator >= simulationStep && ticks < maxTicksPerFrame) {
+            world.beginTick();
+            scheduler.run(simulationStep);
+            simulationAccumulator -= simulationStep;
+            ticks++;
+        }
+        if (ticks == maxTicksPerFrame) simulationAccumulator = std::fmod(simulationAccumulator, (double)simulationStep);
 
         // Get camera position and forward for page interaction raycast
         glm::vec3 cameraPos(0), cameraForward(0, 0, -1);
-        for (auto entity : world.getEntities()) {
-            auto* camera = entity->getComponent<our::CameraComponent>();
-            if (camera) {
-                glm::mat4 matrix = entity->getLocalToWorldMatrix();
-                cameraPos = glm::vec3(matrix[3]);
-                cameraForward =
-                    glm::normalize(glm::vec3(matrix * glm::vec4(0, 0, -1, 0)));
-                break;
-            }
+        if (auto* entity = world.getSingleton<our::CameraComponent>()) {
+            glm::mat4 matrix = entity->getLocalToWorldMatrix();
+            cameraPos = glm::vec3(matrix[3]);
+            cameraForward =
+                glm::normalize(glm::vec3(matrix * glm::vec4(0, 0, -1, 0)));
         }
 
         // DEBUG: Print position
@@ -574,6 +764,18 @@ class Playstate : public our::State {
             std::cout << "Player Position: (" << cameraPos.x << ", " << cameraPos.y
                       << ", " << cameraPos.z << ")\n";
         }
+        // DEBUG: Print how many OpenGL state changes were sent and how many were filtered since the last print
+        if (our::g_debugMode && keyboard.justPressed(GLFW_KEY_F3)) {
+            const our::gl_state::Stats& stats = our::gl_state::getStats();
+            std::uint64_t total = stats.issued + stats.filtered;
+            std::cout << "GL state calls: " << stats.issued << " issued, " << stats.filtered << " filtered ("
+                      << (total ? 100.0 * stats.filtered / total : 0.0) << "% saved)\n";
+            our::gl_state::resetStats();
+            const our::stream_buffer::Stats& streamStats = our::stream_buffer::getStats();
+            std::cout << "Streamed: " << streamStats.frameBytes << " bytes last frame, " << streamStats.peakFrameBytes
+                      << " at most, " << streamStats.stalls << " stalls (" << streamStats.stallSeconds * 1000.0 << " ms)\n";
+            our::stream_buffer::resetStats();
+        }
 
         // Check for interact key
         bool interactPressed = false;
@@ -592,8 +794,15 @@ class Playstate : public our::State {
 
         textRenderer->updateTimedTexts((float)deltaTime);
 
-        // And finally we use the renderer system to draw the scene
+        // Pick up the transforms changed by the AI and page systems before rendering
+        world.updateTransforms();
+
+        // And finally we use the renderer system to draw the scene. The leftover time is part of a tick that hasn't run yet,
+        // so we draw the moving entities that far between their last two simulated states.
+        if (interpolateTransforms)
+            world.interpolateTransforms((float)(simulationAccumulator / simulationStep), snapDistance);
         renderer.render(&world, (float)deltaTime);
+        if (interpolateTransforms) world.restoreTransforms();
         auto size = getApp()->getFrameBufferSize();
         glm::mat4 projection =
             glm::ortho(0.0f, (float)size.x, (float)size.y, 0.0f);
@@ -609,6 +818,27 @@ class Playstate : public our::State {
     }
 
     void onDestroy() override {
+        // Keep the session alive if we are going to another state (but not if the application is closing)
+        if (keepResident && loadingStage == LoadingStage::COMPLETE && !initialSnapshot.empty() &&
+            !glfwWindowShouldClose(getApp()->getWindow())) {
+            suspendSession();
+            return;
+        }
+        destroySession();
+    }
+
+    void onShutdown() override {
+        // A session that was kept alive when we left the play state is released before the OpenGL context goes away
+        if (resident) destroySession();
+    }
+
+    // Releases everything that was loaded for the session
+    void destroySession() {
+        resident = false;
+        // The assets of a kept session are given back to the asset loaders so that they are deleted with the others
+        our::restoreAllAssets(std::exchange(residentAssets, {}));
+        initialSnapshot.clear();
+        initialAudio.clear();
         // Don't forget to destroy the renderer
         renderer.destroy();
         // Destroy physics system
@@ -618,6 +848,8 @@ class Playstate : public our::State {
         cameraController.exit();
         // Destroy page system
         pageSystem.destroy();
+        // Remove the system updates since they refer to this session's systems
+        scheduler.clear();
         if (textRenderer) {
             textRenderer->clearTimedTexts();
             delete textRenderer;
@@ -630,12 +862,10 @@ class Playstate : public our::State {
             loadingRectangle = nullptr;
         }
         if (loadingMaterial) {
-            delete loadingMaterial->shader;
             delete loadingMaterial;
             loadingMaterial = nullptr;
         }
         if (loadingBarMaterial) {
-            delete loadingBarMaterial->shader;
             delete loadingBarMaterial;
             loadingBarMaterial = nullptr;
         }
@@ -6,7 +6,7 @@
 #include <material/material.hpp>
 #include <mesh/mesh.hpp>
 #include <random>
-#include <shader/shader.hpp>
+#include <shader/shader-cache.hpp>
 #include <texture/texture-utils.hpp>
 #include <texture/texture2d.hpp>
 #include <vector>
@@ -440,28 +440,18 @@ class SettingsState : public our::State
 
         // Setting up the materials
         keyboardRectMat = new our::TintedMaterial();
-        keyboardRectMat->shader = new our::ShaderProgram();
-        keyboardRectMat->shader->attach("assets/shaders/tinted.vert",
-                                        GL_VERTEX_SHADER);
-        keyboardRectMat->shader->attach("assets/shaders/tinted.frag",
-                                        GL_FRAGMENT_SHADER);
-        keyboardRectMat->shader->link();
+        keyboardRectMat->shader = our::ShaderCache::get("assets/shaders/tinted.vert",
+                                                        "assets/shaders/tinted.frag");
         keyboardRectMat->tint = glm::vec4(61.0f / 255.0f, 61.0f / 255.0f, 61.0f / 255.0f, 1.0f);
 
         keyboardRectBackdropMat = new our::TintedMaterial();
-        keyboardRectBackdropMat->shader = new our::ShaderProgram();
-        keyboardRectBackdropMat->shader->attach("assets/shaders/tinted.vert",
-                                                GL_VERTEX_SHADER);
-        keyboardRectBackdropMat->shader->attach("assets/shaders/tinted.frag",
-                                                GL_FRAGMENT_SHADER);
-        keyboardRectBackdropMat->shader->link();
+        keyboardRectBackdropMat->shader = our::ShaderCache::get("assets/shaders/tinted.vert",
+                                                                "assets/shaders/tinted.frag");
         keyboardRectBackdropMat->tint = glm::vec4(32.0f / 255.0f, 32.0f / 255.0f, 32.0f / 255.0f, 1.0f);
 
         keyboardKeyMat = new our::TexturedMaterial();
-        keyboardKeyMat->shader = new our::ShaderProgram();
-        keyboardKeyMat->shader->attach("assets/shaders/keyboard.vert", GL_VERTEX_SHADER);
-        keyboardKeyMat->shader->attach("assets/shaders/keyboard.frag", GL_FRAGMENT_SHADER);
-        keyboardKeyMat->shader->link();
+        keyboardKeyMat->shader = our::ShaderCache::get("assets/shaders/keyboard.vert",
+                                                       "assets/shaders/keyboard.frag");
         keyboardKeyMat->tint = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
         keyboardKeyMat->pipelineState.blending.enabled = true;
         keyboardKeyMat->pipelineState.blending.equation = GL_FUNC_ADD;
@@ -476,18 +466,14 @@ class SettingsState : public our::State
         keyboardKeyMat->sampler->set(GL_TEXTURE_LOD_BIAS, -0.5f);
         // Create material for control labels
         controlLabelMat = new our::TintedMaterial();
-        controlLabelMat->shader = new our::ShaderProgram();
-        controlLabelMat->shader->attach("assets/shaders/tinted.vert", GL_VERTEX_SHADER);
-        controlLabelMat->shader->attach("assets/shaders/tinted.frag", GL_FRAGMENT_SHADER);
-        controlLabelMat->shader->link();
+        controlLabelMat->shader = our::ShaderCache::get("assets/shaders/tinted.vert",
+                                                        "assets/shaders/tinted.frag");
         controlLabelMat->tint = glm::vec4(200.0f / 255.0f, 200.0f / 255.0f, 200.0f / 255.0f, 1.0f);
 
         // Create material for flashing effect
         flashMat = new our::TintedMaterial();
-        flashMat->shader = new our::ShaderProgram();
-        flashMat->shader->attach("assets/shaders/tinted.vert", GL_VERTEX_SHADER);
-        flashMat->shader->attach("assets/shaders/tinted.frag", GL_FRAGMENT_SHADER);
-        flashMat->shader->link();
+        flashMat->shader = our::ShaderCache::get("assets/shaders/tinted.vert",
+                                                 "assets/shaders/tinted.frag");
         flashMat->pipelineState.blending.enabled = true;
         flashMat->pipelineState.blending.equation = GL_FUNC_ADD;
         flashMat->pipelineState.blending.sourceFactor = GL_SRC_ALPHA;
@@ -673,7 +659,7 @@ class SettingsState : public our::State
             keyboardKeyMat->shader->set("highlighted", keyboardIcons[i].highlighted);
             rectangle->draw();
         }
-        glBindSampler(0, 0);
+        our::gl_state::bindSampler(0, 0);
         
         // Draw control labels section
         for (auto &label : controlLabels)
@@ -780,15 +766,10 @@ class SettingsState : public our::State
             delete keyboardKeyMat->sampler;
         }
         delete rectangle;
-        delete keyboardRectMat->shader;
         delete keyboardRectMat;
-        delete keyboardRectBackdropMat->shader;
         delete keyboardRectBackdropMat;
-        delete keyboardKeyMat->shader;
         delete keyboardKeyMat;
-        delete controlLabelMat->shader;
         delete controlLabelMat;
-        delete flashMat->shader;
         delete flashMat;
         delete background;
         delete textRenderer;
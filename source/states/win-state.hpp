@@ -3,7 +3,7 @@
 #include <application.hpp>
 #include <material/material.hpp>
 #include <mesh/mesh.hpp>
-#include <shader/shader.hpp>
+#include <shader/shader-cache.hpp>
 #include <texture/texture-utils.hpp>
 #include <texture/texture2d.hpp>
 
@@ -29,12 +29,8 @@ class WinState : public our::State {
 
         // Create background material
         backgroundMaterial = new our::TexturedMaterial();
-        backgroundMaterial->shader = new our::ShaderProgram();
-        backgroundMaterial->shader->attach("assets/shaders/textured.vert",
-                                           GL_VERTEX_SHADER);
-        backgroundMaterial->shader->attach("assets/shaders/textured.frag",
-                                           GL_FRAGMENT_SHADER);
-        backgroundMaterial->shader->link();
+        backgroundMaterial->shader = our::ShaderCache::get("assets/shaders/textured.vert",
+                                                           "assets/shaders/textured.frag");
 
         // Use a dark/black texture or create solid color
         backgroundMaterial->tint = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
@@ -161,9 +157,6 @@ class WinState : public our::State {
 
     void onDestroy() override {
         if (backgroundMaterial) {
-            if (backgroundMaterial->shader) {
-                delete backgroundMaterial->shader;
-            }
             if (backgroundMaterial->texture) {
                 delete backgroundMaterial->texture;
             }
@@ -0,0 +1,40 @@
+#include <flags/flags.h>
+
+#include <ecs/cooked-scene.hpp>
+#include <fstream>
+#include <iostream>
+#include <json/json.hpp>
+
+// The scene cooker compiles the scene of an app config into a cooked scene file that the game maps at load time
+// instead of walking the json (see "common/ecs/cooked-scene.hpp").
+// Usage: SceneCooker -c config/app.jsonc [-o config/app.scene]
+// If no output is given, it uses the "cooked" path in the scene config.
+int main(int argc, char** argv) {
+    flags::args args(argc, argv);  // Parse the command line arguments
+    std::string config_path = args.get<std::string>("c", "config/app.jsonc");
+
+    // Open the config file and exit if failed
+    std::ifstream file_in(config_path);
+    if (!file_in) {
+        std::cerr << "Couldn't open file: " << config_path << std::endl;
+        return -1;
+    }
+    nlohmann::json app_config =
+        nlohmann::json::parse(file_in, nullptr, true, true);
+    file_in.close();
+
+    if (!app_config.contains("scene") || !app_config["scene"].is_object()) {
+        std::cerr << "The config has no scene: " << config_path << std::endl;
+        return -1;
+    }
+    const nlohmann::json& scene = app_config["scene"];
+    std::string output_path = args.get<std::string>("o", scene.value("cooked", ""));
+    if (output_path.empty()) {
+        std::cerr << "No output path, pass it with -o or set \"cooked\" in the scene config" << std::endl;
+        return -1;
+    }
+
+    if (!our::cooked_scene::cook(scene, config_path, output_path)) return -1;
+    std::cout << "Cooked " << config_path << " into " << output_path << std::endl;
+    return 0;
+}
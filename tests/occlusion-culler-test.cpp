@@ -0,0 +1,118 @@
+// Checks the CPU rasterizer and the box test of the occlusion culler (it doesn't need a GPU)
+#include <occlusion-culler.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+    int failures = 0;
+
+    void check(bool condition, const char* what) {
+        if (!condition) {
+            std::cerr << "FAILED: " << what << std::endl;
+            failures++;
+        }
+    }
+
+    // A projection where the clip space x & y are the world x & y and w is the world z, so a point (x, y, z) lands on
+    // the NDC (x / z, y / z) and its stored depth is 1 / z
+    glm::mat4 makeProjection() {
+        glm::mat4 projection(0.0f);
+        projection[0][0] = 1.0f;
+        projection[1][1] = 1.0f;
+        projection[2][3] = 1.0f;
+        return projection;
+    }
+
+    // Counts the pixels of the depth buffer that are covered by an occluder
+    int countCovered(const our::OcclusionCuller& culler) {
+        int covered = 0;
+        for (int y = 0; y < our::OcclusionCuller::HEIGHT; y++) {
+            for (int x = 0; x < our::OcclusionCuller::WIDTH; x++) covered += culler.getDepth(x, y) > 0.0f;
+        }
+        return covered;
+    }
+
+    void testTriangleCoverage() {
+        // At z = 2, the triangle covers the NDC (-0.5, -0.5), (0.5, -0.5), (-0.5, 0.5), which is the pixels from
+        // (64, 32) to (192, 96) below the diagonal: half of a 128 x 64 rectangle
+        our::OcclusionCuller culler;
+        culler.setOccluders({{-1.0f, -1.0f, 2.0f}, {1.0f, -1.0f, 2.0f}, {-1.0f, 1.0f, 2.0f}}, {0, 1, 2});
+        culler.render(makeProjection());
+
+        check(std::abs(culler.getDepth(80, 40) - 0.5f) < 1e-5f, "a pixel inside the triangle stores 1/w");
+        check(std::abs(culler.getDepth(64, 32) - 0.5f) < 1e-5f, "the corner pixel of the triangle is covered");
+        check(culler.getDepth(180, 90) == 0.0f, "a pixel beyond the diagonal is not covered");
+        check(culler.getDepth(10, 10) == 0.0f, "a pixel outside the bounds of the triangle is not covered");
+        int covered = countCovered(culler);
+        check(std::abs(covered - 128 * 64 / 2) <= 128, "the triangle covers half of its bounding rectangle");
+
+        // The same triangle wound clockwise is a back face
+        culler.setOccluders({{-1.0f, -1.0f, 2.0f}, {-1.0f, 1.0f, 2.0f}, {1.0f, -1.0f, 2.0f}}, {0, 1, 2});
+        culler.render(makeProjection());
+        check(countCovered(culler) == 0, "back faces are not rasterized");
+    }
+
+    void testNearPlaneClipping() {
+        // A floor (y = -1) that goes from z = 2 to behind the camera (z = -2), so it crosses w = 0. Once clipped, it
+        // covers the bottom of the screen below its far edge (NDC y = -0.5) down to the bottom border.
+        our::OcclusionCuller culler;
+        culler.setOccluders({{-1.0f, -1.0f, 2.0f}, {0.0f, -1.0f, -2.0f}, {1.0f, -1.0f, 2.0f}}, {0, 1, 2});
+        culler.render(makeProjection());
+
+        bool finite = true;
+        float nearest = 0.0f;
+        for (int y = 0; y < our::OcclusionCuller::HEIGHT; y++) {
+            for (int x = 0; x < our::OcclusionCuller::WIDTH; x++) {
+                float depth = culler.getDepth(x, y);
+                finite = finite && std::isfinite(depth) && depth >= 0.0f;
+                nearest = std::max(nearest, depth);
+            }
+        }
+        check(finite, "the clipped triangle only stores finite and positive depths");
+        check(nearest <= 1.0f / our::OcclusionCuller::NEAR_W + 1e-3f, "nothing is nearer than the near plane");
+
+        // The pixel (128, 16) is at NDC y = -0.742, where the floor is at z = 1 / 0.742
+        float ndcY = (16.5f / our::OcclusionCuller::HEIGHT) * 2.0f - 1.0f;
+        check(std::abs(culler.getDepth(128, 16) - (-ndcY)) < 1e-3f, "the clipped triangle interpolates 1/w");
+        check(culler.getDepth(128, 0) > culler.getDepth(128, 16), "the floor gets nearer towards the bottom");
+        check(culler.getDepth(128, 40) == 0.0f, "nothing is drawn above the far edge of the floor");
+    }
+
+    void testBoxVisibility() {
+        // A wall at z = 5 that covers the left half of the screen (NDC x from -1 to 0)
+        our::OcclusionCuller culler;
+        check(culler.isBoxVisible({-3.0f, -1.0f, 10.0f}, {-2.0f, 1.0f, 11.0f}), "every box is visible before a render");
+        culler.setOccluders({{-5.0f, -5.0f, 5.0f}, {0.0f, -5.0f, 5.0f}, {0.0f, 5.0f, 5.0f}, {-5.0f, 5.0f, 5.0f}},
+                            {0, 1, 2, 0, 2, 3});
+        culler.render(makeProjection());
+
+        check(!culler.isBoxVisible({-3.0f, -1.0f, 10.0f}, {-2.0f, 1.0f, 11.0f}), "a box behind the wall is hidden");
+        check(culler.isBoxVisible({2.0f, -1.0f, 10.0f}, {3.0f, 1.0f, 11.0f}), "a box beside the wall is visible");
+        check(culler.isBoxVisible({-1.5f, -0.5f, 3.0f}, {-1.0f, 0.5f, 3.5f}), "a box in front of the wall is visible");
+        check(culler.isBoxVisible({-1.0f, -1.0f, 10.0f}, {1.0f, 1.0f, 11.0f}), "a box straddling the wall's edge is visible");
+        check(culler.isBoxVisible({-3.0f, -1.0f, -1.0f}, {-2.0f, 1.0f, 11.0f}), "a box reaching behind the camera is visible");
+
+        // A box is only hidden if it is behind the wall by more than the depth bias
+        culler.depthBias = 1.0f;
+        check(culler.isBoxVisible({-3.0f, -0.5f, 5.99f}, {-2.5f, 0.5f, 7.0f}), "a box within the depth bias is visible");
+        check(!culler.isBoxVisible({-3.0f, -0.5f, 6.01f}, {-2.5f, 0.5f, 7.0f}), "a box beyond the depth bias is hidden");
+        culler.depthBias = 3.0f;
+        check(culler.isBoxVisible({-3.0f, -0.5f, 6.01f}, {-2.5f, 0.5f, 7.0f}), "a larger depth bias keeps the box visible");
+    }
+
+}
+
+int main() {
+    testTriangleCoverage();
+    testNearPlaneClipping();
+    testBoxVisibility();
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All the occlusion culler checks passed" << std::endl;
+    return 0;
+}